@@ -0,0 +1,1120 @@
+#include "compact.h"
+#include "import.h"
+#include "path_edit.h"
+#include "point_index.h"
+#include "point_store.h"
+#include "project.h"
+#include "pyramid.h"
+#include "render.h"
+#include "transform.h"
+
+#include <glib/gstdio.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*  Benchmarks of the data and rendering code
+ *
+ *      make bench
+ *      ./point-drawer-bench --output bench.json --max-points 100000
+ *
+ *  Synthetic projects are generated for every combination of number
+ *  of paths, number of points (in all the paths together) and kind of
+ *  data. Every operation is run `--repeats` times and results go out
+ *  as JSON, so runs of different versions can be compared by a script.
+ *
+ *  Drawing goes into an off-screen image surface of the given size,
+ *  so it neither needs a display nor depends on one. Frames drawn in
+ *  tiles are compared with ones drawn by a single thread pixel by pixel.
+ *  */
+
+#define BENCH_WIDTH  1920
+#define BENCH_HEIGHT 1080
+
+// Same free space around the drawing as in <Preview> tab
+#define BENCH_PADDING 10
+
+// Set by `make bench`, so results can be traced back to the code
+#ifndef BENCH_REVISION
+#define BENCH_REVISION "unknown"
+#endif
+
+static const gsize n_paths_variants[]  = { 1, 10, 100 };
+static const gsize n_points_variants[] = { 1000, 10000, 100000, 1000000, 10000000 };
+
+typedef enum {
+  DATA_RANDOM_WALK,
+  DATA_SINE,
+  DATA_SCATTER, // <-- Every point is anywhere in the square, like noise
+
+  N_DATA_KINDS
+} data_kind_t;
+
+static const gchar* data_kind_names[N_DATA_KINDS] = { "random_walk", "sine", "scatter" };
+
+typedef struct {
+  data_kind_t kind;
+  gsize       n_paths;
+  gsize       n_points;
+} dataset_t;
+
+// Points are the same from run to run, so runs can be compared
+#define BENCH_SEED 42
+
+static point_store_t* generate_store(const dataset_t* dataset) {
+  point_store_t* store = point_store_new();
+  GRand* rand = g_rand_new_with_seed(BENCH_SEED);
+
+  gsize n_path_points = MAX(1, dataset->n_points / dataset->n_paths);
+
+  for (gsize i = 0; i < dataset->n_paths; ++ i) {
+    gchar* name = g_strdup_printf("path %zu", i);
+    path_t* path = point_store_add_path(store, name);
+    g_free(name);
+
+    path_reserve(path, n_path_points);
+
+    gdouble x = 0.0, y = 0.0;
+
+    for (gsize j = 0; j < n_path_points; ++ j) {
+      if (dataset->kind == DATA_RANDOM_WALK) {
+        x += g_rand_double_range(rand, -1.0, 1.0);
+        y += g_rand_double_range(rand, -1.0, 1.0);
+      } else if (dataset->kind == DATA_SCATTER) {
+        x = g_rand_double_range(rand, 0.0, 100.0);
+        y = g_rand_double_range(rand, 0.0, 100.0);
+      } else {
+        // Every path spans the same 100 units, one above the other
+        x = 100.0 * j / n_path_points;
+        y = 3.0 * i + sin(x);
+      }
+
+      path_append_point(path, x, y);
+    }
+  }
+
+  g_rand_free(rand);
+  return store;
+}
+
+typedef struct {
+  gint64* times; // <-- Microseconds
+  gsize   n_times;
+} timings_t;
+
+static int compare_times(const void* first, const void* second) {
+  gint64 first_time = *(const gint64*) first, second_time = *(const gint64*) second;
+  return (first_time > second_time) - (first_time < second_time);
+}
+
+// Results are kept as text, they are written all at once in the end
+static GString* results = NULL;
+
+static void add_result(const gchar* benchmark, const dataset_t* dataset, timings_t* timings) {
+  qsort(timings->times, timings->n_times, sizeof(gint64), compare_times);
+
+  gint64 median = timings->times[timings->n_times / 2];
+
+  if (results->len != 0)
+    g_string_append(results, ",\n");
+
+  g_string_append_printf(results,
+    "    { \"benchmark\": \"%s\", \"data\": \"%s\", \"n_paths\": %zu, \"n_points\": %zu, "
+    "\"repeats\": %zu, \"min_ms\": %.3f, \"median_ms\": %.3f, \"max_ms\": %.3f }",
+    benchmark, data_kind_names[dataset->kind], dataset->n_paths, dataset->n_points,
+    timings->n_times,
+    timings->times[0] / 1000.0, median / 1000.0,
+    timings->times[timings->n_times - 1] / 1000.0);
+
+  // Progress goes to stderr, so JSON can be written to stdout
+  g_printerr("%-28s %-12s %4zu paths %9zu points: %10.3f ms\n",
+             benchmark, data_kind_names[dataset->kind],
+             dataset->n_paths, dataset->n_points, median / 1000.0);
+}
+
+// Memory taken by points of compact paths and how far they are off
+static void add_compact_result(const dataset_t* dataset,
+                               gdouble bytes_per_point, gdouble max_error) {
+  if (results->len != 0)
+    g_string_append(results, ",\n");
+
+  g_string_append_printf(results,
+    "    { \"benchmark\": \"compact_size\", \"data\": \"%s\", \"n_paths\": %zu, "
+    "\"n_points\": %zu, \"bytes_per_point\": %.3f, \"max_error\": %.3g }",
+    data_kind_names[dataset->kind], dataset->n_paths, dataset->n_points,
+    bytes_per_point, max_error);
+
+  g_printerr("%-28s %-12s %4zu paths %9zu points: %7.3f bytes per point, error %.3g\n",
+             "compact_size", data_kind_names[dataset->kind],
+             dataset->n_paths, dataset->n_points, bytes_per_point, max_error);
+}
+
+static cairo_t* create_target(void) {
+  cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+                                                        BENCH_WIDTH, BENCH_HEIGHT);
+  cairo_t* cr = cairo_create(surface);
+  cairo_surface_destroy(surface);
+
+  return cr;
+}
+
+static void clear_target(cairo_t* cr) {
+  cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
+  cairo_paint(cr);
+
+  // Image surface is only written to when it's flushed
+  cairo_surface_flush(cairo_get_target(cr));
+}
+
+// Makes caches of all the paths stale, as if every path has just changed
+static void invalidate_caches(point_store_t* store) {
+  for (gsize i = 0; i < store->n_paths; ++ i)
+    ++ store->paths[i]->version;
+}
+
+// What `update_min_and_max_points` used to do on every frame:
+// walks over all the points to find extents of the store
+static void bench_bounds(point_store_t* store, const dataset_t* dataset, gsize n_repeats) {
+  timings_t timings = { g_new(gint64, n_repeats), n_repeats };
+
+  for (gsize i = 0; i < n_repeats; ++ i) {
+    gint64 start = g_get_monotonic_time();
+
+    for (gsize j = 0; j < store->n_paths; ++ j)
+      path_update_bounds(store->paths[j]);
+
+    timings.times[i] = g_get_monotonic_time() - start;
+  }
+
+  add_result("update_bounds", dataset, &timings);
+
+  // And what is done on every frame now, when bounds are kept up to date
+  for (gsize i = 0; i < n_repeats; ++ i) {
+    gint64 start = g_get_monotonic_time();
+
+    bounds_t viewport;
+    render_fit_viewport(store, &viewport);
+
+    timings.times[i] = g_get_monotonic_time() - start;
+  }
+
+  add_result("fit_viewport", dataset, &timings);
+  g_free(timings.times);
+}
+
+// What the main thread spends on every frame drawn by the render worker,
+// before and after it: points are shared, so it only depends on paths
+static void bench_snapshot(point_store_t* store, const dataset_t* dataset, gsize n_repeats) {
+  timings_t timings = { g_new(gint64, n_repeats), n_repeats };
+
+  for (gsize i = 0; i < n_repeats; ++ i) {
+    gint64 start = g_get_monotonic_time();
+
+    point_store_free(point_store_snapshot(store));
+
+    timings.times[i] = g_get_monotonic_time() - start;
+  }
+
+  add_result("snapshot", dataset, &timings);
+
+  // The way render worker takes them, refilling the last one
+  point_store_t* snapshot = point_store_snapshot(store);
+
+  for (gsize i = 0; i < n_repeats; ++ i) {
+    gint64 start = g_get_monotonic_time();
+
+    point_store_snapshot_release(snapshot);
+    snapshot = point_store_snapshot_reuse(store, snapshot);
+
+    timings.times[i] = g_get_monotonic_time() - start;
+  }
+
+  point_store_free(snapshot);
+
+  add_result("snapshot_reuse", dataset, &timings);
+  g_free(timings.times);
+}
+
+// Pyramids are built from scratch, as if all the points have just been
+// imported, it's what the first frame of a project without them costs
+static void bench_pyramid(point_store_t* store, const dataset_t* dataset, gsize n_repeats) {
+  timings_t timings = { g_new(gint64, n_repeats), n_repeats };
+
+  for (gsize i = 0; i < n_repeats; ++ i) {
+    for (gsize j = 0; j < store->n_paths; ++ j)
+      if (store->paths[j]->pyramid != NULL)
+        pyramid_truncate(store->paths[j]->pyramid, 0);
+
+    gint64 start = g_get_monotonic_time();
+
+    for (gsize j = 0; j < store->n_paths; ++ j)
+      pyramid_get(store->paths[j]);
+
+    timings.times[i] = g_get_monotonic_time() - start;
+  }
+
+  add_result("pyramid_build", dataset, &timings);
+  g_free(timings.times);
+}
+
+// Picks are this close to the points they aim at, as in <Preview> tab
+#define PICK_RADIUS 8
+
+// Picks are timed in batches, a single one takes microseconds
+#define N_PICKS 100
+
+// Nearest point among all the paths, the same way `pick_point` does it in
+// main.c. Brute force version is only there to check the indexed one
+static gboolean pick_point(point_store_t* store, const transform_t* transform,
+                           gdouble x, gdouble y, gboolean is_brute_force,
+                           gsize* path_index, gsize* point_index) {
+  gboolean is_picked = FALSE;
+  gdouble  radius    = PICK_RADIUS;
+
+  for (gsize i = 0; i < store->n_paths; ++ i) {
+    path_t* path = store->paths[i];
+
+    gsize   nearest  = 0;
+    gdouble distance = radius * radius;
+
+    gboolean is_found = FALSE;
+
+    if (!is_brute_force) {
+      const point_index_t* index = point_index_get(path);
+
+      is_found = index != NULL &&
+        point_index_find_nearest(index, path, transform, x, y, radius, &nearest, &distance);
+    } else
+      for (gsize j = 0; j < path->n_points; ++ j) {
+        gdouble delta_x = transform_x(transform, path->xs[j]) - x;
+        gdouble delta_y = transform_y(transform, path->ys[j]) - y;
+
+        gdouble point_distance = delta_x * delta_x + delta_y * delta_y;
+
+        if (point_distance < distance || (!is_found && point_distance <= distance)) {
+          nearest  = j;
+          distance = point_distance;
+          is_found = TRUE;
+        }
+      }
+
+    if (is_found) {
+      *path_index  = i;
+      *point_index = nearest;
+
+      radius    = sqrt(distance);
+      is_picked = TRUE;
+    }
+  }
+
+  return is_picked;
+}
+
+// Cursor somewhere around a random point, as if user aimed at it
+static void get_random_cursor(point_store_t* store, const transform_t* transform,
+                              GRand* rand, gdouble* x, gdouble* y) {
+  path_t* path = store->paths[g_rand_int_range(rand, 0, store->n_paths)];
+  gsize index = g_rand_int_range(rand, 0, path->n_points);
+
+  *x = transform_x(transform, path->xs[index]) + g_rand_double_range(rand, -PICK_RADIUS, PICK_RADIUS);
+  *y = transform_y(transform, path->ys[index]) + g_rand_double_range(rand, -PICK_RADIUS, PICK_RADIUS);
+}
+
+// Point indices are built, then points are picked and dragged the way
+// they are on `drawing_area`. Picks are checked against brute force
+static gboolean bench_picking(point_store_t* store, const dataset_t* dataset,
+                              gsize n_repeats) {
+  timings_t timings = { g_new(gint64, n_repeats), n_repeats };
+
+  bounds_t viewport;
+  render_fit_viewport(store, &viewport);
+
+  transform_t transform =
+    transform_for_viewport(&viewport, BENCH_WIDTH, BENCH_HEIGHT, BENCH_PADDING);
+
+  for (gsize i = 0; i < n_repeats; ++ i) {
+    for (gsize j = 0; j < store->n_paths; ++ j)
+      if (store->paths[j]->point_index != NULL) {
+        point_index_free(store->paths[j]->point_index);
+        store->paths[j]->point_index = NULL;
+      }
+
+    gint64 start = g_get_monotonic_time();
+
+    for (gsize j = 0; j < store->n_paths; ++ j)
+      point_index_get(store->paths[j]);
+
+    timings.times[i] = g_get_monotonic_time() - start;
+  }
+
+  add_result("point_index_build", dataset, &timings);
+
+  GRand* rand = g_rand_new_with_seed(BENCH_SEED);
+  gboolean is_correct = TRUE;
+
+  for (gsize i = 0; i < n_repeats && is_correct; ++ i) {
+    gdouble x, y;
+    get_random_cursor(store, &transform, rand, &x, &y);
+
+    gsize path_index = 0, point_index = 0, expected_path = 0, expected_point = 0;
+
+    gboolean is_picked = pick_point(store, &transform, x, y, FALSE, &path_index, &point_index);
+    gboolean is_expected = pick_point(store, &transform, x, y, TRUE,
+                                      &expected_path, &expected_point);
+
+    // Points at the same distance may be picked either way
+    if (is_picked != is_expected || (is_picked &&
+        (path_index != expected_path || point_index != expected_point))) {
+      path_t* path     = store->paths[path_index];
+      path_t* expected = store->paths[expected_path];
+
+      gboolean is_tie = is_picked && is_expected &&
+        transform_x(&transform, path->xs[point_index]) == transform_x(&transform, expected->xs[expected_point]) &&
+        transform_y(&transform, path->ys[point_index]) == transform_y(&transform, expected->ys[expected_point]);
+
+      if (!is_tie) {
+        g_printerr("Picked wrong point at (%g, %g)\n", x, y);
+        is_correct = FALSE;
+      }
+    }
+  }
+
+  for (gsize i = 0; i < n_repeats; ++ i) {
+    gint64 start = g_get_monotonic_time();
+
+    for (gsize j = 0; j < N_PICKS; ++ j) {
+      gdouble x, y;
+      get_random_cursor(store, &transform, rand, &x, &y);
+
+      gsize path_index, point_index;
+      pick_point(store, &transform, x, y, FALSE, &path_index, &point_index);
+    }
+
+    timings.times[i] = g_get_monotonic_time() - start;
+  }
+
+  add_result("pick_100", dataset, &timings);
+
+  // Middle point of the first path is dragged around and put back
+  path_t* path  = store->paths[0];
+  gsize   index = path->n_points / 2;
+
+  gdouble original_x = path->xs[index], original_y = path->ys[index];
+
+  for (gsize i = 0; i < n_repeats; ++ i) {
+    gint64 start = g_get_monotonic_time();
+
+    for (gsize j = 0; j < N_PICKS; ++ j) {
+      gdouble x, y;
+      get_random_cursor(store, &transform, rand, &x, &y);
+
+      path_set_point(path, index, transform_inverse_x(&transform, x),
+                                  transform_inverse_y(&transform, y));
+
+      gsize path_index, point_index;
+      pick_point(store, &transform, x, y, FALSE, &path_index, &point_index);
+    }
+
+    timings.times[i] = g_get_monotonic_time() - start;
+  }
+
+  add_result("drag_100", dataset, &timings);
+
+  // Same with render worker drawing all the time: every move comes while
+  // a snapshot from the frame before is still read, and starts a new frame
+  point_store_t* snapshot = point_store_snapshot(store);
+
+  for (gsize i = 0; i < n_repeats; ++ i) {
+    gint64 start = g_get_monotonic_time();
+
+    for (gsize j = 0; j < N_PICKS; ++ j) {
+      gdouble x, y;
+      get_random_cursor(store, &transform, rand, &x, &y);
+
+      path_set_point(path, index, transform_inverse_x(&transform, x),
+                                  transform_inverse_y(&transform, y));
+
+      point_store_free(snapshot);
+      snapshot = point_store_snapshot(store);
+
+      gsize path_index, point_index;
+      pick_point(store, &transform, x, y, FALSE, &path_index, &point_index);
+    }
+
+    timings.times[i] = g_get_monotonic_time() - start;
+  }
+
+  add_result("drag_100_in_frames", dataset, &timings);
+  point_store_free(snapshot);
+
+  path_set_point(path, index, original_x, original_y);
+
+  g_rand_free(rand);
+  g_free(timings.times);
+
+  return is_correct;
+}
+
+// Largest error of compact points relative to the extents of their path
+static gdouble get_compact_error(const path_t* path, const path_t* original) {
+  gdouble extent = MAX(original->bounds.max.x - original->bounds.min.x,
+                       original->bounds.max.y - original->bounds.min.y);
+  if (extent == 0.0)
+    return 0.0;
+
+  gdouble xs[COMPACT_BLOCK_SIZE], ys[COMPACT_BLOCK_SIZE];
+  gdouble max_error = 0.0;
+
+  for (gsize from = 0; from < path->n_points; from += COMPACT_BLOCK_SIZE) {
+    gsize n_read = MIN(COMPACT_BLOCK_SIZE, path->n_points - from);
+    path_get_points(path, from, n_read, xs, ys);
+
+    for (gsize i = 0; i < n_read; ++ i) {
+      max_error = MAX(max_error, fabs(xs[i] - original->xs[from + i]));
+      max_error = MAX(max_error, fabs(ys[i] - original->ys[from + i]));
+    }
+  }
+
+  return max_error / extent;
+}
+
+// Encoding all the paths as compact (like `--compact` import does) and
+// decoding them back, which is what drawing them costs on top of the usual.
+// Error has to stay within what compact.h promises
+static gboolean bench_compact(point_store_t* store, const dataset_t* dataset,
+                              gsize n_repeats) {
+  timings_t encode_timings = { g_new(gint64, n_repeats), n_repeats };
+  timings_t decode_timings = { g_new(gint64, n_repeats), n_repeats };
+
+  // Original points stay in the snapshot
+  point_store_t* original = point_store_snapshot(store);
+
+  gdouble xs[COMPACT_BLOCK_SIZE], ys[COMPACT_BLOCK_SIZE];
+
+  for (gsize i = 0; i < n_repeats; ++ i) {
+    for (gsize j = 0; j < store->n_paths; ++ j)
+      path_set_compact(store->paths[j], FALSE);
+
+    gint64 start = g_get_monotonic_time();
+
+    for (gsize j = 0; j < store->n_paths; ++ j)
+      path_set_compact(store->paths[j], TRUE);
+
+    encode_timings.times[i] = g_get_monotonic_time() - start;
+    start = g_get_monotonic_time();
+
+    for (gsize j = 0; j < store->n_paths; ++ j) {
+      path_t* path = store->paths[j];
+
+      for (gsize from = 0; from < path->n_points; from += COMPACT_BLOCK_SIZE)
+        path_get_points(path, from, MIN(COMPACT_BLOCK_SIZE, path->n_points - from), xs, ys);
+    }
+
+    decode_timings.times[i] = g_get_monotonic_time() - start;
+  }
+
+  add_result("compact_encode", dataset, &encode_timings);
+  add_result("compact_decode", dataset, &decode_timings);
+
+  gsize n_bytes = 0, n_points = 0;
+  gdouble max_error = 0.0;
+
+  for (gsize i = 0; i < store->n_paths; ++ i) {
+    path_t* path = store->paths[i];
+
+    n_bytes  += compact_get_size(path->compact, path->n_encoded / COMPACT_BLOCK_SIZE) +
+                path->capacity * 2 * sizeof(gdouble);
+    n_points += path->n_points;
+
+    max_error = MAX(max_error, get_compact_error(path, original->paths[i]));
+    path_set_compact(path, FALSE);
+  }
+
+  add_compact_result(dataset, (gdouble) n_bytes / n_points, max_error);
+
+  point_store_free(original);
+  g_free(encode_timings.times);
+  g_free(decode_timings.times);
+
+  if (max_error <= 1.0 / G_MAXUINT32)
+    return TRUE;
+
+  g_printerr("Compact points are off by %.3g of path extents (%s, %zu paths, %zu points)\n",
+             max_error, data_kind_names[dataset->kind], dataset->n_paths, dataset->n_points);
+
+  return FALSE;
+}
+
+// Edited paths keep their bounds up to date without walking over their
+// points again, so they must be the same as walking over them gives
+static gboolean check_edited_bounds(point_store_t* store, const gchar* benchmark,
+                                    const dataset_t* dataset) {
+  for (gsize i = 0; i < store->n_paths; ++ i) {
+    path_t* path = store->paths[i];
+    bounds_t bounds = path->bounds;
+
+    path_update_bounds(path);
+
+    if (!bounds_equal(&bounds, &path->bounds)) {
+      g_printerr("Bounds are off after %s (%s, %zu paths, %zu points)\n", benchmark,
+                 data_kind_names[dataset->kind], dataset->n_paths, dataset->n_points);
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+// Whole paths rotated and resampled at once (see path_edit.h), all
+// paths of the store are selected. Resampling keeps number of points
+static gboolean bench_edit(point_store_t* store, const dataset_t* dataset,
+                           gsize n_repeats) {
+  timings_t timings = { g_new(gint64, n_repeats), n_repeats };
+
+  affine_t rotation = affine_rotation(G_PI / 6, (point_t) { 0.0, 0.0 });
+
+  for (gsize i = 0; i < n_repeats; ++ i) {
+    gint64 start = g_get_monotonic_time();
+
+    paths_transform(store->paths, store->n_paths, &rotation);
+
+    timings.times[i] = g_get_monotonic_time() - start;
+  }
+
+  add_result("path_transform", dataset, &timings);
+  gboolean is_correct = check_edited_bounds(store, "path_transform", dataset);
+
+  gsize n_path_points = MAX(2, dataset->n_points / dataset->n_paths);
+
+  for (gsize i = 0; i < n_repeats; ++ i) {
+    gint64 start = g_get_monotonic_time();
+
+    paths_resample(store->paths, store->n_paths, n_path_points);
+
+    timings.times[i] = g_get_monotonic_time() - start;
+  }
+
+  add_result("path_resample", dataset, &timings);
+  is_correct = check_edited_bounds(store, "path_resample", dataset) && is_correct;
+
+  g_free(timings.times);
+  return is_correct;
+}
+
+// Part of the fitted viewport `bench_drawing` zooms into, along each side
+#define ZOOM_FACTOR 10
+
+// Warm frames (same data, same target) must not allocate anything,
+// see `n_allocations` in render.h
+static gboolean check_allocations(renderer_t* renderer, const gchar* benchmark,
+                                  const dataset_t* dataset) {
+  gsize n_allocations = renderer_get_stats(renderer)->n_allocations;
+  if (n_allocations == 0)
+    return TRUE;
+
+  g_printerr("%s allocated %zu times in a warm frame (%s, %zu paths, %zu points)\n",
+             benchmark, n_allocations, data_kind_names[dataset->kind],
+             dataset->n_paths, dataset->n_points);
+
+  return FALSE;
+}
+
+// Tile threads have their own buffers, each of them has to draw the
+// biggest tile at least once before frames stop allocating
+#define MAX_WARMUP_FRAMES 50
+
+// Tiles are drawn with LOD and culling of the whole frame (see `draw_tile`),
+// but cairo may antialias pixels on the edges of tiles a bit differently,
+// so every channel of tiled and serial pixels may differ by this much
+#define TILED_TOLERANCE 2
+
+// Draws the same frame by the calling thread alone and in tiles, every
+// channel of every pixel has to be within TILED_TOLERANCE of the other
+static gboolean check_tiled_frame(point_store_t* store, const bounds_t* viewport,
+                                  const gchar* benchmark, const dataset_t* dataset) {
+  cairo_t* serial_cr = create_target();
+  cairo_t* tiled_cr  = create_target();
+  renderer_t* renderer = renderer_new();
+
+  render_settings_t settings;
+  render_settings_init(&settings);
+
+  clear_target(serial_cr);
+  settings.n_threads = 1;
+
+  render_frame(renderer, serial_cr, store, &settings, viewport,
+               BENCH_PADDING, BENCH_WIDTH, BENCH_HEIGHT);
+
+  // Even with a single core picture is split into tiles
+  clear_target(tiled_cr);
+  settings.n_threads = MAX(2, (int) g_get_num_processors());
+
+  render_frame(renderer, tiled_cr, store, &settings, viewport,
+               BENCH_PADDING, BENCH_WIDTH, BENCH_HEIGHT);
+
+  cairo_surface_t* serial = cairo_get_target(serial_cr);
+  cairo_surface_t* tiled  = cairo_get_target(tiled_cr);
+
+  cairo_surface_flush(serial);
+  cairo_surface_flush(tiled);
+
+  // Both of them are ARGB32 surfaces of the same size
+  const guchar* serial_data = cairo_image_surface_get_data(serial);
+  const guchar* tiled_data  = cairo_image_surface_get_data(tiled);
+  int stride = cairo_image_surface_get_stride(serial);
+
+  gsize n_different = 0;
+  int max_difference = 0;
+
+  for (int y = 0; y < BENCH_HEIGHT; ++ y)
+    for (int x = 0; x < BENCH_WIDTH; ++ x) {
+      int difference = 0;
+
+      for (int channel = 0; channel < 4; ++ channel) {
+        gsize offset = (gsize) y * stride + 4 * x + channel;
+        difference = MAX(difference, abs(serial_data[offset] - tiled_data[offset]));
+      }
+
+      n_different += difference > TILED_TOLERANCE;
+      max_difference = MAX(max_difference, difference);
+    }
+
+  renderer_free(renderer);
+  cairo_destroy(tiled_cr);
+  cairo_destroy(serial_cr);
+
+  if (n_different == 0)
+    return TRUE;
+
+  g_printerr("%s: %zu pixels of tiled frame differ from serial one by up to %d, "
+             "more than %d (%s, %zu paths, %zu points)\n",
+             benchmark, n_different, max_difference, TILED_TOLERANCE,
+             data_kind_names[dataset->kind], dataset->n_paths, dataset->n_points);
+
+  return FALSE;
+}
+
+static gboolean bench_drawing(point_store_t* store, const dataset_t* dataset,
+                              gsize n_repeats) {
+  timings_t timings = { g_new(gint64, n_repeats), n_repeats };
+  gboolean is_succeeded = TRUE;
+
+  cairo_t* cr = create_target();
+  renderer_t* renderer = renderer_new();
+
+  render_settings_t settings;
+  render_settings_init(&settings);
+
+  bounds_t viewport;
+  render_fit_viewport(store, &viewport);
+
+  for (gsize i = 0; i < n_repeats; ++ i) {
+    clear_target(cr);
+
+    gint64 start = g_get_monotonic_time();
+
+    draw_grid(cr, &viewport, BENCH_PADDING, BENCH_WIDTH, BENCH_HEIGHT,
+              &settings.grid_color);
+    cairo_surface_flush(cairo_get_target(cr));
+
+    timings.times[i] = g_get_monotonic_time() - start;
+  }
+
+  add_result("draw_grid", dataset, &timings);
+
+  // First frame after a change rebuilds caches of every path
+  for (gsize i = 0; i < n_repeats; ++ i) {
+    clear_target(cr);
+    invalidate_caches(store);
+
+    gint64 start = g_get_monotonic_time();
+
+    draw_paths_and_points(renderer, cr, store, RENDER_MODE_BATCHED, &viewport,
+                          BENCH_PADDING, BENCH_WIDTH, BENCH_HEIGHT,
+                          settings.point_radius, settings.line_width,
+                          &settings.point_color, &settings.line_color);
+    cairo_surface_flush(cairo_get_target(cr));
+
+    timings.times[i] = g_get_monotonic_time() - start;
+  }
+
+  add_result("draw_paths_and_points_cold", dataset, &timings);
+
+  for (gsize i = 0; i < n_repeats; ++ i) {
+    clear_target(cr);
+    renderer_reset_stats(renderer);
+
+    gint64 start = g_get_monotonic_time();
+
+    draw_paths_and_points(renderer, cr, store, RENDER_MODE_BATCHED, &viewport,
+                          BENCH_PADDING, BENCH_WIDTH, BENCH_HEIGHT,
+                          settings.point_radius, settings.line_width,
+                          &settings.point_color, &settings.line_color);
+    cairo_surface_flush(cairo_get_target(cr));
+
+    timings.times[i] = g_get_monotonic_time() - start;
+
+    // Cold frames above have already grown all the buffers
+    is_succeeded = check_allocations(renderer, "draw_paths_and_points", dataset) &&
+                   is_succeeded;
+  }
+
+  add_result("draw_paths_and_points", dataset, &timings);
+
+  // Whole frame the way <Preview> tab draws it, on all the cores
+  for (gsize i = 0; i < n_repeats; ++ i) {
+    clear_target(cr);
+
+    gint64 start = g_get_monotonic_time();
+
+    render_frame(renderer, cr, store, &settings, &viewport,
+                 BENCH_PADDING, BENCH_WIDTH, BENCH_HEIGHT);
+    cairo_surface_flush(cairo_get_target(cr));
+
+    timings.times[i] = g_get_monotonic_time() - start;
+  }
+
+  add_result("render_frame", dataset, &timings);
+
+  // Zoomed into the middle, paths are only partly visible and are drawn
+  // through their segment indices, which the first frame builds (paths
+  // that can't be indexed, like scattered points, are drawn whole instead)
+  bounds_t zoomed = viewport;
+
+  gdouble zoomed_width  = (viewport.max.x - viewport.min.x) / ZOOM_FACTOR;
+  gdouble zoomed_height = (viewport.max.y - viewport.min.y) / ZOOM_FACTOR;
+
+  zoomed.min.x += (viewport.max.x - viewport.min.x - zoomed_width ) / 2;
+  zoomed.min.y += (viewport.max.y - viewport.min.y - zoomed_height) / 2;
+
+  zoomed.max.x = zoomed.min.x + zoomed_width;
+  zoomed.max.y = zoomed.min.y + zoomed_height;
+
+  for (gsize i = 0; i < n_repeats; ++ i) {
+    clear_target(cr);
+
+    gint64 start = g_get_monotonic_time();
+
+    render_frame(renderer, cr, store, &settings, &zoomed,
+                 BENCH_PADDING, BENCH_WIDTH, BENCH_HEIGHT);
+    cairo_surface_flush(cairo_get_target(cr));
+
+    timings.times[i] = g_get_monotonic_time() - start;
+  }
+
+  add_result("render_frame_zoomed", dataset, &timings);
+
+  is_succeeded = check_tiled_frame(store, &viewport, "render_frame", dataset) &&
+                 is_succeeded;
+  is_succeeded = check_tiled_frame(store, &zoomed, "render_frame_zoomed", dataset) &&
+                 is_succeeded;
+
+  gboolean is_warm = FALSE;
+
+  for (gsize i = 0; i < MAX_WARMUP_FRAMES && !is_warm; ++ i) {
+    renderer_reset_stats(renderer);
+
+    render_frame(renderer, cr, store, &settings, &viewport,
+                 BENCH_PADDING, BENCH_WIDTH, BENCH_HEIGHT);
+
+    is_warm = renderer_get_stats(renderer)->n_allocations == 0;
+  }
+
+  is_succeeded = (is_warm || check_allocations(renderer, "render_frame", dataset)) &&
+                 is_succeeded;
+
+  renderer_free(renderer);
+  cairo_destroy(cr);
+
+  g_free(timings.times);
+  return is_succeeded;
+}
+
+// Moves all the points to screen space with every kernel the CPU supports,
+// results of each one are checked against `transform_x` and `transform_y`
+static gboolean bench_transform(point_store_t* store, const dataset_t* dataset,
+                                gsize n_repeats) {
+  timings_t timings = { g_new(gint64, n_repeats), n_repeats };
+
+  bounds_t viewport;
+  render_fit_viewport(store, &viewport);
+
+  transform_t transform =
+    transform_for_viewport(&viewport, BENCH_WIDTH, BENCH_HEIGHT, BENCH_PADDING);
+
+  gsize max_n_points = 0;
+  for (gsize i = 0; i < store->n_paths; ++ i)
+    max_n_points = MAX(max_n_points, store->paths[i]->n_points);
+
+  // One buffer is reused for all the paths, as renderer does
+  gdouble* screen_xs = g_new(gdouble, max_n_points);
+  gdouble* screen_ys = g_new(gdouble, max_n_points);
+
+  gboolean is_correct = TRUE;
+
+  for (transform_kernel_t kernel = 0; kernel < N_TRANSFORM_KERNELS; ++ kernel) {
+    if (!transform_kernel_is_supported(kernel))
+      continue;
+
+    for (gsize i = 0; i < store->n_paths && is_correct; ++ i) {
+      path_t* path = store->paths[i];
+
+      transform_points_with_kernel(kernel, &transform, path->xs, path->ys,
+                                   path->n_points, screen_xs, screen_ys);
+
+      for (gsize j = 0; j < path->n_points; ++ j)
+        if (screen_xs[j] != transform_x(&transform, path->xs[j]) ||
+            screen_ys[j] != transform_y(&transform, path->ys[j])) {
+          g_printerr("Kernel %s is wrong for point %zu of path %zu\n",
+                     transform_kernel_get_name(kernel), j, i);
+
+          is_correct = FALSE;
+          break;
+        }
+    }
+
+    for (gsize i = 0; i < n_repeats; ++ i) {
+      gint64 start = g_get_monotonic_time();
+
+      for (gsize j = 0; j < store->n_paths; ++ j) {
+        path_t* path = store->paths[j];
+        transform_points_with_kernel(kernel, &transform, path->xs, path->ys,
+                                     path->n_points, screen_xs, screen_ys);
+      }
+
+      timings.times[i] = g_get_monotonic_time() - start;
+    }
+
+    gchar* benchmark = g_strdup_printf("transform_%s", transform_kernel_get_name(kernel));
+    add_result(benchmark, dataset, &timings);
+    g_free(benchmark);
+  }
+
+  g_free(screen_xs);
+  g_free(screen_ys);
+
+  g_free(timings.times);
+  return is_correct;
+}
+
+// Store imported points go to, the same way GUI puts them
+typedef struct {
+  point_store_t* store;
+  GMainLoop*     loop;
+  gboolean       is_failed;
+} import_context_t;
+
+static void on_import_batch(const import_batch_t* batch, gpointer user_data) {
+  import_context_t* context = user_data;
+
+  for (gsize i = 0; i < batch->n_runs; ++ i) {
+    const import_run_t* run = &batch->runs[i];
+
+    gssize path_index = point_store_find_path(context->store, run->name);
+    path_t* path = path_index == -1 ?
+      point_store_add_path(context->store, run->name) :
+      context->store->paths[path_index];
+
+    path_reserve(path, path->n_points + run->n_points);
+
+    for (gsize j = run->from; j < run->from + run->n_points; ++ j)
+      path_append_point(path, batch->xs[j], batch->ys[j]);
+  }
+}
+
+static void on_import_done(gsize n_points, gsize n_skipped_lines,
+                           gboolean is_cancelled, const GError* error,
+                           gpointer user_data) {
+  import_context_t* context = user_data;
+
+  if (error != NULL) {
+    g_printerr("%s\n", error->message);
+    context->is_failed = TRUE;
+  }
+
+  g_main_loop_quit(context->loop);
+}
+
+static gboolean write_csv(point_store_t* store, const gchar* filename) {
+  FILE* file = fopen(filename, "w");
+  if (file == NULL)
+    return FALSE;
+
+  for (gsize i = 0; i < store->n_paths; ++ i) {
+    path_t* path = store->paths[i];
+
+    for (gsize j = 0; j < path->n_points; ++ j)
+      fprintf(file, "%s,%.17g,%.17g\n", path->name, path->xs[j], path->ys[j]);
+  }
+
+  return fclose(file) == 0;
+}
+
+static gboolean bench_files(point_store_t* store, const dataset_t* dataset,
+                            gsize n_repeats, const gchar* directory) {
+  timings_t timings = { g_new(gint64, n_repeats), n_repeats };
+
+  gchar* csv_filename     = g_build_filename(directory, "bench.csv", NULL);
+  gchar* project_filename = g_build_filename(directory, "bench.pdproj", NULL);
+
+  gboolean is_succeeded = write_csv(store, csv_filename);
+  GError* error = NULL;
+
+  for (gsize i = 0; is_succeeded && i < n_repeats; ++ i) {
+    import_context_t context = { point_store_new(), g_main_loop_new(NULL, FALSE), FALSE };
+
+    gint64 start = g_get_monotonic_time();
+
+    import_start(csv_filename, "default", on_import_batch, on_import_done, &context);
+    g_main_loop_run(context.loop);
+
+    timings.times[i] = g_get_monotonic_time() - start;
+
+    is_succeeded = !context.is_failed;
+
+    g_main_loop_unref(context.loop);
+    point_store_free(context.store);
+  }
+
+  if (is_succeeded)
+    add_result("import", dataset, &timings);
+
+  for (gsize i = 0; is_succeeded && i < n_repeats; ++ i) {
+    gint64 start = g_get_monotonic_time();
+
+    is_succeeded = project_save(store, project_filename, &error);
+
+    timings.times[i] = g_get_monotonic_time() - start;
+  }
+
+  if (is_succeeded)
+    add_result("project_save", dataset, &timings);
+
+  for (gsize i = 0; is_succeeded && i < n_repeats; ++ i) {
+    gint64 start = g_get_monotonic_time();
+
+    point_store_t* loaded_store = project_load(project_filename, &error);
+
+    timings.times[i] = g_get_monotonic_time() - start;
+
+    is_succeeded = loaded_store != NULL;
+    if (is_succeeded)
+      point_store_free(loaded_store);
+  }
+
+  if (is_succeeded)
+    add_result("project_load", dataset, &timings);
+
+  if (error != NULL) {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+  }
+
+  g_unlink(csv_filename);
+  g_unlink(project_filename);
+
+  g_free(csv_filename);
+  g_free(project_filename);
+  g_free(timings.times);
+
+  return is_succeeded;
+}
+
+int main(int argc, char** argv) {
+  gchar* output     = NULL;
+  gint   n_repeats  = 5;
+  gint64 max_points = 10000000;
+
+  GOptionEntry entries[] = {
+    { "output"    , 'o', 0, G_OPTION_ARG_FILENAME, &output,
+      "File for JSON results (standard output by default)", "PATH" },
+    { "repeats"   , 'r', 0, G_OPTION_ARG_INT, &n_repeats,
+      "Number of times every operation is run (5 by default)", "N" },
+    { "max-points", 'm', 0, G_OPTION_ARG_INT64, &max_points,
+      "Skip projects with more points than that (10000000 by default)", "N" },
+    { NULL }
+  };
+
+  GOptionContext* option_context = g_option_context_new("- benchmark data and rendering code");
+  g_option_context_add_main_entries(option_context, entries, NULL);
+
+  GError* error = NULL;
+  gboolean is_parsed = g_option_context_parse(option_context, &argc, &argv, &error);
+
+  g_option_context_free(option_context);
+
+  if (!is_parsed || n_repeats <= 0) {
+    g_printerr("%s\n", is_parsed ? "Number of repeats must be positive" : error->message);
+    g_clear_error(&error);
+
+    return EXIT_FAILURE;
+  }
+
+  gchar* directory = g_dir_make_tmp("point-drawer-bench-XXXXXX", &error);
+  if (directory == NULL) {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+
+    return EXIT_FAILURE;
+  }
+
+  results = g_string_new(NULL);
+  gboolean is_succeeded = TRUE;
+
+  for (gsize i = 0; i < G_N_ELEMENTS(n_points_variants); ++ i)
+    for (gsize j = 0; j < G_N_ELEMENTS(n_paths_variants); ++ j)
+      for (data_kind_t kind = 0; kind < N_DATA_KINDS; ++ kind) {
+        dataset_t dataset = { kind, n_paths_variants[j], n_points_variants[i] };
+
+        if (dataset.n_points > (guint64) max_points)
+          continue;
+
+        point_store_t* store = generate_store(&dataset);
+
+        bench_bounds(store, &dataset, n_repeats);
+        bench_snapshot(store, &dataset, n_repeats);
+        bench_pyramid(store, &dataset, n_repeats);
+
+        is_succeeded = bench_picking(store, &dataset, n_repeats) && is_succeeded;
+
+        is_succeeded = bench_transform(store, &dataset, n_repeats) && is_succeeded;
+        is_succeeded = bench_drawing(store, &dataset, n_repeats) && is_succeeded;
+
+        is_succeeded = bench_files(store, &dataset, n_repeats, directory) && is_succeeded;
+        is_succeeded = bench_compact(store, &dataset, n_repeats) && is_succeeded;
+
+        // Moves all the points, so it goes last
+        is_succeeded = bench_edit(store, &dataset, n_repeats) && is_succeeded;
+
+        point_store_free(store);
+      }
+
+  g_rmdir(directory);
+  g_free(directory);
+
+  GString* json = g_string_new(NULL);
+  g_string_append_printf(json,
+    "{\n"
+    "  \"revision\": \"%s\",\n"
+    "  \"n_cores\": %u,\n"
+    "  \"width\": %d,\n"
+    "  \"height\": %d,\n"
+    "  \"results\": [\n%s\n  ]\n"
+    "}\n",
+    BENCH_REVISION, g_get_num_processors(), BENCH_WIDTH, BENCH_HEIGHT, results->str);
+
+  if (output == NULL)
+    fputs(json->str, stdout);
+  else if (!g_file_set_contents(output, json->str, json->len, &error)) {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+
+    is_succeeded = FALSE;
+  }
+
+  g_string_free(json, TRUE);
+  g_string_free(results, TRUE);
+  g_free(output);
+
+  return is_succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+}
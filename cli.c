@@ -0,0 +1,225 @@
+#include "cli.h"
+#include "export.h"
+#include "project.h"
+#include "render.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Same free space around the drawing as in <Preview> tab
+#define CLI_PADDING 10
+
+#define DEFAULT_WIDTH  800
+#define DEFAULT_HEIGHT 600
+
+typedef struct {
+  gchar*          input;
+  gchar*          output;
+  export_format_t format;
+} render_job_t;
+
+// Shared by all the jobs, only `n_failed` is ever written to
+typedef struct {
+  render_settings_t settings;
+
+  int  width, height;
+  gint n_failed; // <-- Accessed atomically
+} render_context_t;
+
+gboolean cli_is_render_requested(int argc, char** argv) {
+  for (int i = 1; i < argc; ++ i)
+    if (strcmp(argv[i], "--render") == 0)
+      return TRUE;
+
+  return FALSE;
+}
+
+static void run_render_job(gpointer data, gpointer user_data) {
+  render_job_t*     job     = data;
+  render_context_t* context = user_data;
+
+  GError* error = NULL;
+
+  point_store_t* store = project_load(job->input, &error);
+
+  if (store != NULL) {
+    bounds_t viewport;
+    render_fit_viewport(store, &viewport);
+
+    export_image(store, &context->settings, &viewport, CLI_PADDING,
+                 context->width, context->height,
+                 job->format, job->output, &error);
+
+    point_store_free(store);
+  }
+
+  if (error != NULL) {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+
+    g_atomic_int_inc(&context->n_failed);
+  }
+
+  g_free(job->input);
+  g_free(job->output);
+  g_free(job);
+}
+
+// Image for `input` goes to `directory` (or next to `input`) and is named
+// after it. Projects with the same name (from different directories or
+// with different extensions) would overwrite each other's images, so
+// images that aren't the first with their name get a number, just like
+// paths do on import. `outputs` holds names that are already taken
+static gchar* get_output_name(const gchar* input, const gchar* directory,
+                              export_format_t format, GHashTable* outputs) {
+  gchar* name = g_path_get_basename(input);
+
+  gchar* extension = strrchr(name, '.');
+  if (extension != NULL && extension != name)
+    *extension = '\0';
+
+  gchar* input_directory = g_path_get_dirname(input);
+  gchar* output = NULL;
+
+  for (int i = 1; output == NULL || g_hash_table_contains(outputs, output); ++ i) {
+    g_free(output);
+
+    gchar* image_name = i == 1 ?
+      g_strconcat(name, ".", export_format_get_extension(format), NULL) :
+      g_strdup_printf("%s (%d).%s", name, i, export_format_get_extension(format));
+
+    output = g_build_filename(directory != NULL ? directory : input_directory,
+                              image_name, NULL);
+    g_free(image_name);
+  }
+
+  g_hash_table_add(outputs, g_strdup(output));
+
+  g_free(input_directory);
+  g_free(name);
+
+  return output;
+}
+
+int cli_render(int argc, char** argv) {
+  gboolean is_render    = FALSE;
+  gchar*   output       = NULL;
+  gchar*   size         = NULL;
+  gchar*   format_name  = NULL;
+  gint     n_jobs       = 0;
+  gchar**  inputs       = NULL;
+
+  GOptionEntry entries[] = {
+    { "render", 0  , 0, G_OPTION_ARG_NONE, &is_render,
+      "Render projects to images without opening a window", NULL },
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+      "Image file (for one project) or directory (for many)", "PATH" },
+    { "size"  , 's', 0, G_OPTION_ARG_STRING, &size,
+      "Size of images in pixels (800x600 by default)", "WxH" },
+    { "format", 'f', 0, G_OPTION_ARG_STRING, &format_name,
+      "Format of images: png, svg or pdf", "FORMAT" },
+    { "jobs"  , 'j', 0, G_OPTION_ARG_INT, &n_jobs,
+      "Number of images rendered at once (one per core by default)", "N" },
+    { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &inputs,
+      NULL, "PROJECT..." },
+    { NULL }
+  };
+
+  GOptionContext* option_context = g_option_context_new("- render projects to images");
+  g_option_context_add_main_entries(option_context, entries, NULL);
+
+  GError* error = NULL;
+  gboolean is_parsed = g_option_context_parse(option_context, &argc, &argv, &error);
+
+  g_option_context_free(option_context);
+
+  render_context_t context = { .width = DEFAULT_WIDTH, .height = DEFAULT_HEIGHT };
+  render_settings_init(&context.settings);
+
+  // Whole argument has to be a size, and there has to be some room
+  // left for the drawing inside of the padding
+  int n_read = 0;
+
+  if (is_parsed && size != NULL &&
+      (sscanf(size, "%dx%d%n", &context.width, &context.height, &n_read) != 2 ||
+       size[n_read] != '\0' ||
+       context.width <= 2 * CLI_PADDING || context.height <= 2 * CLI_PADDING)) {
+    g_set_error(&error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                "Size must look like 1920x1080 and be larger than %dx%d, not \"%s\"",
+                2 * CLI_PADDING, 2 * CLI_PADDING, size);
+    is_parsed = FALSE;
+  }
+
+  if (is_parsed && (inputs == NULL || inputs[0] == NULL)) {
+    g_set_error(&error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+                "No projects to render");
+    is_parsed = FALSE;
+  }
+
+  guint n_inputs = is_parsed ? g_strv_length(inputs) : 0;
+
+  // Format given explicitly wins, then goes extension of the only
+  // output file, and otherwise it's PNG
+  export_format_t format = EXPORT_FORMAT_PNG;
+
+  gboolean is_output_file = n_inputs == 1 && output != NULL &&
+    !g_file_test(output, G_FILE_TEST_IS_DIR);
+
+  if (is_parsed && format_name != NULL)
+    is_parsed = export_format_from_name(format_name, &format, &error);
+  else if (is_parsed && is_output_file)
+    is_parsed = export_format_from_filename(output, &format, &error);
+
+  if (is_parsed && !is_output_file && output != NULL &&
+      g_mkdir_with_parents(output, 0755) != 0) {
+    g_set_error(&error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                "Can't create directory %s: %s", output, g_strerror(errno));
+    is_parsed = FALSE;
+  }
+
+  if (is_parsed) {
+    if (n_jobs <= 0)
+      n_jobs = g_get_num_processors();
+
+    n_jobs = MIN((guint) n_jobs, n_inputs);
+
+    // Cores that are left without a whole image split images into tiles
+    context.settings.n_threads = MAX(1, (gint) g_get_num_processors() / n_jobs);
+
+    GThreadPool* pool = g_thread_pool_new(run_render_job, &context,
+                                          n_jobs, TRUE, NULL);
+
+    GHashTable* outputs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    for (guint i = 0; i < n_inputs; ++ i) {
+      render_job_t* job = g_new(render_job_t, 1);
+
+      job->input  = g_strdup(inputs[i]);
+      job->output = is_output_file ? g_strdup(output) :
+        get_output_name(inputs[i], output, format, outputs);
+      job->format = format;
+
+      g_thread_pool_push(pool, job, NULL);
+    }
+
+    // Waits for all the jobs to finish
+    g_thread_pool_free(pool, FALSE, TRUE);
+    g_hash_table_destroy(outputs);
+  }
+
+  g_free(output);
+  g_free(size);
+  g_free(format_name);
+  g_strfreev(inputs);
+
+  if (error != NULL) {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+
+    return EXIT_FAILURE;
+  }
+
+  return context.n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
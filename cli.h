@@ -0,0 +1,27 @@
+#ifndef CLI_H
+#define CLI_H
+
+#include <glib.h>
+
+/*  Headless mode, it renders projects to images without any window:
+ *
+ *      point-drawer --render in.pdproj -o out.png --size 1920x1080
+ *      point-drawer --render *.pdproj -o plots/ --format svg --jobs 8
+ *
+ *  With a single input `-o` is the image itself, with many of them
+ *  it's a directory images are put in (named after the projects,
+ *  projects with the same name get "name (2).png" and so on).
+ *  Without `-o` every image is put next to it's project.
+ *
+ *  Inputs are rendered in parallel, by one thread per core unless
+ *  `--jobs` says otherwise. Drawing looks like it does in <Preview>
+ *  tab with default settings.
+ *  */
+
+// Checks if program was started in headless mode
+gboolean cli_is_render_requested(int argc, char** argv);
+
+// Runs headless mode, returns exit status for `main`
+int cli_render(int argc, char** argv);
+
+#endif
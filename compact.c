@@ -0,0 +1,359 @@
+#include "compact.h"
+
+#include <math.h>
+#include <string.h>
+
+// Packed differences are read and written as whole 64-bit words, every
+// block is followed by that many zero bytes, so no word reaches the next one
+#define WORD_SIZE sizeof(guint64)
+
+// Differences of 32-bit numbers less the smallest of them take up to 33 bits
+#define MAX_WIDTH 33
+
+compact_t* compact_new(void) {
+  compact_t* compact = g_new0(compact_t, 1);
+  compact->ref_count = 1;
+
+  return compact;
+}
+
+compact_t* compact_ref(compact_t* compact) {
+  g_atomic_int_inc(&compact->ref_count);
+  return compact;
+}
+
+static compact_data_t* compact_data_new(gsize capacity) {
+  compact_data_t* data = g_new(compact_data_t, 1);
+
+  data->ref_count = 1;
+
+  data->bytes    = g_new(guint8, capacity);
+  data->size     = 0;
+  data->capacity = capacity;
+
+  return data;
+}
+
+static void compact_data_unref(compact_data_t* data) {
+  if (!g_atomic_int_dec_and_test(&data->ref_count))
+    return;
+
+  g_free(data->bytes);
+  g_free(data);
+}
+
+void compact_unref(compact_t* compact) {
+  if (!g_atomic_int_dec_and_test(&compact->ref_count))
+    return;
+
+  g_free(compact->blocks);
+
+  if (compact->data != NULL)
+    compact_data_unref(compact->data);
+
+  g_free(compact);
+}
+
+// Bytes block's differences take, together with the word of zeros after them
+static gsize get_block_size(const compact_block_t* block) {
+  gsize n_bits = (COMPACT_BLOCK_SIZE - 1) * (block->width_x + block->width_y);
+  return (n_bits + 7) / 8 + WORD_SIZE;
+}
+
+// Distance between neighbouring quantized values
+static gdouble get_step(gdouble min, gdouble max) {
+  return (max - min) / G_MAXUINT32;
+}
+
+// `scale` is the inverse of the step, or 0 if all the values are the same
+static guint32 quantize(gdouble value, gdouble min, gdouble scale) {
+  gdouble quantum = round((value - min) * scale);
+  return CLAMP(quantum, 0.0, (gdouble) G_MAXUINT32);
+}
+
+static gdouble dequantize(gint64 quantum, gdouble min, gdouble max, gdouble step) {
+  return MIN(min + quantum * step, max);
+}
+
+static void write_bits(guint8* data, gsize position, guint64 value) {
+  guint64 word;
+  memcpy(&word, data + position / 8, WORD_SIZE);
+
+  word = GUINT64_TO_LE(GUINT64_FROM_LE(word) | value << position % 8);
+  memcpy(data + position / 8, &word, WORD_SIZE);
+}
+
+static guint64 read_bits(const guint8* data, gsize position, guint64 mask) {
+  guint64 word;
+  memcpy(&word, data + position / 8, WORD_SIZE);
+
+  return GUINT64_FROM_LE(word) >> position % 8 & mask;
+}
+
+static guint64 get_mask(guint8 width) {
+  return (G_GUINT64_CONSTANT(1) << width) - 1;
+}
+
+// Quantizes one coordinate of the block and finds how it's differences are
+// packed, difference of every value from the one before it goes to `deltas`
+static void encode_coordinate(const gdouble* values, gint64* deltas,
+                              gdouble* min, gdouble* max,
+                              guint32* first, gint64* min_delta, guint8* width) {
+  *min = *max = values[0];
+
+  for (gsize i = 1; i < COMPACT_BLOCK_SIZE; ++ i) {
+    *min = MIN(*min, values[i]);
+    *max = MAX(*max, values[i]);
+  }
+
+  gdouble step  = get_step(*min, *max);
+  gdouble scale = step == 0.0 ? 0.0 : 1.0 / step;
+
+  *first = quantize(values[0], *min, scale);
+
+  gint64 previous = *first;
+  for (gsize i = 1; i < COMPACT_BLOCK_SIZE; ++ i) {
+    gint64 quantum = quantize(values[i], *min, scale);
+
+    deltas[i] = quantum - previous;
+    previous  = quantum;
+  }
+
+  *min_delta = deltas[1];
+  gint64 max_delta = deltas[1];
+
+  for (gsize i = 2; i < COMPACT_BLOCK_SIZE; ++ i) {
+    *min_delta = MIN(*min_delta, deltas[i]);
+    max_delta  = MAX( max_delta, deltas[i]);
+  }
+
+  guint64 range = max_delta - *min_delta;
+
+  for (*width = 0; *width < MAX_WIDTH && range >> *width != 0; ++ *width)
+    ;
+}
+
+static void pack_deltas(guint8* data, gsize position,
+                        const gint64* deltas, gint64 min_delta, guint8 width) {
+  if (width == 0)
+    return;
+
+  for (gsize i = 1; i < COMPACT_BLOCK_SIZE; ++ i, position += width)
+    write_bits(data, position, deltas[i] - min_delta);
+}
+
+// Read by a snapshot of the store besides the path
+static gboolean is_shared(const gint* ref_count) {
+  return g_atomic_int_get(ref_count) > 1;
+}
+
+// Gives `compact` a table of it's own with the first `n_blocks` blocks and
+// room for `capacity` of them, it shares the data with the one it had before
+static compact_t* compact_copy_blocks(compact_t* compact, gsize n_blocks, gsize capacity) {
+  compact_t* copy = compact_new();
+
+  copy->blocks = g_new(compact_block_t, capacity);
+
+  // Table of a compact without blocks may be NULL
+  if (n_blocks != 0)
+    memcpy(copy->blocks, compact->blocks, n_blocks * sizeof(compact_block_t));
+
+  copy->blocks_capacity = capacity;
+
+  if (compact->data != NULL)
+    g_atomic_int_inc(&compact->data->ref_count);
+
+  copy->data     = compact->data;
+  copy->n_unused = compact->n_unused;
+
+  compact_unref(compact);
+  return copy;
+}
+
+// Moves the first `n_blocks` blocks to new data with room for `capacity`
+// bytes one after another, leaving out what replaced blocks have left
+static void compact_repack(compact_t* compact, gsize n_blocks, gsize capacity) {
+  compact_data_t* data = compact_data_new(capacity);
+
+  for (gsize i = 0; i < n_blocks; ++ i) {
+    compact_block_t* block = &compact->blocks[i];
+    gsize size = get_block_size(block);
+
+    memcpy(data->bytes + data->size, compact->data->bytes + block->offset, size);
+
+    block->offset = data->size;
+    data->size   += size;
+  }
+
+  compact_data_unref(compact->data);
+
+  compact->data     = data;
+  compact->n_unused = 0;
+}
+
+// Makes sure that `index`-th block (one of the first `n_blocks` or the one
+// right after them) can be written, and that `size` more bytes of data fit
+static compact_t* compact_reserve(compact_t* compact, gsize n_blocks, gsize index, gsize size) {
+  compact_data_t* data = compact->data;
+
+  gsize n_used = data == NULL ? 0 : data->size;
+  gboolean has_room = data != NULL && n_used + size <= data->capacity;
+
+  // Rather than growing, data drops what replaced blocks have left,
+  // when there's enough of it, so it's amortized by the growth
+  gboolean is_repacked = !has_room && compact->n_unused != 0 &&
+                         2 * compact->n_unused >= n_used;
+
+  // Snapshots read the blocks that were there when they were taken,
+  // those appended after them are never read, so they go in place.
+  // But snapshots hold the table rather than the data, so the table is
+  // copied before data is replaced too, then data is seen as shared
+  gboolean is_read = index < n_blocks || !has_room;
+
+  gboolean is_full = index == compact->blocks_capacity;
+  gsize blocks_capacity = is_full ? MAX(n_blocks + 1, 2 * compact->blocks_capacity)
+                                  : compact->blocks_capacity;
+
+  // Shared compact is never reallocated, neither it's table nor it's data
+  if (is_shared(&compact->ref_count) && (is_read || is_full))
+    compact = compact_copy_blocks(compact, n_blocks, blocks_capacity);
+  else if (is_full) {
+    compact->blocks = g_renew(compact_block_t, compact->blocks, blocks_capacity);
+    compact->blocks_capacity = blocks_capacity;
+  }
+
+  if (has_room)
+    return compact;
+
+  // Room is doubled for the bytes in use alone
+  gsize n_live = n_used - compact->n_unused;
+
+  if (is_repacked) {
+    compact_repack(compact, n_blocks, MAX(n_live + size, 2 * n_live));
+    return compact;
+  }
+
+  gsize capacity = MAX(n_used + size, 2 * n_live);
+
+  if (data == NULL)
+    compact->data = compact_data_new(capacity);
+  else if (is_shared(&data->ref_count)) {
+    // Bytes are kept where they were, so offsets stay the same
+    compact->data = compact_data_new(capacity);
+    compact->data->size = n_used;
+
+    memcpy(compact->data->bytes, data->bytes, n_used);
+    compact_data_unref(data);
+  } else {
+    data->bytes    = g_renew(guint8, data->bytes, capacity);
+    data->capacity = capacity;
+  }
+
+  return compact;
+}
+
+// Encodes points as `index`-th block, data of the block it replaces is left unused
+static compact_t* compact_encode_block(compact_t* compact, gsize n_blocks, gsize index,
+                                       const gdouble* xs, const gdouble* ys) {
+  compact_block_t block;
+  gint64 deltas_x[COMPACT_BLOCK_SIZE], deltas_y[COMPACT_BLOCK_SIZE];
+
+  encode_coordinate(xs, deltas_x, &block.min_x, &block.max_x,
+                    &block.first_x, &block.min_delta_x, &block.width_x);
+  encode_coordinate(ys, deltas_y, &block.min_y, &block.max_y,
+                    &block.first_y, &block.min_delta_y, &block.width_y);
+
+  gsize size = get_block_size(&block);
+
+  compact = compact_reserve(compact, n_blocks, index, size);
+
+  if (index < n_blocks)
+    compact->n_unused += get_block_size(&compact->blocks[index]);
+
+  compact_data_t* data = compact->data;
+
+  block.offset = data->size;
+  data->size  += size;
+
+  // Bits are OR-ed into place
+  guint8* bytes = data->bytes + block.offset;
+  memset(bytes, 0, size);
+
+  pack_deltas(bytes, 0, deltas_x, block.min_delta_x, block.width_x);
+  pack_deltas(bytes, (COMPACT_BLOCK_SIZE - 1) * block.width_x,
+              deltas_y, block.min_delta_y, block.width_y);
+
+  compact->blocks[index] = block;
+  return compact;
+}
+
+compact_t* compact_append_block(compact_t* compact, gsize n_blocks,
+                                const gdouble* xs, const gdouble* ys) {
+  return compact_encode_block(compact, n_blocks, n_blocks, xs, ys);
+}
+
+compact_t* compact_set_block(compact_t* compact, gsize n_blocks, gsize index,
+                             const gdouble* xs, const gdouble* ys) {
+  g_return_val_if_fail(index < n_blocks, compact);
+
+  return compact_encode_block(compact, n_blocks, index, xs, ys);
+}
+
+static void decode_coordinate(const guint8* data, gsize position,
+                              guint32 first, gint64 min_delta, guint8 width,
+                              gdouble min, gdouble max, gdouble* values) {
+  gdouble step = get_step(min, max);
+  guint64 mask = get_mask(width);
+
+  gint64 quantum = first;
+  values[0] = dequantize(quantum, min, max, step);
+
+  for (gsize i = 1; i < COMPACT_BLOCK_SIZE; ++ i, position += width) {
+    quantum += min_delta + (gint64) read_bits(data, position, mask);
+    values[i] = dequantize(quantum, min, max, step);
+  }
+}
+
+void compact_decode_block(const compact_t* compact, gsize index,
+                          gdouble* xs, gdouble* ys) {
+  const compact_block_t* block = &compact->blocks[index];
+  const guint8* data = compact->data->bytes + block->offset;
+
+  decode_coordinate(data, 0, block->first_x, block->min_delta_x, block->width_x,
+                    block->min_x, block->max_x, xs);
+  decode_coordinate(data, (COMPACT_BLOCK_SIZE - 1) * block->width_x,
+                    block->first_y, block->min_delta_y, block->width_y,
+                    block->min_y, block->max_y, ys);
+}
+
+// Quantized value of `n`-th point in the block, differences before it are summed up
+static gint64 sum_deltas(const guint8* data, gsize position,
+                         guint32 first, gint64 min_delta, guint8 width, gsize n) {
+  guint64 mask = get_mask(width);
+  gint64 quantum = first + (gint64) n * min_delta;
+
+  for (gsize i = 0; i < n; ++ i, position += width)
+    quantum += read_bits(data, position, mask);
+
+  return quantum;
+}
+
+void compact_get_point(const compact_t* compact, gsize index, gdouble* x, gdouble* y) {
+  const compact_block_t* block = &compact->blocks[index / COMPACT_BLOCK_SIZE];
+  const guint8* data = compact->data->bytes + block->offset;
+
+  gsize n = index % COMPACT_BLOCK_SIZE;
+
+  gint64 quantum_x = sum_deltas(data, 0, block->first_x,
+                                block->min_delta_x, block->width_x, n);
+  gint64 quantum_y = sum_deltas(data, (COMPACT_BLOCK_SIZE - 1) * block->width_x,
+                                block->first_y, block->min_delta_y, block->width_y, n);
+
+  *x = dequantize(quantum_x, block->min_x, block->max_x, get_step(block->min_x, block->max_x));
+  *y = dequantize(quantum_y, block->min_y, block->max_y, get_step(block->min_y, block->max_y));
+}
+
+gsize compact_get_size(const compact_t* compact, gsize n_blocks) {
+  gsize data_size = compact->data == NULL ? 0 : compact->data->size;
+  return n_blocks * sizeof(compact_block_t) + data_size;
+}
@@ -0,0 +1,115 @@
+#ifndef COMPACT_H
+#define COMPACT_H
+
+#include <glib.h>
+
+/*  Compact encoding of points, for paths too big to be kept as doubles
+ *
+ *  Points are encoded in blocks of `COMPACT_BLOCK_SIZE` consecutive
+ *  points, every block on it's own:
+ *
+ *    - Coordinates are quantized to 32-bit fixed point numbers spread
+ *      evenly between the smallest and the largest coordinate of the
+ *      block. So decoded coordinate is off by at most
+ *
+ *          (max - min) / (2^33 - 2)
+ *
+ *      plus a few ulps of rounding, where `min` and `max` are extents of
+ *      the block in that coordinate. It's never more than 1.2e-10 of the
+ *      extents of the whole path, that is far below a pixel at any zoom
+ *      the preview has. Extremes of the block are decoded exactly, and
+ *      no decoded point is ever outside of the block's extents.
+ *
+ *      Changing a point encodes it's block anew (see `path_set_point`),
+ *      quantizing other points of the block once more. While the same
+ *      block is being changed, they are quantized from the coordinates
+ *      they had before the first change, so a point dragged for any
+ *      number of frames adds at most one more such error to them, not
+ *      one per frame. Every later edit of the block may add one more.
+ *
+ *    - First point of the block is stored as it is, every next one as
+ *      a difference from the point before it, less the smallest of such
+ *      differences in the block, packed with as many bits as the largest
+ *      of them needs (separately for X and Y).
+ *
+ *  Coordinates that grow evenly (like time of samples) take almost
+ *  no room this way, smooth ones take a few bytes, and even pure noise
+ *  takes 33 bits, so no point takes much more than half of 16 bytes it
+ *  does as two doubles.
+ *
+ *  Blocks are decoded back to doubles by whoever reads them (see
+ *  `path_get_points`), it's a few nanoseconds per point.
+ *  */
+
+// Points in a block, last block of a path is only encoded once it's full
+#define COMPACT_BLOCK_SIZE 256
+
+typedef struct {
+  gdouble min_x, max_x; // <-- Extents of the block, quantization goes
+  gdouble min_y, max_y; //     from the minimum to the maximum
+
+  guint64 offset; // <-- Where packed differences start in `data`
+
+  guint32 first_x, first_y;         // <-- Quantized first point
+  gint64  min_delta_x, min_delta_y; // <-- Added back to every difference
+  guint8  width_x, width_y;         // <-- Bits per packed difference
+} compact_block_t;
+
+// Packed differences of the blocks. Bytes are only ever appended to it,
+// even block that is replaced is encoded anew after all the others, so
+// it's shared by all the copies of the block table that refer to it
+typedef struct {
+  gint    ref_count;
+
+  guint8* bytes;
+  gsize   size; // <-- Bytes taken by blocks, including replaced ones
+  gsize   capacity;
+} compact_data_t;
+
+// Blocks of one path. Just like point buffers, it's shared by the path
+// with snapshots of the store, which only read blocks that were there
+// when they were taken, so blocks are appended in place, but table is
+// copied before any block in it is replaced
+typedef struct compact {
+  gint ref_count;
+
+  compact_block_t* blocks;
+  gsize            blocks_capacity;
+
+  compact_data_t* data;
+
+  // Bytes of data left by replaced blocks, they are dropped
+  // once they take half of it and it would have to grow
+  gsize n_unused;
+} compact_t;
+
+compact_t* compact_new(void);
+
+compact_t* compact_ref  (compact_t* compact);
+void       compact_unref(compact_t* compact);
+
+// Encodes `COMPACT_BLOCK_SIZE` points from `xs` and `ys` as block number
+// `n_blocks`, after the first `n_blocks` blocks. Shared compact is copied
+// instead of being reallocated, so returned compact may be a new one
+compact_t* compact_append_block(compact_t* compact, gsize n_blocks,
+                                const gdouble* xs, const gdouble* ys);
+
+// Encodes `COMPACT_BLOCK_SIZE` points from `xs` and `ys` in place of `index`-th
+// block, one of the first `n_blocks` blocks, the others stay as they are.
+// Returned compact may be a new one the same way as above
+compact_t* compact_set_block(compact_t* compact, gsize n_blocks, gsize index,
+                             const gdouble* xs, const gdouble* ys);
+
+// Decodes `index`-th block into `xs` and `ys`, they need
+// room for `COMPACT_BLOCK_SIZE` points
+void compact_decode_block(const compact_t* compact, gsize index,
+                          gdouble* xs, gdouble* ys);
+
+// Decodes `index`-th point alone (counting from the start of the first block)
+void compact_get_point(const compact_t* compact, gsize index, gdouble* x, gdouble* y);
+
+// Memory that the first `n_blocks` blocks take, in bytes, together
+// with the data replaced blocks have left
+gsize compact_get_size(const compact_t* compact, gsize n_blocks);
+
+#endif
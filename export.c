@@ -0,0 +1,102 @@
+#include "export.h"
+
+#include <cairo-pdf.h>
+#include <cairo-svg.h>
+#include <string.h>
+
+GQuark export_error_quark(void) {
+  return g_quark_from_static_string("export-error-quark");
+}
+
+static const gchar* format_extensions[] = {
+  [EXPORT_FORMAT_PNG] = "png",
+  [EXPORT_FORMAT_SVG] = "svg",
+  [EXPORT_FORMAT_PDF] = "pdf"
+};
+
+gboolean export_format_from_name(const gchar* name, export_format_t* format,
+                                 GError** error) {
+  for (gsize i = 0; i < G_N_ELEMENTS(format_extensions); ++ i)
+    if (g_ascii_strcasecmp(name, format_extensions[i]) == 0) {
+      *format = i;
+      return TRUE;
+    }
+
+  g_set_error(error, EXPORT_ERROR, EXPORT_ERROR_FORMAT,
+              "Unknown image format \"%s\" (expected png, svg or pdf)", name);
+  return FALSE;
+}
+
+gboolean export_format_from_filename(const gchar* filename, export_format_t* format,
+                                     GError** error) {
+  const gchar* extension = strrchr(filename, '.');
+
+  if (extension == NULL) {
+    g_set_error(error, EXPORT_ERROR, EXPORT_ERROR_FORMAT,
+                "Can't tell image format of %s (expected .png, .svg or .pdf)",
+                filename);
+    return FALSE;
+  }
+
+  return export_format_from_name(extension + 1, format, error);
+}
+
+const gchar* export_format_get_extension(export_format_t format) {
+  return format_extensions[format];
+}
+
+static cairo_surface_t* create_surface(export_format_t format, const gchar* filename,
+                                       int width, int height) {
+  switch (format) {
+  case EXPORT_FORMAT_SVG:
+    return cairo_svg_surface_create(filename, width, height);
+
+  case EXPORT_FORMAT_PDF:
+    return cairo_pdf_surface_create(filename, width, height);
+
+  default:
+    return cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+  }
+}
+
+gboolean export_image(point_store_t* store,
+                      const render_settings_t* settings,
+                      const bounds_t*          viewport,
+                      int                       padding,
+                      int            width, int  height,
+                      export_format_t           format,
+                      const gchar*            filename,
+                      GError**                   error) {
+  cairo_surface_t* surface = create_surface(format, filename, width, height);
+  cairo_t* cr = cairo_create(surface);
+
+  cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
+  cairo_paint(cr);
+
+  // Every image gets it's own renderer, so images can be exported
+  // from any number of threads at once (each with it's own store)
+  renderer_t* renderer = renderer_new();
+  render_frame(renderer, cr, store, settings, viewport, padding, width, height);
+  renderer_free(renderer);
+
+  cairo_destroy(cr);
+
+  cairo_status_t status = format == EXPORT_FORMAT_PNG ?
+    cairo_surface_write_to_png(surface, filename) : CAIRO_STATUS_SUCCESS;
+
+  // Vector surfaces are written out only when they are finished
+  cairo_surface_finish(surface);
+
+  if (status == CAIRO_STATUS_SUCCESS)
+    status = cairo_surface_status(surface);
+
+  cairo_surface_destroy(surface);
+
+  if (status != CAIRO_STATUS_SUCCESS) {
+    g_set_error(error, EXPORT_ERROR, EXPORT_ERROR_IO,
+                "Can't write %s: %s", filename, cairo_status_to_string(status));
+    return FALSE;
+  }
+
+  return TRUE;
+}
@@ -0,0 +1,49 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include "point_store.h"
+#include "render.h"
+
+/*  Saving the drawing to image files
+ *
+ *  It uses exactly the same drawing code as <Preview> tab, only
+ *  the target is a cairo image (or vector) surface instead of a
+ *  widget, so it needs neither a display nor any widgets.
+ *  */
+
+typedef enum {
+  EXPORT_FORMAT_PNG,
+  EXPORT_FORMAT_SVG,
+  EXPORT_FORMAT_PDF
+} export_format_t;
+
+#define EXPORT_ERROR export_error_quark()
+GQuark export_error_quark(void);
+
+typedef enum {
+  EXPORT_ERROR_FORMAT, // <-- Format is unknown
+  EXPORT_ERROR_IO      // <-- Image can't be written
+} export_error_t;
+
+// Finds format by it's name ("png", "svg" or "pdf", in any case)
+gboolean export_format_from_name(const gchar* name, export_format_t* format,
+                                 GError** error);
+
+// Finds format by extension of `filename`
+gboolean export_format_from_filename(const gchar* filename, export_format_t* format,
+                                     GError** error);
+
+const gchar* export_format_get_extension(export_format_t format);
+
+// Draws `viewport` of `store` into a `width` x `height` image on white
+// background and writes it to `filename`
+gboolean export_image(point_store_t* store,
+                      const render_settings_t* settings,
+                      const bounds_t*          viewport,
+                      int                       padding,
+                      int            width, int  height,
+                      export_format_t           format,
+                      const gchar*            filename,
+                      GError**                   error);
+
+#endif
@@ -0,0 +1,109 @@
+#include "frame_scheduler.h"
+
+struct frame_scheduler {
+  GtkWidget* widget;
+
+  frame_update_func_t on_update;
+  gpointer            user_data;
+
+  guint tick_id; // <-- 0 when nothing is scheduled
+
+  frame_dirty_t pending; // <-- Marked, but not updated yet
+  frame_dirty_t updated; // <-- Updated, but not drawn yet
+
+  // Damaged areas of the same three stages
+  cairo_region_t* pending_damage;
+  cairo_region_t* updated_damage;
+  cairo_region_t* taken_damage;
+};
+
+frame_scheduler_t* frame_scheduler_new(GtkWidget* widget,
+                                       frame_update_func_t on_update,
+                                       gpointer            user_data) {
+  frame_scheduler_t* scheduler = g_new0(frame_scheduler_t, 1);
+
+  scheduler->widget    = widget;
+  scheduler->on_update = on_update;
+  scheduler->user_data = user_data;
+
+  scheduler->pending_damage = cairo_region_create();
+  scheduler->updated_damage = cairo_region_create();
+  scheduler->taken_damage   = cairo_region_create();
+
+  return scheduler;
+}
+
+void frame_scheduler_free(frame_scheduler_t* scheduler) {
+  if (scheduler->tick_id != 0)
+    gtk_widget_remove_tick_callback(scheduler->widget, scheduler->tick_id);
+
+  cairo_region_destroy(scheduler->pending_damage);
+  cairo_region_destroy(scheduler->updated_damage);
+  cairo_region_destroy(scheduler->taken_damage);
+
+  g_free(scheduler);
+}
+
+// Runs in the update phase of the frame, so the redraw
+// queued here is done in the paint phase of the same frame
+static gboolean on_tick(GtkWidget* widget, GdkFrameClock* frame_clock, gpointer data) {
+  frame_scheduler_t* scheduler = data;
+
+  // Callback stays while every frame has changes (e.g. live points
+  // come in), so it's not added anew for every one of them. It goes
+  // away on the first idle frame, so the clock stops ticking then
+  if (scheduler->pending == 0) {
+    scheduler->tick_id = 0;
+    return G_SOURCE_REMOVE;
+  }
+
+  frame_dirty_t dirty = scheduler->pending;
+  scheduler->pending = 0;
+
+  scheduler->on_update(dirty, scheduler->user_data);
+  scheduler->updated |= dirty;
+
+  cairo_region_union(scheduler->updated_damage, scheduler->pending_damage);
+  cairo_region_subtract(scheduler->pending_damage, scheduler->pending_damage);
+
+  // Damage alone doesn't touch anything outside of the damaged area
+  if (scheduler->updated == FRAME_DIRTY_DAMAGE)
+    gtk_widget_queue_draw_region(widget, scheduler->updated_damage);
+  else
+    gtk_widget_queue_draw(widget);
+
+  return G_SOURCE_CONTINUE;
+}
+
+void frame_scheduler_mark_dirty(frame_scheduler_t* scheduler, frame_dirty_t dirty) {
+  scheduler->pending |= dirty;
+
+  if (scheduler->tick_id == 0)
+    scheduler->tick_id = gtk_widget_add_tick_callback(scheduler->widget, on_tick,
+                                                      scheduler, NULL);
+}
+
+void frame_scheduler_mark_damaged(frame_scheduler_t* scheduler,
+                                  const cairo_rectangle_int_t* area) {
+  cairo_region_union_rectangle(scheduler->pending_damage, area);
+  frame_scheduler_mark_dirty(scheduler, FRAME_DIRTY_DAMAGE);
+}
+
+frame_dirty_t frame_scheduler_take_updated(frame_scheduler_t* scheduler) {
+  frame_dirty_t updated = scheduler->updated;
+  scheduler->updated = 0;
+
+  // Regions are swapped instead of being created anew for every frame
+  cairo_region_t* taken_damage = scheduler->taken_damage;
+
+  scheduler->taken_damage   = scheduler->updated_damage;
+  scheduler->updated_damage = taken_damage;
+
+  cairo_region_subtract(scheduler->updated_damage, scheduler->updated_damage);
+
+  return updated;
+}
+
+const cairo_region_t* frame_scheduler_get_damage(frame_scheduler_t* scheduler) {
+  return scheduler->taken_damage;
+}
@@ -0,0 +1,58 @@
+#ifndef FRAME_SCHEDULER_H
+#define FRAME_SCHEDULER_H
+
+#include <gtk/gtk.h>
+
+/*  Redraws of a widget driven by it's frame clock
+ *
+ *  Anything that changes the picture only marks what has changed,
+ *  that's cheap and can be done on every keystroke or every point.
+ *  At the start of the next frame (in it's update phase) all the
+ *  marks gathered so far are handed to `on_update` at once, then
+ *  the widget is redrawn, so there's at most one update and one
+ *  redraw per frame, however many changes there were.
+ *  */
+
+typedef enum {
+  FRAME_DIRTY_STYLE    = 1 << 0, // <-- Colors, widths, radius or rendering mode
+  FRAME_DIRTY_DATA     = 1 << 1, // <-- Points were added, moved or removed
+  FRAME_DIRTY_GEOMETRY = 1 << 2, // <-- Viewport was zoomed, panned or fitted
+  FRAME_DIRTY_GRID     = 1 << 3, // <-- Grid was switched on or off or recolored
+  FRAME_DIRTY_OVERLAY  = 1 << 4, // <-- Something drawn over the picture changed
+  FRAME_DIRTY_DAMAGE   = 1 << 5, // <-- Points changed, but only in the damaged area
+
+  FRAME_DIRTY_ALL = FRAME_DIRTY_STYLE    | FRAME_DIRTY_DATA    |
+                    FRAME_DIRTY_GEOMETRY | FRAME_DIRTY_GRID    |
+                    FRAME_DIRTY_OVERLAY  | FRAME_DIRTY_DAMAGE
+} frame_dirty_t;
+
+// Brings state that drawing depends on up to date, runs once per frame
+typedef void (*frame_update_func_t)(frame_dirty_t dirty, gpointer user_data);
+
+typedef struct frame_scheduler frame_scheduler_t;
+
+frame_scheduler_t* frame_scheduler_new(GtkWidget* widget,
+                                       frame_update_func_t on_update,
+                                       gpointer            user_data);
+
+void frame_scheduler_free(frame_scheduler_t* scheduler);
+
+// Schedules update and redraw for the next frame, if they aren't yet
+void frame_scheduler_mark_dirty(frame_scheduler_t* scheduler, frame_dirty_t dirty);
+
+// Marks FRAME_DIRTY_DAMAGE and adds `area` (in pixels) to the damaged area.
+// If nothing else is marked in the same frame, only this area of the
+// widget is redrawn
+void frame_scheduler_mark_damaged(frame_scheduler_t* scheduler,
+                                  const cairo_rectangle_int_t* area);
+
+// Returns everything updated since the last call, it's meant to be called
+// from `draw` handler to find out which layers have to be redrawn. It's 0
+// when widget is redrawn for other reasons (exposed, resized...)
+frame_dirty_t frame_scheduler_take_updated(frame_scheduler_t* scheduler);
+
+// Area damaged by the updates that `frame_scheduler_take_updated` has
+// returned last time, it's empty unless they include FRAME_DIRTY_DAMAGE
+const cairo_region_t* frame_scheduler_get_damage(frame_scheduler_t* scheduler);
+
+#endif
@@ -0,0 +1,476 @@
+#include "import.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// File is read in chunks of this size, lines longer than that make it grow
+#define READ_SIZE (1 << 20)
+
+// Points are handed over to the main loop in batches of this size
+#define BATCH_SIZE (1 << 16)
+
+// Worker stops reading while this many batches wait for the main loop,
+// otherwise a slow main loop would make the whole file pile up in memory
+#define MAX_PENDING_BATCHES 4
+
+struct import {
+  gchar* filename;
+  gchar* default_name;
+
+  import_batch_func_t on_batch;
+  import_done_func_t  on_done;
+  gpointer          user_data;
+
+  GThread* thread;
+
+  gint is_cancelled; // <-- Accessed atomically
+
+  // Guard `n_pending_batches`, worker waits on `cond` for it to drop
+  GMutex mutex;
+  GCond  cond;
+  gsize  n_pending_batches;
+
+  // Filled by the worker, read by the main loop only after it's joined
+  gsize   n_points;
+  gsize   n_skipped_lines;
+  GError* error;
+
+  // Batch that is being filled by the worker right now
+  import_batch_t* batch;
+  gsize file_size;
+  gsize n_bytes_read;
+};
+
+// Batch on its way from the worker to the main loop
+typedef struct {
+  import_t*       import;
+  import_batch_t* batch;
+} delivery_t;
+
+static const gdouble powers_of_ten[] = {
+  1e0 , 1e1 , 1e2 , 1e3 , 1e4 , 1e5 , 1e6 , 1e7 , 1e8 , 1e9 , 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Numbers are read by `g_ascii_strtod` only when fast path can't be exact
+static gboolean parse_number_slowly(const gchar* begin, const gchar* end, gdouble* value) {
+  gchar* text = g_strndup(begin, end - begin);
+
+  gchar* text_end;
+  *value = g_ascii_strtod(text, &text_end);
+
+  gboolean is_parsed = *text_end == '\0';
+  g_free(text);
+
+  return is_parsed && isfinite(*value);
+}
+
+gboolean import_parse_number(const gchar* begin, const gchar* end, gdouble* value) {
+  const gchar* current = begin;
+
+  gboolean is_negative = FALSE;
+  if (current < end && (*current == '-' || *current == '+'))
+    is_negative = *current ++ == '-';
+
+  guint64 mantissa = 0;
+  gint    exponent = 0;
+
+  gint     n_significant_digits = 0;
+  gboolean has_digits = FALSE;
+
+  // Mantissa that doesn't fit in 19 digits is rounded, that's
+  // left to `g_ascii_strtod`, it's very rare in real data
+  gboolean is_exact = TRUE;
+
+  for (; current < end && g_ascii_isdigit(*current); ++ current) {
+    has_digits = TRUE;
+
+    if (n_significant_digits < 19) {
+      mantissa = mantissa * 10 + (*current - '0');
+      n_significant_digits += mantissa != 0;
+    } else {
+      is_exact = is_exact && *current == '0';
+      ++ exponent;
+    }
+  }
+
+  if (current < end && *current == '.')
+    for (++ current; current < end && g_ascii_isdigit(*current); ++ current) {
+      has_digits = TRUE;
+
+      if (n_significant_digits < 19) {
+        mantissa = mantissa * 10 + (*current - '0');
+        n_significant_digits += mantissa != 0;
+        -- exponent;
+      } else
+        is_exact = is_exact && *current == '0';
+    }
+
+  if (!has_digits)
+    return FALSE;
+
+  if (current < end && (*current == 'e' || *current == 'E')) {
+    ++ current;
+
+    gboolean is_exponent_negative = FALSE;
+    if (current < end && (*current == '-' || *current == '+'))
+      is_exponent_negative = *current ++ == '-';
+
+    if (current == end || !g_ascii_isdigit(*current))
+      return FALSE;
+
+    gint written_exponent = 0;
+    for (; current < end && g_ascii_isdigit(*current); ++ current)
+      if (written_exponent < 100000)
+        written_exponent = written_exponent * 10 + (*current - '0');
+
+    exponent += is_exponent_negative ? - written_exponent : written_exponent;
+  }
+
+  if (current != end)
+    return FALSE;
+
+  // Both mantissa and power of ten are exact doubles here, so a single
+  // multiplication or division rounds the result correctly
+  if (is_exact && mantissa <= (G_GUINT64_CONSTANT(1) << 53) &&
+      exponent >= -22 && exponent <= 22) {
+    gdouble result = exponent < 0 ?
+      (gdouble) mantissa / powers_of_ten[- exponent] :
+      (gdouble) mantissa * powers_of_ten[  exponent];
+
+    *value = is_negative ? - result : result;
+    return TRUE;
+  }
+
+  return parse_number_slowly(begin, end, value);
+}
+
+static import_batch_t* import_batch_new(void) {
+  import_batch_t* batch = g_new0(import_batch_t, 1);
+
+  batch->xs = g_new(gdouble, BATCH_SIZE);
+  batch->ys = g_new(gdouble, BATCH_SIZE);
+
+  return batch;
+}
+
+static void import_batch_free(import_batch_t* batch) {
+  for (gsize i = 0; i < batch->n_runs; ++ i)
+    g_free(batch->runs[i].name);
+
+  g_free(batch->runs);
+  g_free(batch->xs);
+  g_free(batch->ys);
+  g_free(batch);
+}
+
+static gboolean is_cancelled(import_t* import) {
+  return g_atomic_int_get(&import->is_cancelled);
+}
+
+// Runs on the main loop
+static gboolean deliver_batch(gpointer data) {
+  delivery_t* delivery = data;
+  import_t*   import   = delivery->import;
+
+  if (!is_cancelled(import))
+    import->on_batch(delivery->batch, import->user_data);
+
+  import_batch_free(delivery->batch);
+  g_free(delivery);
+
+  g_mutex_lock(&import->mutex);
+  -- import->n_pending_batches;
+  g_cond_signal(&import->cond);
+  g_mutex_unlock(&import->mutex);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void send_batch(import_t* import) {
+  import_batch_t* batch = import->batch;
+  import->batch = NULL;
+
+  if (batch == NULL || batch->n_points == 0) {
+    if (batch != NULL)
+      import_batch_free(batch);
+
+    return;
+  }
+
+  batch->progress = import->file_size == 0 ? 0.0 :
+    MIN(1.0, (gdouble) import->n_bytes_read / import->file_size);
+
+  g_mutex_lock(&import->mutex);
+
+  while (import->n_pending_batches >= MAX_PENDING_BATCHES && !is_cancelled(import))
+    g_cond_wait(&import->cond, &import->mutex);
+
+  ++ import->n_pending_batches;
+  g_mutex_unlock(&import->mutex);
+
+  delivery_t* delivery = g_new(delivery_t, 1);
+  delivery->import = import;
+  delivery->batch  = batch;
+
+  // All the batches and `finish_import` have the same priority,
+  // so main loop dispatches them in the order they were added
+  g_idle_add(deliver_batch, delivery);
+}
+
+static void append_point(import_t* import,
+                         const gchar* name, gsize name_length,
+                         gdouble x, gdouble y) {
+  if (import->batch != NULL && import->batch->n_points == BATCH_SIZE)
+    send_batch(import);
+
+  if (import->batch == NULL)
+    import->batch = import_batch_new();
+
+  import_batch_t* batch = import->batch;
+
+  import_run_t* run = batch->n_runs == 0 ? NULL : &batch->runs[batch->n_runs - 1];
+
+  gboolean is_same_path = run != NULL &&
+    strlen(run->name) == name_length && memcmp(run->name, name, name_length) == 0;
+
+  if (!is_same_path) {
+    if (batch->n_runs == batch->runs_capacity) {
+      batch->runs_capacity = MAX(16, 2 * batch->runs_capacity);
+      batch->runs = g_renew(import_run_t, batch->runs, batch->runs_capacity);
+    }
+
+    run = &batch->runs[batch->n_runs ++];
+    *run = (import_run_t) { g_strndup(name, name_length), batch->n_points, 0 };
+  }
+
+  batch->xs[batch->n_points] = x;
+  batch->ys[batch->n_points] = y;
+
+  ++ batch->n_points;
+  ++ run->n_points;
+
+  ++ import->n_points;
+}
+
+static gboolean is_blank(gchar symbol) {
+  return symbol == ' ' || symbol == '\t' || symbol == '\r';
+}
+
+static gboolean is_separator(gchar symbol) {
+  return symbol == ',' || symbol == ';' || is_blank(symbol);
+}
+
+// Line can't have more fields than that, there's one extra to spot such lines
+#define MAX_FIELDS 4
+
+gboolean import_parse_line(const gchar* begin, const gchar* end,
+                           const gchar** name, gsize* name_length,
+                           gdouble* x, gdouble* y) {
+  const gchar* field_begins[MAX_FIELDS];
+  const gchar* field_ends  [MAX_FIELDS];
+
+  gint n_fields = 0;
+
+  const gchar* current = begin;
+  while (n_fields < MAX_FIELDS) {
+    while (current < end && is_blank(*current))
+      ++ current;
+
+    if (current == end)
+      break;
+
+    // Quotes are only stripped, there's no escaping inside of them
+    if (*current == '"') {
+      field_begins[n_fields] = ++ current;
+
+      while (current < end && *current != '"')
+        ++ current;
+
+      field_ends[n_fields ++] = current;
+
+      if (current < end)
+        ++ current;
+    } else {
+      field_begins[n_fields] = current;
+
+      while (current < end && !is_separator(*current))
+        ++ current;
+
+      field_ends[n_fields ++] = current;
+    }
+
+    while (current < end && is_blank(*current))
+      ++ current;
+
+    if (current < end && (*current == ',' || *current == ';'))
+      ++ current;
+  }
+
+  if ((n_fields != 2 && n_fields != 3) || current != end)
+    return FALSE;
+
+  gint first_number = n_fields - 2;
+
+  if (!import_parse_number(field_begins[first_number    ], field_ends[first_number    ], x) ||
+      !import_parse_number(field_begins[first_number + 1], field_ends[first_number + 1], y))
+    return FALSE;
+
+  *name        = n_fields == 3 ? field_begins[0] : NULL;
+  *name_length = n_fields == 3 ? field_ends[0] - field_begins[0] : 0;
+
+  return TRUE;
+}
+
+static void parse_line(import_t* import, const gchar* begin, const gchar* end) {
+  const gchar* name;
+  gsize name_length;
+
+  gdouble x, y;
+
+  if (import_parse_line(begin, end, &name, &name_length, &x, &y)) {
+    if (name == NULL)
+      append_point(import, import->default_name, strlen(import->default_name), x, y);
+    else
+      append_point(import, name, name_length, x, y);
+
+    return;
+  }
+
+  // Empty lines are not worth mentioning
+  for (const gchar* current = begin; current < end; ++ current)
+    if (!is_blank(*current)) {
+      ++ import->n_skipped_lines;
+      return;
+    }
+}
+
+static void read_file(import_t* import) {
+  FILE* file = fopen(import->filename, "rb");
+  if (file == NULL) {
+    g_set_error(&import->error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                "Can't open %s: %s", import->filename, g_strerror(errno));
+    return;
+  }
+
+  struct stat file_stat;
+  if (fstat(fileno(file), &file_stat) == 0 && S_ISREG(file_stat.st_mode))
+    import->file_size = file_stat.st_size;
+
+  gsize  capacity = READ_SIZE;
+  gchar* buffer   = g_malloc(capacity);
+  gsize  n_filled = 0;
+
+  gboolean is_end_of_file = FALSE;
+
+  while (!is_end_of_file && !is_cancelled(import)) {
+    if (n_filled == capacity) {
+      capacity *= 2;
+      buffer = g_realloc(buffer, capacity);
+    }
+
+    gsize n_read = fread(buffer + n_filled, 1, capacity - n_filled, file);
+
+    if (n_read == 0 && ferror(file)) {
+      g_set_error(&import->error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                  "Can't read %s: %s", import->filename, g_strerror(errno));
+      break;
+    }
+
+    is_end_of_file = n_read == 0;
+
+    n_filled             += n_read;
+    import->n_bytes_read += n_read;
+
+    // Parse all complete lines, incomplete one waits for the next chunk
+    const gchar* line = buffer;
+    const gchar* end  = buffer + n_filled;
+
+    for (const gchar* line_end; (line_end = memchr(line, '\n', end - line)) != NULL; ) {
+      parse_line(import, line, line_end);
+      line = line_end + 1;
+    }
+
+    // Last line doesn't have to end with a new line
+    if (is_end_of_file && line < end) {
+      parse_line(import, line, end);
+      line = end;
+    }
+
+    n_filled = end - line;
+    memmove(buffer, line, n_filled);
+  }
+
+  g_free(buffer);
+  fclose(file);
+}
+
+// Runs on the main loop after the last batch
+static gboolean finish_import(gpointer data) {
+  import_t* import = data;
+
+  g_thread_join(import->thread);
+
+  import->on_done(import->n_points, import->n_skipped_lines,
+                  is_cancelled(import), import->error, import->user_data);
+
+  g_clear_error(&import->error);
+
+  g_mutex_clear(&import->mutex);
+  g_cond_clear(&import->cond);
+
+  g_free(import->filename);
+  g_free(import->default_name);
+  g_free(import);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gpointer import_worker(gpointer data) {
+  import_t* import = data;
+
+  read_file(import);
+
+  if (is_cancelled(import)) {
+    if (import->batch != NULL)
+      import_batch_free(import->batch);
+
+    import->batch = NULL;
+  } else
+    send_batch(import);
+
+  g_idle_add(finish_import, import);
+  return NULL;
+}
+
+import_t* import_start(const gchar* filename, const gchar* default_name,
+                       import_batch_func_t on_batch,
+                       import_done_func_t   on_done,
+                       gpointer           user_data) {
+  import_t* import = g_new0(import_t, 1);
+
+  import->filename     = g_strdup(filename);
+  import->default_name = g_strdup(default_name);
+
+  import->on_batch  = on_batch;
+  import->on_done   = on_done;
+  import->user_data = user_data;
+
+  g_mutex_init(&import->mutex);
+  g_cond_init(&import->cond);
+
+  import->thread = g_thread_new("import", import_worker, import);
+  return import;
+}
+
+void import_cancel(import_t* import) {
+  g_atomic_int_set(&import->is_cancelled, TRUE);
+
+  // Wake the worker up if it waits for the main loop
+  g_mutex_lock(&import->mutex);
+  g_cond_broadcast(&import->cond);
+  g_mutex_unlock(&import->mutex);
+}
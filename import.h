@@ -0,0 +1,76 @@
+#ifndef IMPORT_H
+#define IMPORT_H
+
+#include <glib.h>
+
+/*  Bulk import of points from text files (CSV and alike)
+ *
+ *  Every line holds one point, fields are separated by commas,
+ *  semicolons, tabs or spaces:
+ *
+ *      x, y          <-- point goes to the path named `default_name`
+ *      name, x, y    <-- point goes to the path named `name`
+ *
+ *  Lines that are neither (headers, comments, garbage) are skipped.
+ *
+ *  File is read and parsed on a worker thread. Parsed points are
+ *  handed over to the main loop in batches (via `g_idle_add`), so
+ *  all the callbacks below run on the main thread and may touch
+ *  `point_store` and widgets freely.
+ *  */
+
+// Points from consecutive lines that go to the same path
+typedef struct {
+  gchar* name; // <-- Owned by the batch
+
+  gsize from;     // <-- Index of the first point in batch's `xs` and `ys`
+  gsize n_points;
+} import_run_t;
+
+typedef struct {
+  import_run_t* runs;
+  gsize         n_runs;
+  gsize         runs_capacity;
+
+  gdouble*      xs;
+  gdouble*      ys;
+  gsize         n_points;
+
+  // Part of the file that has been read so far, from 0 to 1
+  gdouble       progress;
+} import_batch_t;
+
+typedef void (*import_batch_func_t)(const import_batch_t* batch, gpointer user_data);
+
+// Called exactly once, after the last batch. `error` is NULL
+// unless the file couldn't be read
+typedef void (*import_done_func_t)(gsize n_points, gsize n_skipped_lines,
+                                   gboolean is_cancelled, const GError* error,
+                                   gpointer user_data);
+
+typedef struct import import_t;
+
+// Starts importing `filename` in the background. Returned import
+// is freed by itself after `on_done` has been called
+import_t* import_start(const gchar* filename, const gchar* default_name,
+                       import_batch_func_t on_batch,
+                       import_done_func_t   on_done,
+                       gpointer           user_data);
+
+// Stops the import as soon as possible, batches that haven't been
+// delivered yet are dropped. `on_done` is still called after that
+void import_cancel(import_t* import);
+
+// Parses one line of the format described above (without the new line),
+// `name` is set to NULL for lines without path name. Returns FALSE if
+// the line is not a point
+gboolean import_parse_line(const gchar* begin, const gchar* end,
+                           const gchar** name, gsize* name_length,
+                           gdouble* x, gdouble* y);
+
+// Parses decimal number that takes exactly `begin` up to `end`,
+// returns FALSE if it's not a finite number. It doesn't depend
+// on locale and is exact (correctly rounded) for all inputs
+gboolean import_parse_number(const gchar* begin, const gchar* end, gdouble* value);
+
+#endif
@@ -0,0 +1,148 @@
+#include "lod.h"
+#include "pyramid.h"
+
+#include <math.h>
+
+gboolean polyline_reserve(polyline_t* polyline, gsize capacity) {
+  if (capacity <= polyline->capacity)
+    return FALSE;
+
+  gsize new_capacity = polyline->capacity == 0 ? 256 : polyline->capacity;
+  while (new_capacity < capacity)
+    new_capacity *= 2;
+
+  polyline->capacity = new_capacity;
+
+  polyline->xs = g_renew(gdouble, polyline->xs, polyline->capacity);
+  polyline->ys = g_renew(gdouble, polyline->ys, polyline->capacity);
+
+  return TRUE;
+}
+
+void polyline_append(polyline_t* polyline, gdouble x, gdouble y) {
+  polyline_reserve(polyline, polyline->n_points + 1);
+
+  polyline->xs[polyline->n_points] = x;
+  polyline->ys[polyline->n_points] = y;
+
+  ++ polyline->n_points;
+}
+
+void polyline_append_break(polyline_t* polyline) {
+  polyline_append(polyline, NAN, NAN);
+}
+
+void polyline_clear(polyline_t* polyline) {
+  g_free(polyline->xs);
+  g_free(polyline->ys);
+
+  *polyline = (polyline_t) { NULL, NULL, 0, 0 };
+}
+
+// Run of consecutive points that fall into the same pixel column,
+// only points that matter for drawing are remembered (by index)
+typedef struct {
+  gdouble column;
+
+  gsize first, last;
+  gsize lowest, highest;
+} column_run_t;
+
+// Emits remembered points of the run in the same order they had in path
+static void polyline_append_run(polyline_t* polyline, const column_run_t* run,
+                                const gdouble* xs, const gdouble* ys) {
+  gsize indices[4] = {
+    run->first,
+    MIN(run->lowest, run->highest),
+    MAX(run->lowest, run->highest),
+    run->last
+  };
+
+  for (int i = 0; i < 4; ++ i) {
+    if (i != 0 && indices[i] == indices[i - 1])
+      continue;
+
+    polyline_append(polyline, xs[indices[i]], ys[indices[i]]);
+  }
+}
+
+void lod_decimate(polyline_t* polyline,
+                  const gdouble* xs, const gdouble* ys, gsize n_points) {
+  if (n_points == 0)
+    return;
+
+  column_run_t run = { floor(xs[0]), 0, 0, 0, 0 };
+
+  for (gsize i = 1; i < n_points; ++ i) {
+    gdouble column = floor(xs[i]);
+
+    if (column != run.column) {
+      polyline_append_run(polyline, &run, xs, ys);
+      run = (column_run_t) { column, i, i, i, i };
+      continue;
+    }
+
+    // Screen Y grows downwards, but it doesn't matter here
+    if (ys[i] < ys[run.lowest])
+      run.lowest  = i;
+
+    if (ys[i] > ys[run.highest])
+      run.highest = i;
+
+    run.last = i;
+  }
+
+  polyline_append_run(polyline, &run, xs, ys);
+}
+
+static void lod_build(lod_t* lod, path_t* path, const transform_t* transform,
+                      polyline_t* scratch) {
+  lod->polyline.n_points = 0;
+
+  if (path->n_points == 0)
+    return;
+
+  // Huge paths are never read whole, only points that pyramid picks are
+  // decimated, it gives a few of them for every column they get into
+  const pyramid_t* pyramid = pyramid_get(path);
+
+  if (pyramid != NULL) {
+    scratch->n_points = 0;
+    pyramid_collect(pyramid, path, transform, scratch);
+
+    lod_decimate(&lod->polyline, scratch->xs, scratch->ys, scratch->n_points);
+    return;
+  }
+
+  // Screen coordinates of the whole path, runs only keep indices into them
+  polyline_reserve(scratch, path->n_points);
+  transform_path_points(transform, path, 0, path->n_points,
+                        scratch->xs, scratch->ys);
+
+  scratch->n_points = path->n_points;
+
+  lod_decimate(&lod->polyline, scratch->xs, scratch->ys, path->n_points);
+}
+
+const lod_t* lod_get(path_t* path, const transform_t* transform,
+                     polyline_t* scratch) {
+  lod_t* lod = path->lod;
+
+  if (lod == NULL)
+    lod = path->lod = g_new0(lod_t, 1);
+  else if (lod->version == path->version &&
+           transform_equal(&lod->transform, transform))
+    return lod;
+
+  lod_build(lod, path, transform, scratch);
+
+  lod->version   = path->version;
+  lod->transform = *transform;
+
+  return lod;
+}
+
+void lod_free(lod_t* lod) {
+  polyline_clear(&lod->polyline);
+  g_free(lod);
+}
@@ -0,0 +1,63 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include "point_store.h"
+#include "transform.h"
+
+/*  Level of detail for paths with far more points than pixels
+ *
+ *  Consecutive points that fall into the same pixel column are
+ *  collapsed into at most four of them: the first, the lowest,
+ *  the highest and the last one. Everything else lies in between
+ *  and would be drawn over the same pixels anyway.
+ *
+ *  For paths sorted by X this leaves at most four points per column,
+ *  so the number of drawn segments depends on the widget width
+ *  and not on the number of points.
+ *  */
+
+// Polyline in screen coordinates, NaN in `xs` marks a break:
+// next point starts a new piece instead of continuing the line
+typedef struct {
+  gdouble* xs;
+  gdouble* ys;
+
+  gsize    n_points;
+  gsize    capacity;
+} polyline_t;
+
+// Makes sure that `polyline` has room for at least `capacity` points,
+// returns TRUE if it had to be reallocated for that
+gboolean polyline_reserve(polyline_t* polyline, gsize capacity);
+
+void polyline_append(polyline_t* polyline, gdouble x, gdouble y);
+void polyline_append_break(polyline_t* polyline);
+
+static inline gboolean polyline_is_break(const polyline_t* polyline, gsize index) {
+  return polyline->xs[index] != polyline->xs[index]; // <-- Only true for NaN
+}
+
+void polyline_clear(polyline_t* polyline);
+
+// Appends decimated version of (already transformed) points to `polyline`
+void lod_decimate(polyline_t* polyline,
+                  const gdouble* xs, const gdouble* ys, gsize n_points);
+
+typedef struct lod {
+  // What the polyline was built from, it's rebuilt when any of them changes
+  guint64     version;
+  transform_t transform;
+
+  polyline_t  polyline;
+} lod_t;
+
+// Returns decimated `path` for `transform`, it's built once and cached
+// in the path until either it's points or `transform` change. Path is
+// moved to screen space in `scratch` first, it's only reallocated if
+// it's too small for the path
+const lod_t* lod_get(path_t* path, const transform_t* transform,
+                     polyline_t* scratch);
+
+void lod_free(lod_t* lod);
+
+#endif
@@ -1,4 +1,21 @@
 #include <gtk/gtk.h>
+#include <math.h>
+#include <string.h>
+
+#include "cli.h"
+#include "export.h"
+#include "frame_scheduler.h"
+#include "import.h"
+#include "path_edit.h"
+#include "point_index.h"
+#include "point_model.h"
+#include "point_store.h"
+#include "project.h"
+#include "render.h"
+#include "render_worker.h"
+#include "stream.h"
+#include "trace.h"
+#include "transform.h"
 
 /*  Almost all the interface is done via `Glade`
  *  Here some important highlights from that file:
@@ -7,10 +24,27 @@
  *
  *      In <Preview> tab:
  *          `on_drawing_area_draw`
+ *          `on_open_project_button_clicked`
+ *          `on_save_project_button_clicked`
+ *          `on_save_image_button_clicked`
  *
  *      In <Points List> tab:
+ *          `on_tree_view_for_points_map`
  *          `on_add_path_button_clicked`
  *          `on_add_point_button_clicked`
+ *          `on_transform_button_clicked`
+ *          `on_resample_button_clicked`
+ *          `on_import_button_clicked`
+ *          `on_cancel_import_button_clicked`
+ *
+ *      In <Settings> tab:
+ *          `on_style_entry_changed`
+ *          `on_style_color_set`
+ *          `on_style_switch_state_set`
+ *          `on_grid_color_set`
+ *          `on_grid_switch_state_set`
+ *          `on_show_stats_switch_state_set`
+ *          `on_record_trace_switch_state_set`
  *
  *  Functions are linked dynamically so you need to compile this
  *  program with `-rdynamic` GCC option for GTK to recognize them.
@@ -18,31 +52,60 @@
  *  Signals are being handled by functions and you have to look up
  *  signature for each of them.
  *
- *  Here only two types of signals (except defined in the code) are being handled:
+ *  Here are types of signals (except defined in the code) being handled:
  *      `clicked` signal emited by button
  *      when the button has been activated:
  *          `void <function-name>(GtkButton* button, gpointer user_data)`
  *
+ *      `changed` signal emited by entry when it's text has changed:
+ *          `void <function-name>(GtkEditable* editable, gpointer user_data)`
+ *
+ *      `color-set` signal emited by color button when user picked a color:
+ *          `void <function-name>(GtkColorButton* button, gpointer user_data)`
+ *
+ *      `state-set` signal emited by switch when it's flipped, returning
+ *      TRUE would stop the switch from changing it's state:
+ *          `gboolean <function-name>(GtkSwitch* widget, gboolean state, gpointer user_data)`
+ *
  *      `draw` signal emited also by all widgets
  *      when widget is supposed to render itself:
  *          `gboolean <function-name>(GtkWidget* widget, cairo_t* cairo)`
  *
  *
  *  Some widgets will be borrowed from inside builder
- *  constructed from `layout.glade`.
+ *  constructed from `layout.glade`, which is compiled
+ *  into the program (see layout.gresource.xml).
+ *
+ *  Points themselves live in `point_store` (see point_store.h),
+ *  `tree_view_for_points` shows them through `point_model` (see point_model.h).
  *
  *  Here's list of important named widgets described in layout.glade:
  *
  *      In <Preview> tab:
- *          `drawing_area`
+ *          `drawing_area` (scroll zooms, drag pans, double click fits all,
+ *                          click picks a point and drag moves it)
+ *          `open_project_button`
  *
  *      In <Points List> tab:
- *          `tree_view_for_points`
+ *          `tree_view_for_points` (several rows can be selected, paths
+ *                                  selected in it are edited all at once)
+ *          `add_path_button`
+ *          `import_button`
+ *          `import_progress_box` (shown only while import is running)
+ *          `import_progress_bar`
  *
  *          `x_entry`
  *          `y_entry`
  *          `choose_path_text_combo_box`
  *
+ *          `shift_x_entry`
+ *          `shift_y_entry`
+ *          `scale_entry`
+ *          `rotation_entry` (in degrees)
+ *          `resample_entry`
+ *          `transform_button`
+ *          `resample_button`
+ *
  *      In <Settings> tab:
  *          `line_width_entry`
  *          `randomize_colors_switch`
@@ -51,6 +114,10 @@
  *          `grid_color_picker`
  *          `point_radius_entry`
  *          `point_color_picker`
+ *          `batched_rendering_switch`
+ *          `multithreaded_rendering_switch`
+ *          `show_stats_switch` (draws frame stats over `drawing_area`)
+ *          `record_trace_switch` (records frame timings to a file, see trace.h)
  *  */
 
 // ----> Widgets borrowed from `layout.glade` <---- //
@@ -58,14 +125,30 @@ GtkWidget* main_window;
 
 // --> Widgets from     <Preview> tab <-- //
 GtkWidget* drawing_area;
+GtkWidget* open_project_button;
+GtkWidget* open_project_file_picker;
 GtkWidget* save_project_file_picker;
 GtkWidget* save_image_file_picker;
+GtkWidget* save_trace_file_picker;
 
 // --> Widgets from <Point Lists> tab <-- //
 GtkWidget* tree_view_for_points;
+GtkWidget* add_path_button;
+GtkWidget* import_button;
+GtkWidget* import_file_picker;
+GtkWidget* import_progress_box;
+GtkWidget* import_progress_bar;
 GtkWidget* x_entry;
 GtkWidget* y_entry;
 GtkWidget* choose_path_text_combo_box;
+GtkWidget* add_point_button;
+GtkWidget* shift_x_entry;
+GtkWidget* shift_y_entry;
+GtkWidget* scale_entry;
+GtkWidget* rotation_entry;
+GtkWidget* resample_entry;
+GtkWidget* transform_button;
+GtkWidget* resample_button;
 
 // --> Widgets from    <Settings> tab <-- //
 GtkWidget* line_width_entry;
@@ -75,23 +158,39 @@ GtkWidget* draw_grid_switch;
 GtkWidget* grid_color_picker;
 GtkWidget* point_radius_entry;
 GtkWidget* point_color_picker;
+GtkWidget* batched_rendering_switch;
+GtkWidget* multithreaded_rendering_switch;
+GtkWidget* show_stats_switch;
+GtkWidget* record_trace_switch;
 // ------------------------------------------------ //
 
-enum { // <-- Tree store columns
-  X_COORDINATE_COLUMN,
-  Y_COORDINATE_COLUMN,
+// Source of truth for all the paths, `point_model` shows it row by row:
+// n-th top-level row is n-th path and it's children are path's points.
+// Live paths (see `get_stream_path`) are the only exception, they have
+// a top-level row but no rows for their points
+point_store_t* point_store = NULL;
+
+// Every change of `point_store` has to be reported to it
+PointModel* point_model = NULL;
 
-  N_COLUMNS // It corresponds to number of columns
-};
+// Anything that changes what `drawing_area` shows marks it
+// here, it's redrawn once per frame (see frame_scheduler.h)
+frame_scheduler_t* frame_scheduler = NULL;
 
-GtkTreeStore* tree_store = NULL;
+// Import that is running right now, there's at most one at a time
+import_t* current_import = NULL;
 
-void initialize_tree_store(void) {
-  tree_store = gtk_tree_store_new(N_COLUMNS,
-                                  G_TYPE_STRING, /* --> X coordinate column */
-                                  G_TYPE_STRING  /* --> Y coordinate column */);
+void initialize_point_store(void) {
+  point_store = point_store_new();
 }
 
+void initialize_point_model(void) {
+  point_model = point_model_new(point_store);
+}
+
+// Columns can't size themselves to content in fixed height mode
+#define TREE_VIEW_COLUMN_WIDTH 150
+
 // It appends columns to `tree_view_for_columns` declared in the top of this file
 void append_column_to_tree_view(char* name, gint column_id,
                                 void (*on_tree_view_cell_edited)(
@@ -121,22 +220,16 @@ void append_column_to_tree_view(char* name, gint column_id,
   // Make columns take all the available space
   gtk_tree_view_column_set_expand(column, TRUE);
 
+  // Required by fixed height mode (see `initialize_tree_view_for_points`)
+  gtk_tree_view_column_set_sizing(column, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_column_set_fixed_width(column, TREE_VIEW_COLUMN_WIDTH);
+
   // And finally append our column
   gtk_tree_view_append_column(
     GTK_TREE_VIEW(tree_view_for_points),
     column);
 }
 
-void update_tree_model_cell(gchar* path, gint column_id, gchar* new_text) {
-  GtkTreeIter iter;
-  gtk_tree_model_get_iter(GTK_TREE_MODEL(tree_store), &iter,
-                          gtk_tree_path_new_from_string(path));
-
-  gtk_tree_store_set(tree_store, &iter,
-                     column_id, new_text,
-                     -1);
-}
-
 gboolean is_number(const char* string) {
   char* end;
   strtod(string, &end);
@@ -147,96 +240,151 @@ gboolean is_number(const char* string) {
   return TRUE;
 }
 
-typedef struct {
-  gdouble x;
-  gdouble y;
-} point_t;
+// Enough to hold any number formatted for an entry
+#define COORDINATE_TEXT_SIZE 32
+
+// Finds out which path (and which point in it) row `path_string` of
+// `point_model` corresponds to, `point_index` is -1 for rows with paths
+gboolean get_row_indices(const gchar* path_string,
+                         gint* path_index, gint* point_index) {
+  // It's "path" or "path:point", it's parsed right here instead of
+  // making a GtkTreePath of it, so editing a cell allocates nothing
+  gchar* end;
+  guint64 path_number = g_ascii_strtoull(path_string, &end, 10);
 
-point_t min = { 0.0, 0.0 },
-        max = { 0.0, 0.0 };
+  if (end == path_string || path_number >= point_store->n_paths)
+    return FALSE;
 
-void update_min_and_max_points() {
-  min.x = 0.0;
-  min.y = 0.0;
+  *path_index  = path_number;
+  *point_index = -1;
 
-  max.x = 0.0;
-  max.y = 0.0;
+  if (*end == ':') {
+    const gchar* point_string = end + 1;
+    guint64 point_number = g_ascii_strtoull(point_string, &end, 10);
 
-  GtkTreeIter parent;
-  gtk_tree_model_get_iter(GTK_TREE_MODEL(tree_store), &parent,
-                          gtk_tree_path_new_first());
+    if (end == point_string ||
+        point_number >= point_store->paths[path_number]->n_points)
+      return FALSE;
 
-  if (!gtk_tree_store_iter_is_valid(tree_store, &parent))
-    return;
+    *point_index = point_number;
+  }
 
-  do {
-    GtkTreeIter iter;
-    if (gtk_tree_model_iter_n_children(GTK_TREE_MODEL(tree_store), &parent) == 0)
-      continue;
+  return *end == '\0';
+}
+
+// Entries of `choose_path_text_combo_box` go in the same order as paths
+// in `point_store`, so active entry is the index of the chosen path.
+// Combo box is kept in sync entry by entry, it's refilled only when
+// the whole store is replaced
+void append_paths_to_combo_box(gsize from) {
+  for (gsize i = from; i < point_store->n_paths; ++ i)
+    gtk_combo_box_text_append_text(
+      GTK_COMBO_BOX_TEXT(choose_path_text_combo_box),
+      point_store->paths[i]->name
+    );
+
+  // The newest path is the one points are most likely added to
+  if (from < point_store->n_paths)
+    gtk_combo_box_set_active(GTK_COMBO_BOX(choose_path_text_combo_box),
+                             (gint) point_store->n_paths - 1);
+}
 
-    gtk_tree_model_iter_nth_child(GTK_TREE_MODEL(tree_store), &iter, &parent, 0);
+// Called after path `index` has been removed from `point_store`
+void remove_path_from_combo_box(gsize index) {
+  gtk_combo_box_text_remove(GTK_COMBO_BOX_TEXT(choose_path_text_combo_box), index);
 
-    do {
-      GValue x_value = G_VALUE_INIT;
-      gtk_tree_model_get_value(GTK_TREE_MODEL(tree_store), &iter,
-                               X_COORDINATE_COLUMN, &x_value);
+  if (gtk_combo_box_get_active(GTK_COMBO_BOX(choose_path_text_combo_box)) == -1)
+    gtk_combo_box_set_active(GTK_COMBO_BOX(choose_path_text_combo_box),
+                             (gint) point_store->n_paths - 1);
+}
 
-      const gchar* x_string = g_value_get_string(&x_value);
+void rename_path_in_combo_box(gsize index) {
+  GtkComboBoxText* combo_box = GTK_COMBO_BOX_TEXT(choose_path_text_combo_box);
+  gint active = gtk_combo_box_get_active(GTK_COMBO_BOX(combo_box));
 
-      double x;
-      sscanf(x_string, "%lf", &x);
+  gtk_combo_box_text_remove(combo_box, index);
+  gtk_combo_box_text_insert_text(combo_box, index, point_store->paths[index]->name);
 
-      GValue y_value = G_VALUE_INIT;
-      gtk_tree_model_get_value(GTK_TREE_MODEL(tree_store), &iter,
-                               Y_COORDINATE_COLUMN, &y_value);
+  if (active == (gint) index)
+    gtk_combo_box_set_active(GTK_COMBO_BOX(combo_box), active);
+}
 
-      const gchar* y_string = g_value_get_string(&y_value);
+void update_paths_in_combo_box(void) {
+  gtk_combo_box_text_remove_all(
+    GTK_COMBO_BOX_TEXT(choose_path_text_combo_box)
+  );
 
-      double y;
-      sscanf(y_string, "%lf", &y);
+  append_paths_to_combo_box(0);
+}
 
-      min.x = MIN(min.x, x);
-      min.y = MIN(min.y, y);
+// Edits of single points only redraw what they've changed, these
+// are defined below, along with the rest of `drawing_area` code
+void get_point_area(path_t* path, gsize index, cairo_rectangle_int_t* area);
+void mark_point_edited(path_t* path, gsize index, const cairo_rectangle_int_t* old_area);
 
-      max.x = MAX(max.x, x);
-      max.y = MAX(max.y, y);
-    } while(gtk_tree_model_iter_next(GTK_TREE_MODEL(tree_store), &iter));
+// Point picked on `drawing_area` or selected in `tree_view_for_points`,
+// it's circled on `drawing_area`. Path index is -1 if there's none
+gssize selected_path_index  = -1;
+gsize  selected_point_index = 0;
 
-  } while(gtk_tree_model_iter_next(GTK_TREE_MODEL(tree_store), &parent));
+gboolean is_point_selected(void) {
+  return selected_path_index >= 0 &&
+         (gsize) selected_path_index < point_store->n_paths &&
+         selected_point_index < point_store->paths[selected_path_index]->n_points;
 }
 
 void on_tree_view_x_cell_edited(GtkCellRendererText *cell,
                                 gchar *path_string,
                                 gchar *new_text,
                                 gpointer user_data) {
-  GtkTreeIter iter;
-  gtk_tree_model_get_iter(GTK_TREE_MODEL(tree_store), &iter,
-                          gtk_tree_path_new_from_string(path_string));
+  gint path_index, point_index;
+  if (!get_row_indices(path_string, &path_index, &point_index) ||
+      g_strcmp0(new_text, "") == 0)
+    return;
 
-  if (((gtk_tree_store_iter_is_valid(tree_store, &iter)
-        && gtk_tree_store_iter_depth(tree_store, &iter) == 0) ||
-        is_number(new_text)) && g_strcmp0(new_text, "") != 0) {
+  path_t* path = point_store->paths[path_index];
 
-    update_tree_model_cell(path_string, X_COORDINATE_COLUMN, new_text);
-    gtk_widget_queue_draw(drawing_area);
+  // X column of top-level rows holds path name
+  if (point_index == -1) {
+    point_store_rename_path(point_store, path_index, new_text);
+
+    point_model_row_changed(point_model, path_index, -1);
+    rename_path_in_combo_box(path_index);
+    return;
   }
+
+  if (!is_number(new_text))
+    return;
+
+  cairo_rectangle_int_t old_area;
+  get_point_area(path, point_index, &old_area);
+
+  gdouble x = strtod(new_text, NULL);
+  path_set_point(path, point_index, x, path_get_point(path, point_index).y);
+
+  point_model_row_changed(point_model, path_index, point_index);
+  mark_point_edited(path, point_index, &old_area);
 }
 
 void on_tree_view_y_cell_edited(GtkCellRendererText *cell,
                                 gchar *path_string,
                                 gchar *new_text,
                                 gpointer user_data) {
-  GtkTreeIter iter;
-  gtk_tree_model_get_iter(GTK_TREE_MODEL(tree_store), &iter,
-                          gtk_tree_path_new_from_string(path_string));
+  gint path_index, point_index;
+  if (!get_row_indices(path_string, &path_index, &point_index) ||
+      point_index == -1 || !is_number(new_text))
+    return;
 
-  if (gtk_tree_store_iter_is_valid(tree_store, &iter)
-      && gtk_tree_store_iter_depth(tree_store, &iter) != 0 &&
-      is_number(new_text)  && g_strcmp0(new_text, "") != 0) {
+  path_t* path = point_store->paths[path_index];
 
-    update_tree_model_cell(path_string, Y_COORDINATE_COLUMN, new_text);
-    gtk_widget_queue_draw(drawing_area);
-  }
+  cairo_rectangle_int_t old_area;
+  get_point_area(path, point_index, &old_area);
+
+  gdouble y = strtod(new_text, NULL);
+  path_set_point(path, point_index, path_get_point(path, point_index).x, y);
+
+  point_model_row_changed(point_model, path_index, point_index);
+  mark_point_edited(path, point_index, &old_area);
 }
 
 void initialize_tree_view_columns(void) {
@@ -244,416 +392,1625 @@ void initialize_tree_view_columns(void) {
   append_column_to_tree_view("Y Coordinate", Y_COORDINATE_COLUMN, on_tree_view_y_cell_edited);
 }
 
-void update_paths_in_combo_box(void) {
-  gtk_combo_box_text_remove_all(
-    GTK_COMBO_BOX_TEXT(choose_path_text_combo_box)
-  );
+// Removes path or point in the row at `tree_path` from the store and the view
+void remove_tree_view_row(GtkTreePath* tree_path) {
+  gint depth = 0;
+  gint* indices = gtk_tree_path_get_indices_with_depth(tree_path, &depth);
+  gint path_index = indices[0];
 
-  GtkTreeIter iter;
-  gtk_tree_model_get_iter(GTK_TREE_MODEL(tree_store), &iter,
-                          gtk_tree_path_new_first());
+  // Remove it from the store first, `point_model` just shows it
+  if (depth == 1) {
+    point_store_remove_path(point_store, path_index);
+    point_model_path_removed(point_model, path_index);
 
-  if (!gtk_tree_store_iter_is_valid(tree_store, &iter))
-    return;
+    remove_path_from_combo_box(path_index);
+    frame_scheduler_mark_dirty(frame_scheduler, FRAME_DIRTY_DATA);
+  } else {
+    path_t* path = point_store->paths[path_index];
 
-  int count = 0; do {
-    GValue value = G_VALUE_INIT;
-    gtk_tree_model_get_value(GTK_TREE_MODEL(tree_store), &iter,
-                             X_COORDINATE_COLUMN, &value);
+    cairo_rectangle_int_t old_area;
+    get_point_area(path, indices[1], &old_area);
 
-    const gchar* name = g_value_get_string(&value);
-    gtk_combo_box_text_append_text(
-      GTK_COMBO_BOX_TEXT(choose_path_text_combo_box),
-      name
-    );
+    path_remove_point(path, indices[1]);
+    point_model_point_removed(point_model, path_index, indices[1]);
+
+    mark_point_edited(path, indices[1], &old_area);
+  }
+}
 
-    count ++;
-  } while(gtk_tree_model_iter_next(GTK_TREE_MODEL(tree_store), &iter));
+// Checks if row of the path that `tree_path` row of a point is in is selected too
+gboolean is_path_row_selected(GtkTreeSelection* selection, GtkTreePath* tree_path) {
+  GtkTreePath* path_row = gtk_tree_path_copy(tree_path);
+  gtk_tree_path_up(path_row);
 
-  gtk_combo_box_set_active(GTK_COMBO_BOX(choose_path_text_combo_box), count - 1);
+  gboolean is_selected = gtk_tree_selection_path_is_selected(selection, path_row);
+  gtk_tree_path_free(path_row);
+
+  return is_selected;
 }
 
 gboolean on_tree_view_key_pressed(GtkWidget *widget, GdkEventKey *event, gpointer data) {
   if (event->keyval == GDK_KEY_Delete){
-    GtkTreeIter iter;
     GtkTreeSelection* selection = gtk_tree_view_get_selection(
       GTK_TREE_VIEW(tree_view_for_points)
     );
 
-    GtkTreeModel* model = GTK_TREE_MODEL(tree_store);
-    gtk_tree_selection_get_selected(selection, &model, &iter);
+    GList* rows = gtk_tree_selection_get_selected_rows(selection, NULL);
+
+    // All the selected rows are removed. They are listed in the order of
+    // the view, so going from the last one, every row is removed before
+    // the rows above it and indices of the rest stay the same: points of
+    // a path go before the path and later paths go before earlier ones
+    for (GList* row = g_list_last(rows); row != NULL; row = row->prev) {
+      GtkTreePath* tree_path = row->data;
 
-    gtk_tree_store_remove(tree_store, &iter);
+      // Points of a path that is removed as well go together with it
+      if (gtk_tree_path_get_depth(tree_path) == 2 &&
+          is_path_row_selected(selection, tree_path))
+        continue;
 
-    if (gtk_tree_store_iter_depth(tree_store, &iter) == 0)
-      update_paths_in_combo_box();
+      remove_tree_view_row(tree_path);
+    }
+
+    g_list_free_full(rows, (GDestroyNotify) gtk_tree_path_free);
+
+    // Indices after the removed rows have shifted
+    selected_path_index = -1;
+    frame_scheduler_mark_dirty(frame_scheduler, FRAME_DIRTY_OVERLAY);
 
-    gtk_widget_queue_draw(drawing_area);
     return TRUE;
   }
   return FALSE;
 }
 
+// View is set up only when it's shown for the first time
+gboolean is_tree_view_initialized = FALSE;
+
+// View keeps a node for every row of an expanded path, so paths with more
+// points than that are never expanded just to show the selected point
+#define MAX_EXPANDED_POINTS 100000
+
+// Selects and scrolls to the row of the selected point. View that isn't
+// set up yet or has no model (while it's being reloaded) is left alone
+void show_selected_point_in_tree_view(void) {
+  GtkTreeView* view = GTK_TREE_VIEW(tree_view_for_points);
+
+  if (!is_tree_view_initialized || gtk_tree_view_get_model(view) == NULL ||
+      !is_point_selected())
+    return;
+
+  path_t* path = point_store->paths[selected_path_index];
+  GtkTreePath* tree_path = gtk_tree_path_new_from_indices(selected_path_index, -1);
+
+  // Otherwise only the row of the path is selected
+  if (gtk_tree_view_row_expanded(view, tree_path) ||
+      path->n_points <= MAX_EXPANDED_POINTS) {
+    gtk_tree_path_append_index(tree_path, selected_point_index);
+    gtk_tree_view_expand_to_path(view, tree_path);
+  }
+
+  gtk_tree_view_set_cursor(view, tree_path, NULL, FALSE);
+
+  gtk_tree_path_free(tree_path);
+}
+
+// Handler for `changed` signal of `tree_view_for_points` selection, point
+// in the row under the cursor is the selected one (several rows can be
+// selected at once, so the selection itself isn't walked on every change)
+void on_tree_view_selection_changed(GtkTreeSelection* selection, gpointer user_data) {
+  GtkTreePath* tree_path = NULL;
+  gtk_tree_view_get_cursor(GTK_TREE_VIEW(tree_view_for_points), &tree_path, NULL);
+
+  if (tree_path == NULL)
+    return;
+
+  gint depth = 0;
+  gint* indices = gtk_tree_path_get_indices_with_depth(tree_path, &depth);
+
+  // Rows of paths themselves aren't points
+  if (depth == 2) {
+    selected_path_index  = indices[0];
+    selected_point_index = indices[1];
+
+    frame_scheduler_mark_dirty(frame_scheduler, FRAME_DIRTY_OVERLAY);
+  }
+
+  gtk_tree_path_free(tree_path);
+}
+
 // `tree_view_for_points` is the widget declared in the top of the file
 void initialize_tree_view_for_points(void) {
   initialize_tree_view_columns();
-  initialize_tree_store(); // Initialize it's model
 
-  gtk_tree_view_set_model(
-    GTK_TREE_VIEW(tree_view_for_points),
-    GTK_TREE_MODEL(tree_store)
+  // Import keeps view detached, model is set once it's over
+  if (current_import == NULL)
+    gtk_tree_view_set_model(
+      GTK_TREE_VIEW(tree_view_for_points),
+      GTK_TREE_MODEL(point_model)
+    );
+
+  // All rows are of the same height, so view doesn't have
+  // to measure every single one of them (there may be millions)
+  gtk_tree_view_set_fixed_height_mode(GTK_TREE_VIEW(tree_view_for_points), TRUE);
+
+  // Several paths can be selected to edit them together
+  gtk_tree_selection_set_mode(
+    gtk_tree_view_get_selection(GTK_TREE_VIEW(tree_view_for_points)),
+    GTK_SELECTION_MULTIPLE
   );
 
   gtk_widget_add_events(tree_view_for_points, GDK_KEY_PRESS_MASK);
   g_signal_connect(G_OBJECT(tree_view_for_points), "key_press_event",
                    G_CALLBACK(on_tree_view_key_pressed), NULL);
+
+  g_signal_connect(
+    G_OBJECT(gtk_tree_view_get_selection(GTK_TREE_VIEW(tree_view_for_points))),
+    "changed", G_CALLBACK(on_tree_view_selection_changed), NULL
+  );
+
+  is_tree_view_initialized = TRUE;
+
+  // Point may have been picked before the view was shown
+  show_selected_point_in_tree_view();
 }
 
-// Defaults:
-//     line (color = #555753, size = 5)
-//     grid (color = #D3D7CF, enabled = true)
-//     point(color = #2E3436, radius = 5)
-void initialize_defaults(void) {
-  GdkRGBA grid_default_color  = { 0x55 / 256.0,
-                                  0x57 / 256.0,
-                                  0x53 / 256.0, 1.0 };
-  gtk_color_chooser_set_rgba(GTK_COLOR_CHOOSER(grid_color_picker),
-                            &grid_default_color);
+// Handler for `tree_view_for_points` `map` signal, <Points List> tab
+// isn't the first one, so it's not set up until it's opened
+void on_tree_view_for_points_map(GtkWidget* widget, gpointer user_data) {
+  if (!is_tree_view_initialized)
+    initialize_tree_view_for_points();
+}
 
-  GdkRGBA line_default_color  = { 0xD3 / 256.0,
-                                  0xD7 / 256.0,
-                                  0xCF / 256.0, 1.0 };
-  gtk_color_chooser_set_rgba(GTK_COLOR_CHOOSER(line_color_picker),
-                            &line_default_color);
+// Free space left around the drawing in `drawing_area`, in pixels
+#define DRAWING_AREA_PADDING 10
 
-  GdkRGBA point_default_color = { 0x2E / 256.0,
-                                  0x34 / 256.0,
-                                  0x36 / 256.0, 1.0 };
-  gtk_color_chooser_set_rgba(GTK_COLOR_CHOOSER(point_color_picker),
-                            &point_default_color);
+// Part of data space shown in `drawing_area`, until user zooms
+// or pans it just follows extents of the points
+bounds_t viewport = { { 0.0, 0.0 }, { 1.0, 1.0 } };
+gboolean is_viewport_fitted = TRUE;
 
-  gtk_entry_set_text(GTK_ENTRY(  line_width_entry), "5");
+// Fits all the points into `viewport`, it's aligned to whole grid cells
+void fit_viewport(void) {
+  render_fit_viewport(point_store, &viewport);
+}
 
-  gtk_entry_set_text(GTK_ENTRY(point_radius_entry), "5");
+// Collects everything set in <Settings> tab
+void get_render_settings(render_settings_t* settings) {
+  settings->is_grid_enabled = gtk_switch_get_active(GTK_SWITCH(draw_grid_switch));
 
-  gtk_switch_set_state(GTK_SWITCH(draw_grid_switch),
-                       TRUE);
+  gtk_color_chooser_get_rgba(GTK_COLOR_CHOOSER(grid_color_picker),
+                             &settings->grid_color);
+
+  gtk_color_chooser_get_rgba(GTK_COLOR_CHOOSER(line_color_picker),
+                             &settings->line_color);
+
+  gtk_color_chooser_get_rgba(GTK_COLOR_CHOOSER(point_color_picker),
+                             &settings->point_color);
+
+  const gchar* point_radius_text =
+    gtk_entry_get_text(GTK_ENTRY(point_radius_entry));
+
+  gchar* end_text;
+  settings->point_radius = strtod(point_radius_text, &end_text);
+
+  const gchar* line_width_text =
+    gtk_entry_get_text(GTK_ENTRY(line_width_entry));
+
+  settings->line_width = strtod(line_width_text, &end_text);
+
+  settings->mode =
+    gtk_switch_get_active(GTK_SWITCH(batched_rendering_switch)) ?
+      RENDER_MODE_BATCHED : RENDER_MODE_SEGMENTS;
+
+  settings->n_threads =
+    gtk_switch_get_active(GTK_SWITCH(multithreaded_rendering_switch)) ?
+      g_get_num_processors() : 1;
 }
 
-// We will load `layout.glade` in this `builder`
-GtkBuilder* builder;
+// Settings `drawing_area` is drawn with, they are read from
+// <Settings> tab only when some of them have changed
+render_settings_t render_settings;
 
-// Use define to get widget by name from `builder`
-#define GET_WIDGET(widget) GTK_WIDGET(       \
-    gtk_builder_get_object(builder, widget)  \
-)
+// Frames are recorded here while `record_trace_switch` is on
+trace_t* trace = NULL;
 
-int main(int argc, char **argv) {
-  // Initialize GTK with command line arguments so it will recognize
-  // GTK options passed via command line arguments
-  gtk_init(&argc, &argv);
+// Average frame time is taken over this many last frames
+#define STATS_HISTORY_SIZE 60
 
-  // Load glade file with all the widgets
-  builder = gtk_builder_new_from_file("layout.glade");
+// What is shown by `draw_stats_overlay`, it's gathered from
+// the moment `show_stats_switch` has been turned on
+struct {
+  gint64 frame_times[STATS_HISTORY_SIZE]; // <-- Ring buffer, in microseconds
+  gsize  n_frames;
 
-  // --> Get widgets from just loaded layout file <--
-  main_window                = GET_WIDGET(               "main_window");
+  render_stats_t last_frame;
 
-  drawing_area               = GET_WIDGET(              "drawing_area");
+  gsize  n_cache_hits;
+  gsize  n_cache_misses;
+} frame_stats;
 
-  tree_view_for_points       = GET_WIDGET(      "tree_view_for_points");
-  x_entry                    = GET_WIDGET(                   "x_entry");
-  y_entry                    = GET_WIDGET(                   "y_entry");
-  choose_path_text_combo_box = GET_WIDGET("choose_path_text_combo_box");
+void record_frame(const render_stats_t* stats, gint64 start, gint64 duration) {
+  frame_stats.frame_times[frame_stats.n_frames ++ % STATS_HISTORY_SIZE] = duration;
+  frame_stats.last_frame = *stats;
 
-  line_width_entry           = GET_WIDGET(          "line_width_entry");
-  randomize_colors_switch    = GET_WIDGET(   "randomize_colors_switch");
-  line_color_picker          = GET_WIDGET(         "line_color_picker");
-  draw_grid_switch           = GET_WIDGET(          "draw_grid_switch");
-  grid_color_picker          = GET_WIDGET(         "grid_color_picker");
-  point_radius_entry         = GET_WIDGET(        "point_radius_entry");
-  point_color_picker         = GET_WIDGET(        "point_color_picker");
-  // ------------------------------------- -----------
+  frame_stats.n_cache_hits   += stats->n_cache_hits;
+  frame_stats.n_cache_misses += stats->n_cache_misses;
 
-  // Initialize tree_view & it's model
-  initialize_tree_view_for_points();
+  if (trace == NULL)
+    return;
 
-  // Set default values for drawing
-  initialize_defaults();
+  gint64 end = start + duration;
 
-  // Make GTK listen to signals and callback program
-  // when signals are being emited
-  gtk_builder_connect_signals(builder, NULL);
+  trace_add_span(trace, "draw", start, duration);
 
-  // Free builder object
-  g_object_unref(builder);
+  trace_add_counter(trace, "time, ms", end,
+                    "data" , stats->data_time  / 1000.0,
+                    "cairo", stats->cairo_time / 1000.0, NULL);
 
-  // Show window with all the children widgets
-  gtk_widget_show(main_window);
+  trace_add_counter(trace, "points", end,
+                    "all"      , (gdouble) stats->n_points,
+                    "submitted", (gdouble) stats->n_points_submitted, NULL);
 
-  // Start main event loop
-  // It will not exit until `gtk_main_quit()` call
-  gtk_main();
+  trace_add_counter(trace, "segments", end,
+                    "all"      , (gdouble) stats->n_segments,
+                    "submitted", (gdouble) stats->n_segments_submitted, NULL);
 
-  // Exit with success
-  return EXIT_SUCCESS;
+  trace_add_counter(trace, "caches", end,
+                    "hits"  , (gdouble) stats->n_cache_hits,
+                    "misses", (gdouble) stats->n_cache_misses, NULL);
+
+  trace_add_counter(trace, "allocations", end,
+                    "renderer", (gdouble) stats->n_allocations, NULL);
 }
 
-// Draw a line from (from_x, from_y) to (to_x, to_y)
-void cairo_line(cairo_t* cr, double from_x, double from_y, double to_x, double to_y) {
-  cairo_move_to(cr, from_x, from_y);
-  cairo_line_to(cr, to_x, to_y);
+#define STATS_FONT_SIZE   12
+#define STATS_LINE_HEIGHT 16
+#define STATS_MARGIN      6
+
+// Share of `part` in `whole`, in percents
+gdouble get_percentage(gsize part, gsize whole) {
+  return whole == 0 ? 0.0 : 100.0 * part / whole;
 }
 
-void draw_grid(cairo_t* cr, int padding,
-               int hcells, int vcells,
-               int width , int height,
-               GdkRGBA* grid_color) {
+void draw_stats_overlay(cairo_t* cr) {
+  gsize n_frames = MIN(frame_stats.n_frames, STATS_HISTORY_SIZE);
+  if (n_frames == 0)
+    return;
 
-  cairo_set_source_rgba(cr,
-                        grid_color->red , grid_color->green,
-                        grid_color->blue, grid_color->alpha);
+  gint64 total_time = 0;
+  for (gsize i = 0; i < n_frames; ++ i)
+    total_time += frame_stats.frame_times[i];
 
-  int delta_x = (width  - 2 * padding) / hcells;
-  int delta_y = (height - 2 * padding) / vcells;
+  gint64 last_time =
+    frame_stats.frame_times[(frame_stats.n_frames - 1) % STATS_HISTORY_SIZE];
 
-  for (int i = 0; i < hcells + 1; ++ i)
-    cairo_line(cr, padding + i * delta_x, padding, padding + i * delta_x, height - padding);
+  const render_stats_t* last = &frame_stats.last_frame;
 
-  for (int i = 0; i < vcells + 1; ++ i)
-    cairo_line(cr, padding, padding + i * delta_y, width - padding, padding + i * delta_y);
+  // With tiles points may be submitted once per tile they fall into
+  gsize n_points_culled =
+    last->n_points   - MIN(last->n_points  , last->n_points_submitted);
+  gsize n_segments_culled =
+    last->n_segments - MIN(last->n_segments, last->n_segments_submitted);
 
-  cairo_stroke(cr);
-}
+  gchar lines[6][128];
 
-void draw_paths_and_points(cairo_t* cr, int padding,
-                           int         point_radius,
-                           int  hcells, int  vcells,
-                           int  hshift, int  vshift,
-                           int   width, int  height,
-                           gdouble       line_width,
-                           GdkRGBA*     point_color,
-                           GdkRGBA*      line_color) {
+  g_snprintf(lines[0], sizeof(lines[0]), "Кадр: %.2f мс, в среднем %.2f мс",
+             last_time / 1000.0, total_time / 1000.0 / n_frames);
 
-  int delta_x = (width  - 2 * padding) / hcells;
-  int delta_y = (height - 2 * padding) / vcells;
+  g_snprintf(lines[1], sizeof(lines[1]), "Точки: %.2f мс, cairo: %.2f мс",
+             last->data_time / 1000.0, last->cairo_time / 1000.0);
 
-  GtkTreeIter parent;
-  gtk_tree_model_get_iter(GTK_TREE_MODEL(tree_store), &parent,
-                          gtk_tree_path_new_first());
+  g_snprintf(lines[2], sizeof(lines[2]), "Точек: %zu из %zu, отсечено %.1f%%",
+             last->n_points_submitted, last->n_points,
+             get_percentage(n_points_culled, last->n_points));
 
-  if (!gtk_tree_store_iter_is_valid(tree_store, &parent))
-    return;
+  g_snprintf(lines[3], sizeof(lines[3]), "Отрезков: %zu из %zu, отсечено %.1f%%",
+             last->n_segments_submitted, last->n_segments,
+             get_percentage(n_segments_culled, last->n_segments));
 
-  do {
-    GtkTreeIter iter;
-    if (gtk_tree_model_iter_n_children(GTK_TREE_MODEL(tree_store), &parent) == 0)
-      continue;
+  g_snprintf(lines[4], sizeof(lines[4]), "Кэши: %.1f%% попаданий (%zu промахов)",
+             get_percentage(frame_stats.n_cache_hits,
+                            frame_stats.n_cache_hits + frame_stats.n_cache_misses),
+             frame_stats.n_cache_misses);
 
-    gtk_tree_model_iter_nth_child(GTK_TREE_MODEL(tree_store), &iter, &parent, 0);
+  // Should stay 0 unless data or size of the widget change
+  g_snprintf(lines[5], sizeof(lines[5]), "Выделений памяти: %zu",
+             last->n_allocations);
 
-    gdouble x_from , y_from;
+  cairo_save(cr);
 
-    int i = 0; do {
-      GValue x_value = G_VALUE_INIT;
-      gtk_tree_model_get_value(GTK_TREE_MODEL(tree_store), &iter,
-                               X_COORDINATE_COLUMN, &x_value);
+  cairo_select_font_face(cr, "monospace",
+                         CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+  cairo_set_font_size(cr, STATS_FONT_SIZE);
 
-      const gchar* x_string = g_value_get_string(&x_value);
+  gdouble width = 0;
+  for (gsize i = 0; i < G_N_ELEMENTS(lines); ++ i) {
+    cairo_text_extents_t extents;
+    cairo_text_extents(cr, lines[i], &extents);
 
-      double x;
-      sscanf(x_string, "%lf", &x);
+    width = MAX(width, extents.x_advance);
+  }
+
+  cairo_set_source_rgba(cr, 0.0, 0.0, 0.0, 0.7);
+  cairo_rectangle(cr, 0, 0, width + 2 * STATS_MARGIN,
+                  G_N_ELEMENTS(lines) * STATS_LINE_HEIGHT + 2 * STATS_MARGIN);
+  cairo_fill(cr);
 
-      GValue y_value = G_VALUE_INIT;
-      gtk_tree_model_get_value(GTK_TREE_MODEL(tree_store), &iter,
-                               Y_COORDINATE_COLUMN, &y_value);
+  cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
 
-      const gchar* y_string = g_value_get_string(&y_value);
+  for (gsize i = 0; i < G_N_ELEMENTS(lines); ++ i) {
+    cairo_move_to(cr, STATS_MARGIN, STATS_MARGIN + (i + 1) * STATS_LINE_HEIGHT - 4);
+    cairo_show_text(cr, lines[i]);
+  }
 
-      double y;
-      sscanf(y_string, "%lf", &y);
+  cairo_restore(cr);
+}
 
-      x -= hshift;
-      y -= vshift;
+// Runs at most once per frame, before `drawing_area` is redrawn
+void on_frame_update(frame_dirty_t dirty, gpointer user_data) {
+  gint64 start = g_get_monotonic_time();
 
-      y = vcells - y;
+  if (dirty & (FRAME_DIRTY_STYLE | FRAME_DIRTY_GRID))
+    get_render_settings(&render_settings);
 
-      double x_real = x * delta_x + padding;
-      double y_real = y * delta_y + padding;
+  // Points of live paths drop off without touching their bounds,
+  // so bounds are tightened here, once per frame
+  if (dirty & FRAME_DIRTY_DATA)
+    for (gsize i = 0; i < point_store->n_paths; ++ i)
+      if (point_store->paths[i]->has_loose_bounds)
+        path_update_bounds(point_store->paths[i]);
 
-      // Draw a line
-      if (i != 0) {
-        cairo_set_source_rgba(cr,
-                              line_color->red , line_color->green,
-                              line_color->blue, line_color->alpha);
+  if (is_viewport_fitted && (dirty & (FRAME_DIRTY_DATA | FRAME_DIRTY_GEOMETRY)))
+    fit_viewport();
 
-        cairo_set_line_width(cr, line_width);
-        cairo_line(cr, x_from, y_from, x_real, y_real);
+  if (trace != NULL)
+    trace_add_span(trace, "update", start, g_get_monotonic_time() - start);
+}
 
-        cairo_stroke(cr);
-      }
+transform_t get_drawing_area_transform(const bounds_t* shown_viewport) {
+  return transform_for_viewport(shown_viewport,
+                                gtk_widget_get_allocated_width (drawing_area),
+                                gtk_widget_get_allocated_height(drawing_area),
+                                DRAWING_AREA_PADDING);
+}
 
-      if (i != 0) {
-        // Draw a point
-        cairo_set_source_rgba(cr,
-                              point_color->red , point_color->green,
-                              point_color->blue, point_color->alpha);
+// Part of `drawing_area` taken by `index`-th point of `path`
+// and both segments that go to it
+void get_point_area(path_t* path, gsize index, cairo_rectangle_int_t* area) {
+  gsize from = index == 0 ? 0 : index - 1;
+  gsize to   = MIN(index + 1, path->n_points - 1);
 
-        cairo_arc(cr, x_from, y_from, point_radius, 0, 2 * 3.1415926);
+  render_get_points_area(&render_settings, &viewport, DRAWING_AREA_PADDING,
+                         gtk_widget_get_allocated_width (drawing_area),
+                         gtk_widget_get_allocated_height(drawing_area),
+                         path, from, to, area);
+}
 
-        cairo_fill(cr);
-      }
+// Called after `index`-th point of `path` was moved or removed, only
+// `old_area` it took before and the area around it now are redrawn.
+// If the edit changes the fitted viewport, everything moves anyway
+void mark_point_edited(path_t* path, gsize index, const cairo_rectangle_int_t* old_area) {
+  if (is_viewport_fitted) {
+    bounds_t fitted;
+    render_fit_viewport(point_store, &fitted);
 
-      x_from = x_real;
-      y_from = y_real;
+    if (!bounds_equal(&fitted, &viewport)) {
+      frame_scheduler_mark_dirty(frame_scheduler, FRAME_DIRTY_DATA);
+      return;
+    }
+  }
 
-      ++ i;
-    } while(gtk_tree_model_iter_next(GTK_TREE_MODEL(tree_store), &iter));
+  frame_scheduler_mark_damaged(frame_scheduler, old_area);
 
-    // Draw the last point
-    cairo_set_source_rgba(cr,
-                          point_color->red , point_color->green,
-                          point_color->blue, point_color->alpha);
+  // Point that took the place of the removed one (or the previous one,
+  // if it was the last) is connected to both neighbours of the old one
+  if (path->n_points != 0) {
+    cairo_rectangle_int_t new_area;
+    get_point_area(path, MIN(index, path->n_points - 1), &new_area);
 
-    cairo_arc(cr, x_from, y_from, point_radius, 0, 2 * 3.1415926);
+    frame_scheduler_mark_damaged(frame_scheduler, &new_area);
+  }
 
-    cairo_fill(cr);
-  } while(gtk_tree_model_iter_next(GTK_TREE_MODEL(tree_store), &parent));
+  // Overlay lies on top of everything, it can't be redrawn in parts
+  if (gtk_switch_get_active(GTK_SWITCH(show_stats_switch)))
+    frame_scheduler_mark_dirty(frame_scheduler, FRAME_DIRTY_OVERLAY);
 }
 
-void redraw(cairo_t* cr) {
-  int width = gtk_widget_get_allocated_width(drawing_area);
-  int height = gtk_widget_get_allocated_height(drawing_area);
+// Each scroll step zooms in or out this many times
+#define ZOOM_FACTOR 1.25
 
-  update_min_and_max_points();
+// Viewport won't get smaller than that when zooming in
+#define MIN_VIEWPORT_SIZE 1e-9
 
-  int padding = 10;
+gboolean on_drawing_area_scroll(GtkWidget *widget, GdkEventScroll *event, gpointer data) {
+  gdouble factor;
 
-  int hcells = max.x - min.x;
-  int vcells = max.y - min.y;
+  if (event->direction == GDK_SCROLL_UP)
+    factor = 1 / ZOOM_FACTOR;
+  else if (event->direction == GDK_SCROLL_DOWN)
+    factor = ZOOM_FACTOR;
+  else
+    return FALSE;
 
-  int hshift = min.x;
-  int vshift = min.y;
+  if (is_viewport_fitted)
+    fit_viewport();
 
-  hcells = hcells < 1 ? 1 : hcells;
-  vcells = vcells < 1 ? 1 : vcells;
+  if (factor < 1 && (viewport.max.x - viewport.min.x < MIN_VIEWPORT_SIZE ||
+                     viewport.max.y - viewport.min.y < MIN_VIEWPORT_SIZE))
+    return TRUE;
 
-  gboolean is_grid_enabled = gtk_switch_get_active(GTK_SWITCH(draw_grid_switch));
+  // Point under the cursor stays where it is
+  transform_t transform = get_drawing_area_transform(&viewport);
 
-  if (is_grid_enabled) {
-    GdkRGBA grid_color;
-    gtk_color_chooser_get_rgba(GTK_COLOR_CHOOSER(grid_color_picker), &grid_color);
+  gdouble x = transform_inverse_x(&transform, event->x);
+  gdouble y = transform_inverse_y(&transform, event->y);
 
-    draw_grid(cr, padding, hcells, vcells, width, height, &grid_color);
-  }
+  viewport.min.x = x - (x - viewport.min.x) * factor;
+  viewport.max.x = x + (viewport.max.x - x) * factor;
 
-  GdkRGBA line_color;
-  gtk_color_chooser_get_rgba(GTK_COLOR_CHOOSER(line_color_picker),
-                             &line_color);
+  viewport.min.y = y - (y - viewport.min.y) * factor;
+  viewport.max.y = y + (viewport.max.y - y) * factor;
 
-  GdkRGBA point_color;
-  gtk_color_chooser_get_rgba(GTK_COLOR_CHOOSER(point_color_picker),
-                             &point_color);
+  is_viewport_fitted = FALSE;
 
-  const gchar* point_radius_text =
-    gtk_entry_get_text(GTK_ENTRY(point_radius_entry));
+  frame_scheduler_mark_dirty(frame_scheduler, FRAME_DIRTY_GEOMETRY);
+  return TRUE;
+}
 
-  gchar* end_text;
-  double point_radius = strtod(point_radius_text, &end_text);
+// Point is picked if it's this close to the cursor, in pixels
+#define PICK_RADIUS 8
 
-  const gchar* line_width_text =
-    gtk_entry_get_text(GTK_ENTRY(line_width_entry));
+// Finds point nearest to (`x`, `y`) in `drawing_area` among all the
+// paths, with the help of their point indices (see point_index.h).
+// Live paths are skipped, they have no rows to select and move on
+gboolean pick_point(gdouble x, gdouble y, gssize* path_index, gsize* point_index) {
+  transform_t transform = get_drawing_area_transform(&viewport);
 
-  double line_width = strtod(line_width_text, &end_text);
+  gboolean is_picked = FALSE;
+  gdouble  radius    = PICK_RADIUS;
 
-  draw_paths_and_points(cr, padding, point_radius,
-                        hcells, vcells,
-                        hshift, vshift,
-                        width , height,  line_width,
-                          &point_color, &line_color);
-}
+  for (gsize i = 0; i < point_store->n_paths; ++ i) {
+    path_t* path = point_store->paths[i];
 
-// Handler for `drawing_area` `draw` signal
-void on_drawing_area_draw(GtkWidget *drawing_area, cairo_t *cr, gpointer data) {
-  redraw(cr);
-}
+    if (path->window_size != 0)
+      continue;
 
-// It handles various events that can change tree_store state
-void refresh() {
-  gtk_widget_queue_draw(drawing_area);
+    const point_index_t* index = point_index_get(path);
+    if (index == NULL)
+      continue;
+
+    gsize   nearest;
+    gdouble distance;
+
+    if (point_index_find_nearest(index, path, &transform, x, y, radius,
+                                 &nearest, &distance)) {
+      *path_index  = i;
+      *point_index = nearest;
+
+      // Next paths have to be even closer
+      radius    = sqrt(distance);
+      is_picked = TRUE;
+    }
+  }
+
+  return is_picked;
 }
 
-int path_number = 1;
-void on_add_path_button_clicked(GtkButton* button, gpointer user_data){
-  GtkTreeIter iter;
+// Where the cursor and the viewport were when dragging started
+gboolean is_dragging = FALSE;
+gdouble  drag_start_x, drag_start_y;
+bounds_t drag_start_viewport;
 
-  int  len     = snprintf(NULL, 0,"%d", path_number);
-  char num[len];  sprintf(num, "%d", path_number ++);
+// Set instead of `is_dragging` when drag started on a point, then it's
+// the selected point that is moved, and it stays that far from the cursor
+gboolean is_dragging_point = FALSE;
+gdouble  grab_offset_x, grab_offset_y;
 
-  gchar* name = "Контур ";
-  gchar* path_name = g_strconcat(name, num, NULL);
+gboolean on_drawing_area_button_pressed(GtkWidget *widget, GdkEventButton *event, gpointer data) {
+  if (event->button != GDK_BUTTON_PRIMARY)
+    return FALSE;
 
-  gtk_tree_store_append(tree_store, &iter, NULL);
-  gtk_tree_store_set(tree_store, &iter,
-                     X_COORDINATE_COLUMN, path_name,
-                     Y_COORDINATE_COLUMN, "",
-                     -1);
+  // Double click brings back the view of all the points
+  if (event->type == GDK_2BUTTON_PRESS) {
+    is_dragging = FALSE;
+    is_dragging_point = FALSE;
+    is_viewport_fitted = TRUE;
 
-  g_free(path_name);
+    frame_scheduler_mark_dirty(frame_scheduler, FRAME_DIRTY_GEOMETRY);
+    return TRUE;
+  }
 
-  update_paths_in_combo_box();
-}
+  if (is_viewport_fitted)
+    fit_viewport();
 
-void on_add_point_button_clicked(GtkButton* button, gpointer user_data) {
-  const gchar* x_text = gtk_entry_get_text(GTK_ENTRY(x_entry));
-  const gchar* y_text = gtk_entry_get_text(GTK_ENTRY(y_entry));
+  // Point under the cursor is selected and dragged, empty space pans the view
+  gssize path_index;
+  gsize  point_index;
 
-  // Defaults for x in y
-  if (g_strcmp0(x_text, "") == 0)
-    x_text = "0";
+  if (pick_point(event->x, event->y, &path_index, &point_index)) {
+    selected_path_index  = path_index;
+    selected_point_index = point_index;
 
-  if (g_strcmp0(y_text, "") == 0)
-    y_text = "0";
+    show_selected_point_in_tree_view();
 
-  if (!is_number(y_text)) {
-    gtk_entry_set_text(GTK_ENTRY(y_entry), "");
-    return;
+    transform_t transform = get_drawing_area_transform(&viewport);
+    point_t point = path_get_point(point_store->paths[path_index], point_index);
+
+    grab_offset_x = transform_x(&transform, point.x) - event->x;
+    grab_offset_y = transform_y(&transform, point.y) - event->y;
+
+    is_dragging_point = TRUE;
+
+    frame_scheduler_mark_dirty(frame_scheduler, FRAME_DIRTY_OVERLAY);
+    return TRUE;
   }
 
-  if (!is_number(x_text)) {
-    gtk_entry_set_text(GTK_ENTRY(x_entry), "");
+  is_dragging = TRUE;
+
+  drag_start_x = event->x;
+  drag_start_y = event->y;
+  drag_start_viewport = viewport;
+
+  return TRUE;
+}
+
+// Moves the dragged point under the cursor, it's an edit
+// just like the one made in `tree_view_for_points`
+void drag_selected_point(gdouble x, gdouble y) {
+  if (!is_point_selected())
     return;
+
+  path_t* path = point_store->paths[selected_path_index];
+
+  // View doesn't follow the point while it's being moved
+  is_viewport_fitted = FALSE;
+
+  transform_t transform = get_drawing_area_transform(&viewport);
+
+  cairo_rectangle_int_t old_area;
+  get_point_area(path, selected_point_index, &old_area);
+
+  path_set_point(path, selected_point_index,
+                 transform_inverse_x(&transform, x + grab_offset_x),
+                 transform_inverse_y(&transform, y + grab_offset_y));
+
+  point_model_row_changed(point_model, selected_path_index, selected_point_index);
+  mark_point_edited(path, selected_point_index, &old_area);
+
+  // Circle around it has moved too
+  frame_scheduler_mark_dirty(frame_scheduler, FRAME_DIRTY_OVERLAY);
+}
+
+gboolean on_drawing_area_motion(GtkWidget *widget, GdkEventMotion *event, gpointer data) {
+  if (is_dragging_point) {
+    drag_selected_point(event->x, event->y);
+    return TRUE;
   }
 
-  gchar* path_name = gtk_combo_box_text_get_active_text(
-    GTK_COMBO_BOX_TEXT(choose_path_text_combo_box)
-  );
+  if (!is_dragging)
+    return FALSE;
 
-  if (path_name == NULL)
-    return;
+  transform_t transform = get_drawing_area_transform(&drag_start_viewport);
 
-  GtkTreeIter iter;
-  gtk_tree_model_get_iter(GTK_TREE_MODEL(tree_store), &iter,
-                          gtk_tree_path_new_first());
+  gdouble delta_x = (event->x - drag_start_x) / transform.scale_x;
+  gdouble delta_y = (event->y - drag_start_y) / transform.scale_y;
 
-  if (!gtk_tree_store_iter_is_valid(tree_store, &iter))
-    return;
+  viewport.min.x = drag_start_viewport.min.x - delta_x;
+  viewport.max.x = drag_start_viewport.max.x - delta_x;
 
-  do {
-    GValue value = G_VALUE_INIT;
-    gtk_tree_model_get_value(GTK_TREE_MODEL(tree_store), &iter, X_COORDINATE_COLUMN, &value);
+  viewport.min.y = drag_start_viewport.min.y - delta_y;
+  viewport.max.y = drag_start_viewport.max.y - delta_y;
 
-    const gchar* name = g_value_get_string(&value);
-    if (g_strcmp0(path_name, name) == 0) {
-      GtkTreeIter append_iter;
+  is_viewport_fitted = FALSE;
 
-      gtk_tree_store_append(tree_store, &append_iter, &iter);
-      gtk_tree_store_set(tree_store, &append_iter,
-                         X_COORDINATE_COLUMN, x_text,
-                         Y_COORDINATE_COLUMN, y_text,
-                         -1);
+  frame_scheduler_mark_dirty(frame_scheduler, FRAME_DIRTY_GEOMETRY);
+  return TRUE;
+}
 
-      return;
-    }
-  } while(gtk_tree_model_iter_next(GTK_TREE_MODEL(tree_store), &iter));
+gboolean on_drawing_area_button_released(GtkWidget *widget, GdkEventButton *event, gpointer data) {
+  if (event->button != GDK_BUTTON_PRIMARY)
+    return FALSE;
+
+  is_dragging = FALSE;
+  is_dragging_point = FALSE;
+
+  return TRUE;
+}
+
+// Radius of the circle drawn around the selected point, in pixels
+#define SELECTION_RADIUS 6
+
+// Circles the selected point, it's drawn over the picture like the stats
+// overlay, so it's where the point is now, even if the frame is older
+void draw_selected_point(cairo_t* cr) {
+  if (!is_point_selected())
+    return;
+
+  transform_t transform = get_drawing_area_transform(&viewport);
+  point_t point = path_get_point(point_store->paths[selected_path_index],
+                                 selected_point_index);
+
+  cairo_save(cr);
+
+  cairo_arc(cr, transform_x(&transform, point.x), transform_y(&transform, point.y),
+            SELECTION_RADIUS, 0, 2 * G_PI);
+
+  cairo_set_line_width(cr, 2);
+  cairo_set_source_rgb(cr, 0.9, 0.1, 0.1);
+  cairo_stroke(cr);
+
+  cairo_restore(cr);
+}
+
+// `drawing_area` is the widget declared in the top of the file
+void initialize_drawing_area(void) {
+  gtk_widget_add_events(drawing_area,
+                        GDK_SCROLL_MASK         |
+                        GDK_BUTTON_PRESS_MASK   |
+                        GDK_BUTTON_RELEASE_MASK |
+                        GDK_BUTTON1_MOTION_MASK);
+
+  g_signal_connect(G_OBJECT(drawing_area), "scroll-event",
+                   G_CALLBACK(on_drawing_area_scroll), NULL);
+  g_signal_connect(G_OBJECT(drawing_area), "button-press-event",
+                   G_CALLBACK(on_drawing_area_button_pressed), NULL);
+  g_signal_connect(G_OBJECT(drawing_area), "motion-notify-event",
+                   G_CALLBACK(on_drawing_area_motion), NULL);
+  g_signal_connect(G_OBJECT(drawing_area), "button-release-event",
+                   G_CALLBACK(on_drawing_area_button_released), NULL);
+
+  frame_scheduler = frame_scheduler_new(drawing_area, on_frame_update, NULL);
+}
+
+// All the pickers are created once and only hidden after use,
+// so they remember the folder user has been to last time
+// They are created when one of them is needed for the first time
+void initialize_file_pickers(void) {
+  if (open_project_file_picker != NULL)
+    return;
+
+  GtkFileFilter* filter = gtk_file_filter_new();
+  gtk_file_filter_set_name(filter, "Проекты (*.pdproj)");
+  gtk_file_filter_add_pattern(filter, "*.pdproj");
+
+  open_project_file_picker = gtk_file_chooser_dialog_new(
+    "Открыть проект", GTK_WINDOW(main_window),
+    GTK_FILE_CHOOSER_ACTION_OPEN,
+    "Отмена", GTK_RESPONSE_CANCEL,
+    "Открыть", GTK_RESPONSE_ACCEPT, NULL
+  );
+
+  save_project_file_picker = gtk_file_chooser_dialog_new(
+    "Сохранить проект", GTK_WINDOW(main_window),
+    GTK_FILE_CHOOSER_ACTION_SAVE,
+    "Отмена", GTK_RESPONSE_CANCEL,
+    "Сохранить", GTK_RESPONSE_ACCEPT, NULL
+  );
+
+  // Same filter is shared by both pickers
+  g_object_ref_sink(filter);
+  gtk_file_chooser_add_filter(GTK_FILE_CHOOSER(open_project_file_picker), filter);
+  gtk_file_chooser_add_filter(GTK_FILE_CHOOSER(save_project_file_picker), filter);
+  g_object_unref(filter);
+
+  gtk_file_chooser_set_do_overwrite_confirmation(
+    GTK_FILE_CHOOSER(save_project_file_picker), TRUE);
+
+  gtk_file_chooser_set_current_name(
+    GTK_FILE_CHOOSER(save_project_file_picker), "Проект.pdproj");
+
+  import_file_picker = gtk_file_chooser_dialog_new(
+    "Импорт из файла", GTK_WINDOW(main_window),
+    GTK_FILE_CHOOSER_ACTION_OPEN,
+    "Отмена", GTK_RESPONSE_CANCEL,
+    "Импортировать", GTK_RESPONSE_ACCEPT, NULL
+  );
+
+  GtkFileFilter* text_filter = gtk_file_filter_new();
+  gtk_file_filter_set_name(text_filter, "Таблицы (*.csv, *.tsv, *.txt, *.dat)");
+  gtk_file_filter_add_pattern(text_filter, "*.csv");
+  gtk_file_filter_add_pattern(text_filter, "*.tsv");
+  gtk_file_filter_add_pattern(text_filter, "*.txt");
+  gtk_file_filter_add_pattern(text_filter, "*.dat");
+
+  GtkFileFilter* any_filter = gtk_file_filter_new();
+  gtk_file_filter_set_name(any_filter, "Все файлы");
+  gtk_file_filter_add_pattern(any_filter, "*");
+
+  gtk_file_chooser_add_filter(GTK_FILE_CHOOSER(import_file_picker), text_filter);
+  gtk_file_chooser_add_filter(GTK_FILE_CHOOSER(import_file_picker), any_filter);
+
+  save_image_file_picker = gtk_file_chooser_dialog_new(
+    "Сохранить изображение", GTK_WINDOW(main_window),
+    GTK_FILE_CHOOSER_ACTION_SAVE,
+    "Отмена", GTK_RESPONSE_CANCEL,
+    "Сохранить", GTK_RESPONSE_ACCEPT, NULL
+  );
+
+  GtkFileFilter* image_filter = gtk_file_filter_new();
+  gtk_file_filter_set_name(image_filter, "Изображения (*.png, *.svg, *.pdf)");
+  gtk_file_filter_add_pattern(image_filter, "*.png");
+  gtk_file_filter_add_pattern(image_filter, "*.svg");
+  gtk_file_filter_add_pattern(image_filter, "*.pdf");
+
+  gtk_file_chooser_add_filter(GTK_FILE_CHOOSER(save_image_file_picker), image_filter);
+
+  gtk_file_chooser_set_do_overwrite_confirmation(
+    GTK_FILE_CHOOSER(save_image_file_picker), TRUE);
+
+  gtk_file_chooser_set_current_name(
+    GTK_FILE_CHOOSER(save_image_file_picker), "Рисунок.png");
+
+  save_trace_file_picker = gtk_file_chooser_dialog_new(
+    "Записывать трассировку в", GTK_WINDOW(main_window),
+    GTK_FILE_CHOOSER_ACTION_SAVE,
+    "Отмена", GTK_RESPONSE_CANCEL,
+    "Записывать", GTK_RESPONSE_ACCEPT, NULL
+  );
+
+  GtkFileFilter* trace_filter = gtk_file_filter_new();
+  gtk_file_filter_set_name(trace_filter, "Трассировки Chrome (*.json)");
+  gtk_file_filter_add_pattern(trace_filter, "*.json");
+
+  gtk_file_chooser_add_filter(GTK_FILE_CHOOSER(save_trace_file_picker), trace_filter);
+
+  gtk_file_chooser_set_do_overwrite_confirmation(
+    GTK_FILE_CHOOSER(save_trace_file_picker), TRUE);
+
+  gtk_file_chooser_set_current_name(
+    GTK_FILE_CHOOSER(save_trace_file_picker), "Трассировка.json");
+}
+
+// Defaults:
+//     line (color = #555753, size = 5)
+//     grid (color = #D3D7CF, enabled = true)
+//     point(color = #2E3436, radius = 5)
+//     batched rendering (enabled = true)
+//     multithreaded rendering (enabled = true, if there's more than one core)
+void initialize_defaults(void) {
+  // Same defaults are used for images rendered from command line
+  render_settings_t defaults;
+  render_settings_init(&defaults);
+
+  gtk_color_chooser_set_rgba(GTK_COLOR_CHOOSER(grid_color_picker),
+                            &defaults.grid_color);
+
+  gtk_color_chooser_set_rgba(GTK_COLOR_CHOOSER(line_color_picker),
+                            &defaults.line_color);
+
+  gtk_color_chooser_set_rgba(GTK_COLOR_CHOOSER(point_color_picker),
+                            &defaults.point_color);
+
+  gchar line_width_text[COORDINATE_TEXT_SIZE];
+  g_snprintf(line_width_text, sizeof(line_width_text), "%g", defaults.line_width);
+  gtk_entry_set_text(GTK_ENTRY(  line_width_entry), line_width_text);
+
+  gchar point_radius_text[COORDINATE_TEXT_SIZE];
+  g_snprintf(point_radius_text, sizeof(point_radius_text), "%d", defaults.point_radius);
+  gtk_entry_set_text(GTK_ENTRY(point_radius_entry), point_radius_text);
+
+  gtk_switch_set_state(GTK_SWITCH(draw_grid_switch),
+                       defaults.is_grid_enabled);
+
+  gtk_switch_set_state(GTK_SWITCH(batched_rendering_switch),
+                       defaults.mode == RENDER_MODE_BATCHED);
+
+  gtk_switch_set_state(GTK_SWITCH(multithreaded_rendering_switch),
+                       defaults.n_threads > 1);
+
+  // Everything has to be read and drawn for the first frame
+  frame_scheduler_mark_dirty(frame_scheduler, FRAME_DIRTY_ALL);
+}
+
+// Live points (see stream.h) go to live paths, which keep only the last
+// `stream_window_size` points. They get no rows in `point_model` for them:
+// appending rows would cost much more than drawing the points
+stream_t* stream        = NULL;
+gchar*    stream_source = NULL;
+
+gint stream_window_size = 1 << 16;
+
+// Points without path name go to the path with this name
+#define STREAM_PATH_NAME "Поток"
+
+// Index of the path that got the previous point, the next one most likely
+// goes to it too. It's not a pointer, since the path may be removed
+gsize last_stream_path_index = 0;
+
+// Finds live path named `name`, existing path that isn't live
+// becomes live (rows of it's points are removed), missing is created
+path_t* get_stream_path(const gchar* name, gsize name_length) {
+  if (last_stream_path_index < point_store->n_paths) {
+    path_t* path = point_store->paths[last_stream_path_index];
+
+    if (path->window_size != 0 && strlen(path->name) == name_length &&
+        memcmp(path->name, name, name_length) == 0)
+      return path;
+  }
+
+  gchar* path_name = g_strndup(name, name_length);
+  gssize path_index = point_store_find_path(point_store, path_name);
+
+  if (path_index == -1) {
+    point_store_add_path(point_store, path_name);
+    path_index = point_store->n_paths - 1;
+
+    point_model_paths_added(point_model, path_index);
+    append_paths_to_combo_box(path_index);
+  }
+
+  g_free(path_name);
+
+  path_t* path = point_store->paths[path_index];
+  if (path->window_size == 0) {
+    gsize n_points = path->n_points;
+
+    path_set_window(path, stream_window_size);
+    point_model_points_hidden(point_model, path_index, n_points);
+  }
+
+  last_stream_path_index = path_index;
+  return path;
+}
+
+void on_stream_point(const gchar* name, gsize name_length,
+                     gdouble x, gdouble y, gpointer user_data) {
+  path_append_point(get_stream_path(name, name_length), x, y);
+
+  // Points come much more often than frames, but
+  // all of them are drawn in one go on the next one
+  frame_scheduler_mark_dirty(frame_scheduler, FRAME_DIRTY_DATA);
+}
+
+// With `--startup-time` program quits right after the first frame is
+// shown, printing how long it took from the start of `main` to get there.
+// Loading of the libraries before `main` isn't included. Single runs are
+// noisy, to compare two builds take the median of a few dozen runs of each,
+// and for a truly cold start drop the page cache before every run:
+//
+//     sync; echo 3 | sudo tee /proc/sys/vm/drop_caches
+//     ./point-drawer --startup-time
+gboolean is_startup_timed = FALSE;
+
+struct {
+  gint64 start; // <-- `main` is entered
+  gint64 gtk;   // <-- GTK is initialized
+  gint64 ui;    // <-- All the widgets are loaded and set up
+} startup_times;
+
+void report_startup_time(void) {
+  gint64 end = g_get_monotonic_time();
+
+  g_print("Startup: %.1f ms (GTK %.1f ms, UI %.1f ms, first frame %.1f ms)\n",
+          (end                 - startup_times.start) / 1000.0,
+          (startup_times.gtk   - startup_times.start) / 1000.0,
+          (startup_times.ui    - startup_times.gtk  ) / 1000.0,
+          (end                 - startup_times.ui   ) / 1000.0);
+
+  gtk_main_quit();
+}
+
+// Set by `--compact`: paths that points are imported to are made compact,
+// so they take a fraction of the memory (see compact.h for the precision)
+gboolean are_imports_compact = FALSE;
+
+// We will load `layout.glade` in this `builder`
+GtkBuilder* builder;
+
+// Path of `layout.glade` among the resources (see layout.gresource.xml)
+#define LAYOUT_RESOURCE "/point-drawer/layout.glade"
+
+// Use define to get widget by name from `builder`
+#define GET_WIDGET(widget) GTK_WIDGET(       \
+    gtk_builder_get_object(builder, widget)  \
+)
+
+int main(int argc, char **argv) {
+  startup_times.start = g_get_monotonic_time();
+
+  // Rendering to files (see cli.h) needs no display, so
+  // it's done before GTK is even initialized
+  if (cli_is_render_requested(argc, argv))
+    return cli_render(argc, argv);
+
+  GOptionEntry entries[] = {
+    { "stream", 0, 0, G_OPTION_ARG_FILENAME, &stream_source,
+      "Draw points read live from SOURCE: - (stdin), FIFO, file or unix:SOCKET", "SOURCE" },
+    { "window", 0, 0, G_OPTION_ARG_INT, &stream_window_size,
+      "Keep only the last N points of every live path (65536 by default)", "N" },
+    { "startup-time", 0, 0, G_OPTION_ARG_NONE, &is_startup_timed,
+      "Print how long it took to show the first frame and quit", NULL },
+    { "compact", 0, 0, G_OPTION_ARG_NONE, &are_imports_compact,
+      "Keep imported points compact: 2-6 times less memory, 1e-10 precision", NULL },
+    { NULL }
+  };
+
+  // Initialize GTK with command line arguments so it will recognize
+  // GTK options passed via command line arguments
+  GError* error = NULL;
+  if (!gtk_init_with_args(&argc, &argv, NULL, entries, NULL, &error)) {
+    g_printerr("%s\n", error != NULL ? error->message : "Can't open display");
+    return EXIT_FAILURE;
+  }
+
+  if (stream_window_size <= 0) {
+    g_printerr("Window should be at least one point long\n");
+    return EXIT_FAILURE;
+  }
+
+  startup_times.gtk = g_get_monotonic_time();
+
+  // Load glade file with all the widgets, it's compiled into the program
+  builder = gtk_builder_new_from_resource(LAYOUT_RESOURCE);
+
+  // --> Get widgets from just loaded layout file <--
+  main_window                = GET_WIDGET(               "main_window");
+
+  drawing_area               = GET_WIDGET(              "drawing_area");
+  open_project_button        = GET_WIDGET(       "open_project_button");
+
+  tree_view_for_points       = GET_WIDGET(      "tree_view_for_points");
+  add_path_button            = GET_WIDGET(           "add_path_button");
+  import_button              = GET_WIDGET(             "import_button");
+  import_progress_box        = GET_WIDGET(       "import_progress_box");
+  import_progress_bar        = GET_WIDGET(       "import_progress_bar");
+  x_entry                    = GET_WIDGET(                   "x_entry");
+  y_entry                    = GET_WIDGET(                   "y_entry");
+  choose_path_text_combo_box = GET_WIDGET("choose_path_text_combo_box");
+  add_point_button           = GET_WIDGET(          "add_point_button");
+  shift_x_entry              = GET_WIDGET(             "shift_x_entry");
+  shift_y_entry              = GET_WIDGET(             "shift_y_entry");
+  scale_entry                = GET_WIDGET(               "scale_entry");
+  rotation_entry             = GET_WIDGET(            "rotation_entry");
+  resample_entry             = GET_WIDGET(            "resample_entry");
+  transform_button           = GET_WIDGET(          "transform_button");
+  resample_button            = GET_WIDGET(           "resample_button");
+
+  line_width_entry           = GET_WIDGET(          "line_width_entry");
+  randomize_colors_switch    = GET_WIDGET(   "randomize_colors_switch");
+  line_color_picker          = GET_WIDGET(         "line_color_picker");
+  draw_grid_switch           = GET_WIDGET(          "draw_grid_switch");
+  grid_color_picker          = GET_WIDGET(         "grid_color_picker");
+  point_radius_entry         = GET_WIDGET(        "point_radius_entry");
+  point_color_picker         = GET_WIDGET(        "point_color_picker");
+  batched_rendering_switch   = GET_WIDGET(  "batched_rendering_switch");
+  multithreaded_rendering_switch = GET_WIDGET("multithreaded_rendering_switch");
+  show_stats_switch          = GET_WIDGET(         "show_stats_switch");
+  record_trace_switch        = GET_WIDGET(       "record_trace_switch");
+  // ------------------------------------- -----------
+
+  // Create storage for paths, it starts empty
+  initialize_point_store();
+
+  // Model follows the store from the start, but `tree_view_for_points`
+  // and file pickers are only set up once they are needed
+  initialize_point_model();
+
+  // Make preview react to zooming and panning
+  initialize_drawing_area();
+
+  // Set default values for drawing
+  initialize_defaults();
+
+  // Start reading live points if they were asked for
+  if (stream_source != NULL) {
+    stream = stream_open(stream_source, STREAM_PATH_NAME,
+                         on_stream_point, NULL, &error);
+
+    if (stream == NULL) {
+      g_printerr("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Make GTK listen to signals and callback program
+  // when signals are being emited
+  gtk_builder_connect_signals(builder, NULL);
+
+  // Free builder object
+  g_object_unref(builder);
+
+  startup_times.ui = g_get_monotonic_time();
+
+  // Show window with all the children widgets
+  gtk_widget_show(main_window);
+
+  // Start main event loop
+  // It will not exit until `gtk_main_quit()` call
+  gtk_main();
+
+  // Trace that is still being recorded has to be finished to be readable
+  if (trace != NULL && !trace_close(trace, &error)) {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+  }
+
+  // Exit with success
+  return EXIT_SUCCESS;
+}
+
+// Frames of `drawing_area` are drawn by it, so even a slow frame
+// doesn't block the window. It lives as long as the program
+render_worker_t* render_worker = NULL;
+
+// Size of the last frame asked for, resizes don't mark anything
+// in `frame_scheduler`, so they are found out by comparing to it
+int requested_width = -1, requested_height = -1;
+
+void get_render_input(render_input_t* input, gpointer user_data) {
+  *input = (render_input_t) {
+    .store    = point_store,
+    .settings = render_settings,
+    .viewport = viewport,
+    .padding  = DRAWING_AREA_PADDING,
+
+    .width  = gtk_widget_get_allocated_width (drawing_area),
+    .height = gtk_widget_get_allocated_height(drawing_area),
+    .scale  = gtk_widget_get_scale_factor(drawing_area)
+  };
+}
+
+void on_frame_rendered(const render_stats_t* stats, gint64 start, gint64 duration,
+                       gpointer user_data) {
+  record_frame(stats, start, duration);
+  gtk_widget_queue_draw(drawing_area);
+}
+
+void redraw(cairo_t* cr) {
+  int width = gtk_widget_get_allocated_width(drawing_area);
+  int height = gtk_widget_get_allocated_height(drawing_area);
+
+  if (render_worker == NULL)
+    render_worker = render_worker_new(get_render_input, on_frame_rendered, NULL);
+
+  frame_dirty_t dirty = frame_scheduler_take_updated(frame_scheduler);
+
+  gboolean is_resized = width != requested_width || height != requested_height;
+
+  // Overlay isn't a part of the picture, it alone needs no new frame
+  if ((dirty & ~FRAME_DIRTY_OVERLAY) != 0 || is_resized) {
+    // Paths are drawn again only if something they depend on has changed
+    gboolean are_paths_changed =
+      (dirty & (FRAME_DIRTY_STYLE | FRAME_DIRTY_DATA | FRAME_DIRTY_GEOMETRY)) != 0;
+
+    // Edits of single points leave most of the paths as they were
+    const cairo_region_t* damage = (dirty & FRAME_DIRTY_DAMAGE) ?
+      frame_scheduler_get_damage(frame_scheduler) : NULL;
+
+    render_worker_request(render_worker, are_paths_changed, damage);
+
+    requested_width  = width;
+    requested_height = height;
+  }
+
+  // Until the new frame is ready, the last one is shown
+  gboolean is_painted = render_worker_paint(render_worker, cr);
+
+  if (is_painted && is_startup_timed) {
+    is_startup_timed = FALSE;
+    report_startup_time();
+  }
+
+  // Overlay isn't a part of the picture, so it's never cached
+  draw_selected_point(cr);
+
+  if (gtk_switch_get_active(GTK_SWITCH(show_stats_switch)))
+    draw_stats_overlay(cr);
+}
+
+// Handler for `drawing_area` `draw` signal
+gboolean on_drawing_area_draw(GtkWidget *drawing_area, cairo_t *cr, gpointer data) {
+  redraw(cr);
+  return FALSE;
+}
+
+// Handlers for widgets of <Settings> tab, they only tell what has changed,
+// settings themselves are read once per frame in `on_frame_update`
+void on_style_entry_changed(GtkEditable* editable, gpointer user_data) {
+  frame_scheduler_mark_dirty(frame_scheduler, FRAME_DIRTY_STYLE);
+}
+
+void on_style_color_set(GtkColorButton* button, gpointer user_data) {
+  frame_scheduler_mark_dirty(frame_scheduler, FRAME_DIRTY_STYLE);
+}
+
+// Returns FALSE, so switch's own handler still updates it's state
+gboolean on_style_switch_state_set(GtkSwitch* widget, gboolean state, gpointer user_data) {
+  frame_scheduler_mark_dirty(frame_scheduler, FRAME_DIRTY_STYLE);
+  return FALSE;
+}
+
+void on_grid_color_set(GtkColorButton* button, gpointer user_data) {
+  frame_scheduler_mark_dirty(frame_scheduler, FRAME_DIRTY_GRID);
+}
+
+gboolean on_grid_switch_state_set(GtkSwitch* widget, gboolean state, gpointer user_data) {
+  frame_scheduler_mark_dirty(frame_scheduler, FRAME_DIRTY_GRID);
+  return FALSE;
+}
+
+gboolean on_show_stats_switch_state_set(GtkSwitch* widget, gboolean state, gpointer user_data) {
+  // Stats start over every time they are shown
+  memset(&frame_stats, 0, sizeof(frame_stats));
+
+  frame_scheduler_mark_dirty(frame_scheduler, FRAME_DIRTY_OVERLAY);
+  return FALSE;
+}
+
+int path_number = 1;
+void on_add_path_button_clicked(GtkButton* button, gpointer user_data){
+  gchar* path_name = NULL;
+
+  // Loaded, imported or renamed path may already have the name
+  do {
+    g_free(path_name);
+    path_name = g_strdup_printf("Контур %d", path_number ++);
+  } while (point_store_find_path(point_store, path_name) != -1);
+
+  point_store_add_path(point_store, path_name);
+  g_free(path_name);
+
+  point_model_paths_added(point_model, point_store->n_paths - 1);
+  append_paths_to_combo_box(point_store->n_paths - 1);
+}
+
+void on_add_point_button_clicked(GtkButton* button, gpointer user_data) {
+  const gchar* x_text = gtk_entry_get_text(GTK_ENTRY(x_entry));
+  const gchar* y_text = gtk_entry_get_text(GTK_ENTRY(y_entry));
+
+  // Defaults for x in y
+  if (g_strcmp0(x_text, "") == 0)
+    x_text = "0";
+
+  if (g_strcmp0(y_text, "") == 0)
+    y_text = "0";
+
+  if (!is_number(y_text)) {
+    gtk_entry_set_text(GTK_ENTRY(y_entry), "");
+    return;
+  }
+
+  if (!is_number(x_text)) {
+    gtk_entry_set_text(GTK_ENTRY(x_entry), "");
+    return;
+  }
+
+  // Combo box lists paths in the store's order (see `append_paths_to_combo_box`)
+  gint path_index = gtk_combo_box_get_active(
+    GTK_COMBO_BOX(choose_path_text_combo_box)
+  );
+
+  if (path_index == -1 || (gsize) path_index >= point_store->n_paths)
+    return;
+
+  // Text is parsed only here, store keeps plain numbers from now on
+  gdouble x = strtod(x_text, NULL);
+  gdouble y = strtod(y_text, NULL);
+
+  path_t* path = point_store->paths[path_index];
+  path_append_point(path, x, y);
+
+  point_model_points_added(point_model, path_index, path->n_points - 1);
+  frame_scheduler_mark_dirty(frame_scheduler, FRAME_DIRTY_DATA);
+}
+
+// Shows `store` in `point_model` instead of the current one. Model is
+// detached meanwhile, so view doesn't react to every single row
+void set_point_model_store(point_store_t* store) {
+  if (is_tree_view_initialized) {
+    g_object_ref(point_model);
+    gtk_tree_view_set_model(GTK_TREE_VIEW(tree_view_for_points), NULL);
+  }
+
+  point_model_set_store(point_model, store);
+
+  if (is_tree_view_initialized) {
+    gtk_tree_view_set_model(GTK_TREE_VIEW(tree_view_for_points),
+                            GTK_TREE_MODEL(point_model));
+    g_object_unref(point_model);
+  }
+}
+
+void add_selected_path(GtkTreeModel* model, GtkTreePath* tree_path,
+                       GtkTreeIter* iter, gpointer user_data) {
+  GPtrArray* paths = user_data;
+
+  gint depth = 0;
+  gint* indices = gtk_tree_path_get_indices_with_depth(tree_path, &depth);
+
+  // Rows of points are skipped, and so are live paths: their points
+  // keep coming and dropping off, so they aren't edited as a whole
+  if (depth == 1) {
+    path_t* path = point_store->paths[indices[0]];
+
+    if (path->window_size == 0)
+      g_ptr_array_add(paths, path);
+  }
+}
+
+// Paths whose rows are selected in `tree_view_for_points`,
+// array is freed by the caller
+GPtrArray* get_selected_paths(void) {
+  GPtrArray* paths = g_ptr_array_new();
+
+  if (is_tree_view_initialized)
+    gtk_tree_selection_selected_foreach(
+      gtk_tree_view_get_selection(GTK_TREE_VIEW(tree_view_for_points)),
+      add_selected_path, paths
+    );
+
+  return paths;
+}
+
+// Reads number from `entry`, empty one means `default_value`.
+// Entry with something else in it is cleared and FALSE is returned
+gboolean get_entry_number(GtkWidget* entry, gdouble default_value, gdouble* value) {
+  const gchar* text = gtk_entry_get_text(GTK_ENTRY(entry));
+
+  if (g_strcmp0(text, "") == 0) {
+    *value = default_value;
+    return TRUE;
+  }
+
+  if (!is_number(text)) {
+    gtk_entry_set_text(GTK_ENTRY(entry), "");
+    return FALSE;
+  }
+
+  *value = strtod(text, NULL);
+  return TRUE;
+}
+
+void on_transform_button_clicked(GtkButton* button, gpointer user_data) {
+  gdouble shift_x, shift_y, scale, angle;
+
+  if (!get_entry_number(shift_x_entry , 0.0, &shift_x ) ||
+      !get_entry_number(shift_y_entry , 0.0, &shift_y ) ||
+      !get_entry_number(scale_entry   , 1.0, &scale   ) ||
+      !get_entry_number(rotation_entry, 0.0, &angle   ))
+    return;
+
+  GPtrArray* paths = get_selected_paths();
+
+  // Paths are scaled and rotated around the center of all of them
+  bounds_t bounds = { { INFINITY, INFINITY }, { - INFINITY, - INFINITY } };
+
+  for (guint i = 0; i < paths->len; ++ i) {
+    path_t* path = g_ptr_array_index(paths, i);
+
+    if (path->n_points == 0)
+      continue;
+
+    bounds.min.x = MIN(bounds.min.x, path->bounds.min.x);
+    bounds.min.y = MIN(bounds.min.y, path->bounds.min.y);
+
+    bounds.max.x = MAX(bounds.max.x, path->bounds.max.x);
+    bounds.max.y = MAX(bounds.max.y, path->bounds.max.y);
+  }
+
+  if (bounds.min.x <= bounds.max.x) {
+    point_t center = {
+      (bounds.min.x + bounds.max.x) / 2,
+      (bounds.min.y + bounds.max.y) / 2
+    };
+
+    affine_t scaling     = affine_scaling(scale, scale, center);
+    affine_t rotation    = affine_rotation(angle * G_PI / 180, center);
+    affine_t translation = affine_translation(shift_x, shift_y);
+
+    affine_t affine = affine_compose(&scaling, &rotation);
+    affine = affine_compose(&affine, &translation);
+
+    paths_transform((path_t**) paths->pdata, paths->len, &affine);
+
+    // Rows read points right from the store, they only have to be redrawn
+    gtk_widget_queue_draw(tree_view_for_points);
+    frame_scheduler_mark_dirty(frame_scheduler, FRAME_DIRTY_DATA);
+  }
+
+  g_ptr_array_free(paths, TRUE);
+}
+
+// Paths aren't resampled to more points than that
+#define MAX_RESAMPLED_POINTS 100000000
+
+void on_resample_button_clicked(GtkButton* button, gpointer user_data) {
+  const gchar* text = gtk_entry_get_text(GTK_ENTRY(resample_entry));
+
+  gchar* end;
+  guint64 n_points = g_ascii_strtoull(text, &end, 10);
+
+  if (end == text || *end != '\0' ||
+      n_points < 2 || n_points > MAX_RESAMPLED_POINTS) {
+    gtk_entry_set_text(GTK_ENTRY(resample_entry), "");
+    return;
+  }
+
+  GPtrArray* paths = get_selected_paths();
+
+  if (paths->len != 0) {
+    paths_resample((path_t**) paths->pdata, paths->len, n_points);
+
+    // Paths have different number of rows now, so model is reloaded
+    // at once (which drops the selection as well)
+    set_point_model_store(point_store);
+
+    selected_path_index = -1;
+    frame_scheduler_mark_dirty(frame_scheduler, FRAME_DIRTY_DATA);
+  }
+
+  g_ptr_array_free(paths, TRUE);
+}
+
+void show_error_message(const gchar* title, const GError* error) {
+  GtkWidget* dialog = gtk_message_dialog_new(
+    GTK_WINDOW(main_window), GTK_DIALOG_MODAL,
+    GTK_MESSAGE_ERROR, GTK_BUTTONS_CLOSE, "%s", title
+  );
+
+  gtk_message_dialog_format_secondary_text(GTK_MESSAGE_DIALOG(dialog),
+                                           "%s", error->message);
+
+  gtk_dialog_run(GTK_DIALOG(dialog));
+  gtk_widget_destroy(dialog);
+}
+
+void on_open_project_button_clicked(GtkButton* button, gpointer user_data) {
+  initialize_file_pickers();
+
+  gint response = gtk_dialog_run(GTK_DIALOG(open_project_file_picker));
+  gtk_widget_hide(open_project_file_picker);
+
+  if (response != GTK_RESPONSE_ACCEPT)
+    return;
+
+  gchar* filename =
+    gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(open_project_file_picker));
+
+  GError* error = NULL;
+  point_store_t* loaded_store = project_load(filename, &error);
+
+  g_free(filename);
+
+  if (loaded_store == NULL) {
+    show_error_message("Не удалось открыть проект", error);
+    g_error_free(error);
+    return;
+  }
+
+  set_point_model_store(loaded_store);
+
+  point_store_free(point_store);
+  point_store = loaded_store;
+
+  selected_path_index = -1;
+
+  // Numbers of new paths go on after the loaded ones, names
+  // that are taken anyway are skipped when a path is added
+  path_number = point_store->n_paths + 1;
+
+  update_paths_in_combo_box();
+
+  is_viewport_fitted = TRUE;
+  frame_scheduler_mark_dirty(frame_scheduler, FRAME_DIRTY_DATA);
+}
+
+void on_save_project_button_clicked(GtkButton* button, gpointer user_data) {
+  initialize_file_pickers();
+
+  gint response = gtk_dialog_run(GTK_DIALOG(save_project_file_picker));
+  gtk_widget_hide(save_project_file_picker);
+
+  if (response != GTK_RESPONSE_ACCEPT)
+    return;
+
+  gchar* filename =
+    gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(save_project_file_picker));
+
+  GError* error = NULL;
+  if (!project_save(point_store, filename, &error)) {
+    show_error_message("Не удалось сохранить проект", error);
+    g_error_free(error);
+  }
+
+  g_free(filename);
+}
+
+void set_import_running(gboolean is_running) {
+  gtk_widget_set_visible  (import_progress_box,  is_running);
+
+  gtk_widget_set_sensitive(import_button      , !is_running);
+  gtk_widget_set_sensitive(add_path_button    , !is_running);
+  gtk_widget_set_sensitive(add_point_button   , !is_running);
+  gtk_widget_set_sensitive(open_project_button, !is_running);
+
+  // View is detached from the model while import runs, otherwise it
+  // would have to react to every single row being appended. View that
+  // isn't set up yet gets the model when it is, if import is over by then.
+  // `point_model` holds a reference of it's own, so it outlives the view's
+  if (is_tree_view_initialized)
+    gtk_tree_view_set_model(GTK_TREE_VIEW(tree_view_for_points),
+                            is_running ? NULL : GTK_TREE_MODEL(point_model));
+}
+
+// Finds path named `name` (creates it if there's none)
+gsize get_import_path(const gchar* name) {
+  gssize path_index = point_store_find_path(point_store, name);
+  if (path_index != -1)
+    return path_index;
+
+  point_store_add_path(point_store, name);
+  point_model_paths_added(point_model, point_store->n_paths - 1);
+
+  return point_store->n_paths - 1;
+}
+
+void on_import_batch(const import_batch_t* batch, gpointer user_data) {
+  gsize n_paths = point_store->n_paths;
+
+  for (gsize i = 0; i < batch->n_runs; ++ i) {
+    const import_run_t* run = &batch->runs[i];
+
+    gsize path_index = get_import_path(run->name);
+    path_t* path = point_store->paths[path_index];
+
+    // Live path keeps only it's window, there's no need for more room
+    gsize n_points = path->n_points;
+    if (path->window_size == 0) {
+      if (are_imports_compact)
+        path_set_compact(path, TRUE);
+
+      path_reserve(path, n_points + run->n_points);
+    }
+
+    for (gsize j = run->from; j < run->from + run->n_points; ++ j)
+      path_append_point(path, batch->xs[j], batch->ys[j]);
+
+    point_model_points_added(point_model, path_index, n_points);
+  }
+
+  append_paths_to_combo_box(n_paths);
+
+  gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(import_progress_bar),
+                                batch->progress);
+
+  frame_scheduler_mark_dirty(frame_scheduler, FRAME_DIRTY_DATA);
+}
+
+void on_import_done(gsize n_points, gsize n_skipped_lines,
+                    gboolean is_cancelled, const GError* error,
+                    gpointer user_data) {
+  current_import = NULL;
+
+  set_import_running(FALSE);
+
+  frame_scheduler_mark_dirty(frame_scheduler, FRAME_DIRTY_DATA);
+
+  if (error != NULL)
+    show_error_message("Не удалось импортировать файл", error);
+}
+
+// Path for points without a path name is named after the file,
+// it's always a new one, even if the same file is imported again
+gchar* get_import_path_name(const gchar* filename) {
+  gchar* name = g_path_get_basename(filename);
+
+  gchar* extension = strrchr(name, '.');
+  if (extension != NULL && extension != name)
+    *extension = '\0';
+
+  gchar* unique_name = g_strdup(name);
+  for (int i = 2; point_store_find_path(point_store, unique_name) != -1; ++ i) {
+    g_free(unique_name);
+    unique_name = g_strdup_printf("%s (%d)", name, i);
+  }
+
+  g_free(name);
+  return unique_name;
+}
+
+void on_import_button_clicked(GtkButton* button, gpointer user_data) {
+  initialize_file_pickers();
+
+  gint response = gtk_dialog_run(GTK_DIALOG(import_file_picker));
+  gtk_widget_hide(import_file_picker);
+
+  if (response != GTK_RESPONSE_ACCEPT || current_import != NULL)
+    return;
+
+  gchar* filename =
+    gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(import_file_picker));
+
+  gchar* path_name = get_import_path_name(filename);
+
+  gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(import_progress_bar), 0.0);
+  set_import_running(TRUE);
+
+  current_import = import_start(filename, path_name,
+                                on_import_batch, on_import_done, NULL);
+
+  g_free(path_name);
+  g_free(filename);
+}
+
+void on_cancel_import_button_clicked(GtkButton* button, gpointer user_data) {
+  if (current_import != NULL)
+    import_cancel(current_import);
+}
+
+// Saves exactly what `drawing_area` shows, format is picked by extension
+void on_save_image_button_clicked(GtkButton* button, gpointer user_data) {
+  initialize_file_pickers();
+
+  gint response = gtk_dialog_run(GTK_DIALOG(save_image_file_picker));
+  gtk_widget_hide(save_image_file_picker);
+
+  if (response != GTK_RESPONSE_ACCEPT)
+    return;
+
+  gchar* filename =
+    gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(save_image_file_picker));
+
+  render_settings_t settings;
+  get_render_settings(&settings);
+
+  GError* error = NULL;
+  export_format_t format;
+
+  gboolean is_saved =
+    export_format_from_filename(filename, &format, &error) &&
+    export_image(point_store, &settings, &viewport, DRAWING_AREA_PADDING,
+                 gtk_widget_get_allocated_width (drawing_area),
+                 gtk_widget_get_allocated_height(drawing_area),
+                 format, filename, &error);
+
+  if (!is_saved) {
+    show_error_message("Не удалось сохранить изображение", error);
+    g_error_free(error);
+  }
+
+  g_free(filename);
+}
+
+gboolean on_record_trace_switch_state_set(GtkSwitch* widget, gboolean state, gpointer user_data) {
+  GError* error = NULL;
+
+  if (!state) {
+    if (trace != NULL && !trace_close(trace, &error)) {
+      show_error_message("Не удалось записать трассировку", error);
+      g_error_free(error);
+    }
+
+    trace = NULL;
+    return FALSE;
+  }
+
+  if (trace != NULL)
+    return FALSE;
+
+  initialize_file_pickers();
+
+  gint response = gtk_dialog_run(GTK_DIALOG(save_trace_file_picker));
+  gtk_widget_hide(save_trace_file_picker);
+
+  if (response == GTK_RESPONSE_ACCEPT) {
+    gchar* filename =
+      gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(save_trace_file_picker));
+
+    trace = trace_open(filename, &error);
+    g_free(filename);
+
+    if (trace == NULL) {
+      show_error_message("Не удалось начать запись трассировки", error);
+      g_error_free(error);
+    }
+  }
+
+  if (trace != NULL)
+    return FALSE;
+
+  // Switch is turned back off (that emits this signal once more),
+  // and TRUE keeps it from taking the state it was turned on to
+  gtk_switch_set_active(widget, FALSE);
+  return TRUE;
 }
@@ -0,0 +1,558 @@
+#include "path_edit.h"
+#include "transform.h"
+
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAS_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+// Points (or segments) edited by one job, it's large enough to
+// make threads worth it and small enough to stay in the cache
+#define CHUNK_SIZE 65536
+
+static void bounds_extend(bounds_t* bounds, gdouble x, gdouble y) {
+  bounds->min.x = MIN(bounds->min.x, x);
+  bounds->min.y = MIN(bounds->min.y, y);
+
+  bounds->max.x = MAX(bounds->max.x, x);
+  bounds->max.y = MAX(bounds->max.y, y);
+}
+
+affine_t affine_translation(gdouble dx, gdouble dy) {
+  return (affine_t) {
+    1.0, 0.0, dx,
+    0.0, 1.0, dy
+  };
+}
+
+affine_t affine_scaling(gdouble scale_x, gdouble scale_y, point_t center) {
+  return (affine_t) {
+    scale_x, 0.0, center.x - scale_x * center.x,
+    0.0, scale_y, center.y - scale_y * center.y
+  };
+}
+
+affine_t affine_rotation(gdouble angle, point_t center) {
+  gdouble cosine = cos(angle), sine = sin(angle);
+
+  return (affine_t) {
+    cosine, - sine, center.x - cosine * center.x + sine * center.y,
+    sine, cosine  , center.y - sine * center.x - cosine * center.y
+  };
+}
+
+affine_t affine_compose(const affine_t* first, const affine_t* second) {
+  return (affine_t) {
+    second->xx * first->xx + second->xy * first->yx,
+    second->xx * first->xy + second->xy * first->yy,
+    second->xx * first->dx + second->xy * first->dy + second->dx,
+
+    second->yx * first->xx + second->yy * first->yx,
+    second->yx * first->xy + second->yy * first->yy,
+    second->yx * first->dx + second->yy * first->dy + second->dy
+  };
+}
+
+/*  Kernels map points in place and extend `bounds` by the new points.
+ *  Just like in transform.c, all of them give exactly the same results
+ *  (there's no fused multiply-add), so it doesn't matter which one
+ *  has edited which chunk.
+ *  */
+
+typedef void (*kernel_func_t)(const affine_t* affine, gdouble* xs, gdouble* ys,
+                              gsize n, bounds_t* bounds);
+
+static void transform_scalar(const affine_t* affine, gdouble* xs, gdouble* ys,
+                             gsize n, bounds_t* bounds) {
+  for (gsize i = 0; i < n; ++ i) {
+    gdouble x = xs[i], y = ys[i];
+
+    xs[i] = affine->xx * x + affine->xy * y + affine->dx;
+    ys[i] = affine->yx * x + affine->yy * y + affine->dy;
+
+    bounds_extend(bounds, xs[i], ys[i]);
+  }
+}
+
+#ifdef HAS_X86_KERNELS
+
+__attribute__((target("sse2")))
+static void transform_sse2(const affine_t* affine, gdouble* xs, gdouble* ys,
+                           gsize n, bounds_t* bounds) {
+  __m128d xx = _mm_set1_pd(affine->xx), xy = _mm_set1_pd(affine->xy);
+  __m128d yx = _mm_set1_pd(affine->yx), yy = _mm_set1_pd(affine->yy);
+  __m128d dx = _mm_set1_pd(affine->dx), dy = _mm_set1_pd(affine->dy);
+
+  __m128d min_x = _mm_set1_pd(bounds->min.x), max_x = _mm_set1_pd(bounds->max.x);
+  __m128d min_y = _mm_set1_pd(bounds->min.y), max_y = _mm_set1_pd(bounds->max.y);
+
+  gsize i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d x = _mm_loadu_pd(xs + i);
+    __m128d y = _mm_loadu_pd(ys + i);
+
+    __m128d new_x = _mm_add_pd(_mm_add_pd(_mm_mul_pd(xx, x), _mm_mul_pd(xy, y)), dx);
+    __m128d new_y = _mm_add_pd(_mm_add_pd(_mm_mul_pd(yx, x), _mm_mul_pd(yy, y)), dy);
+
+    _mm_storeu_pd(xs + i, new_x);
+    _mm_storeu_pd(ys + i, new_y);
+
+    min_x = _mm_min_pd(min_x, new_x);
+    max_x = _mm_max_pd(max_x, new_x);
+
+    min_y = _mm_min_pd(min_y, new_y);
+    max_y = _mm_max_pd(max_y, new_y);
+  }
+
+  gdouble lanes[4][2];
+  _mm_storeu_pd(lanes[0], min_x);
+  _mm_storeu_pd(lanes[1], max_x);
+  _mm_storeu_pd(lanes[2], min_y);
+  _mm_storeu_pd(lanes[3], max_y);
+
+  for (gsize lane = 0; lane < 2; ++ lane) {
+    bounds->min.x = MIN(bounds->min.x, lanes[0][lane]);
+    bounds->max.x = MAX(bounds->max.x, lanes[1][lane]);
+
+    bounds->min.y = MIN(bounds->min.y, lanes[2][lane]);
+    bounds->max.y = MAX(bounds->max.y, lanes[3][lane]);
+  }
+
+  transform_scalar(affine, xs + i, ys + i, n - i, bounds);
+}
+
+__attribute__((target("avx2")))
+static void transform_avx2(const affine_t* affine, gdouble* xs, gdouble* ys,
+                           gsize n, bounds_t* bounds) {
+  __m256d xx = _mm256_set1_pd(affine->xx), xy = _mm256_set1_pd(affine->xy);
+  __m256d yx = _mm256_set1_pd(affine->yx), yy = _mm256_set1_pd(affine->yy);
+  __m256d dx = _mm256_set1_pd(affine->dx), dy = _mm256_set1_pd(affine->dy);
+
+  __m256d min_x = _mm256_set1_pd(bounds->min.x), max_x = _mm256_set1_pd(bounds->max.x);
+  __m256d min_y = _mm256_set1_pd(bounds->min.y), max_y = _mm256_set1_pd(bounds->max.y);
+
+  gsize i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d x = _mm256_loadu_pd(xs + i);
+    __m256d y = _mm256_loadu_pd(ys + i);
+
+    __m256d new_x = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(xx, x), _mm256_mul_pd(xy, y)), dx);
+    __m256d new_y = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(yx, x), _mm256_mul_pd(yy, y)), dy);
+
+    _mm256_storeu_pd(xs + i, new_x);
+    _mm256_storeu_pd(ys + i, new_y);
+
+    min_x = _mm256_min_pd(min_x, new_x);
+    max_x = _mm256_max_pd(max_x, new_x);
+
+    min_y = _mm256_min_pd(min_y, new_y);
+    max_y = _mm256_max_pd(max_y, new_y);
+  }
+
+  gdouble lanes[4][4];
+  _mm256_storeu_pd(lanes[0], min_x);
+  _mm256_storeu_pd(lanes[1], max_x);
+  _mm256_storeu_pd(lanes[2], min_y);
+  _mm256_storeu_pd(lanes[3], max_y);
+
+  for (gsize lane = 0; lane < 4; ++ lane) {
+    bounds->min.x = MIN(bounds->min.x, lanes[0][lane]);
+    bounds->max.x = MAX(bounds->max.x, lanes[1][lane]);
+
+    bounds->min.y = MIN(bounds->min.y, lanes[2][lane]);
+    bounds->max.y = MAX(bounds->max.y, lanes[3][lane]);
+  }
+
+  transform_scalar(affine, xs + i, ys + i, n - i, bounds);
+}
+
+#endif
+
+// Indexed by kernels of transform.h, so the same one is picked
+static const kernel_func_t kernels[N_TRANSFORM_KERNELS] = {
+  [TRANSFORM_KERNEL_SCALAR] = transform_scalar,
+#ifdef HAS_X86_KERNELS
+  [TRANSFORM_KERNEL_SSE2  ] = transform_sse2,
+  [TRANSFORM_KERNEL_AVX2  ] = transform_avx2,
+#endif
+};
+
+// New points of a path being resampled
+typedef struct {
+  path_t*  path;
+  gsize    n_points;
+
+  // Length of the path up to the start of every chunk of it's segments,
+  // and the length of the whole path after them
+  gdouble* lengths;
+  gsize    n_chunks;
+
+  gdouble* xs;
+  gdouble* ys;
+} resampling_t;
+
+typedef enum {
+  JOB_TRANSFORM, // <-- Maps points of the chunk in place
+  JOB_MEASURE,   // <-- Measures length of the chunk of segments
+  JOB_RESAMPLE   // <-- Writes the chunk of new points
+} job_kind_t;
+
+// Jobs pushed to the pool at once, they are waited for all together
+typedef struct {
+  GMutex mutex;
+  GCond  cond;
+
+  gsize n_unfinished;
+} batch_t;
+
+typedef struct {
+  job_kind_t kind;
+  batch_t*   batch;
+
+  path_t* path;
+  gsize   from, n; // <-- Points, segments or new points of the chunk
+
+  const affine_t* affine;     // <-- For JOB_TRANSFORM
+  resampling_t*   resampling; // <-- For JOB_MEASURE and JOB_RESAMPLE
+
+  // Filled in by the job
+  bounds_t bounds; // <-- Extents of the points it has written
+  gdouble  length; // <-- Length of the segments it has measured
+} job_t;
+
+static gdouble get_segment_length(const path_t* path, gsize segment) {
+  gdouble dx = path->xs[segment + 1] - path->xs[segment];
+  gdouble dy = path->ys[segment + 1] - path->ys[segment];
+
+  return sqrt(dx * dx + dy * dy);
+}
+
+static void measure_segments(job_t* job) {
+  job->length = 0.0;
+
+  for (gsize i = job->from; i < job->from + job->n; ++ i)
+    job->length += get_segment_length(job->path, i);
+}
+
+// Length of the path up to the start of `segment` is counted from the start
+// of it's chunk, so it doesn't depend on which job has walked up to it
+static gdouble get_next_start(const resampling_t* resampling, gsize segment,
+                              gdouble start, gdouble segment_length) {
+  if ((segment + 1) % CHUNK_SIZE == 0)
+    return resampling->lengths[(segment + 1) / CHUNK_SIZE];
+
+  return start + segment_length;
+}
+
+// Finds chunk of segments where the path reaches `distance`
+static gsize find_chunk(const resampling_t* resampling, gdouble distance) {
+  gsize low = 0, high = resampling->n_chunks - 1;
+
+  while (low < high) {
+    gsize middle = (low + high + 1) / 2;
+
+    if (resampling->lengths[middle] <= distance)
+      low = middle;
+    else
+      high = middle - 1;
+  }
+
+  return low;
+}
+
+static void resample_points(job_t* job) {
+  resampling_t* resampling = job->resampling;
+
+  const gdouble* xs = resampling->path->xs;
+  const gdouble* ys = resampling->path->ys;
+
+  gsize   n_segments = resampling->path->n_points - 1;
+  gdouble step       = resampling->lengths[resampling->n_chunks] / (resampling->n_points - 1);
+
+  // Last point is put exactly where it was, after the others
+  gsize to = MIN(job->from + job->n, resampling->n_points - 1);
+
+  // Walk starts at the chunk of segments where the first new point lies
+  gsize   segment = find_chunk(resampling, step * job->from) * CHUNK_SIZE;
+  gdouble start   = resampling->lengths[segment / CHUNK_SIZE];
+
+  gdouble  segment_length = get_segment_length(resampling->path, segment);
+  bounds_t bounds         = job->bounds;
+
+  for (gsize i = job->from; i < to; ++ i) {
+    gdouble distance = step * i;
+
+    while (start + segment_length < distance && segment + 1 < n_segments) {
+      start = get_next_start(resampling, segment, start, segment_length);
+
+      ++ segment;
+      segment_length = get_segment_length(resampling->path, segment);
+    }
+
+    gdouble fraction = segment_length > 0.0 ? (distance - start) / segment_length : 0.0;
+    fraction = CLAMP(fraction, 0.0, 1.0);
+
+    gdouble x = xs[segment] + fraction * (xs[segment + 1] - xs[segment]);
+    gdouble y = ys[segment] + fraction * (ys[segment + 1] - ys[segment]);
+
+    resampling->xs[i] = x;
+    resampling->ys[i] = y;
+
+    bounds_extend(&bounds, x, y);
+  }
+
+  if (to < job->from + job->n) {
+    resampling->xs[to] = xs[n_segments];
+    resampling->ys[to] = ys[n_segments];
+
+    bounds_extend(&bounds, xs[n_segments], ys[n_segments]);
+  }
+
+  job->bounds = bounds;
+}
+
+static void run_job(gpointer data, gpointer user_data) {
+  job_t* job = data;
+
+  switch (job->kind) {
+  case JOB_TRANSFORM:
+    kernels[transform_get_best_kernel()](job->affine,
+                                         job->path->xs + job->from,
+                                         job->path->ys + job->from,
+                                         job->n, &job->bounds);
+    break;
+
+  case JOB_MEASURE:
+    measure_segments(job);
+    break;
+
+  case JOB_RESAMPLE:
+    resample_points(job);
+    break;
+  }
+
+  batch_t* batch = job->batch;
+  g_mutex_lock(&batch->mutex);
+
+  if (-- batch->n_unfinished == 0)
+    g_cond_signal(&batch->cond);
+
+  g_mutex_unlock(&batch->mutex);
+}
+
+static GThreadPool* get_job_pool(void) {
+  static GThreadPool* pool = NULL;
+
+  if (g_once_init_enter(&pool)) {
+    GThreadPool* new_pool = g_thread_pool_new(run_job, NULL,
+                                              g_get_num_processors(), FALSE, NULL);
+    g_once_init_leave(&pool, new_pool);
+  }
+
+  return pool;
+}
+
+// Runs all the jobs on the pool and waits for them, single job is run right
+// here. Bounds of the jobs start empty, so the first point sets them
+static void run_jobs(job_t* jobs, gsize n_jobs) {
+  batch_t batch = { .n_unfinished = n_jobs };
+
+  g_mutex_init(&batch.mutex);
+  g_cond_init(&batch.cond);
+
+  for (gsize i = 0; i < n_jobs; ++ i) {
+    jobs[i].batch  = &batch;
+    jobs[i].bounds = (bounds_t) { { INFINITY, INFINITY }, { - INFINITY, - INFINITY } };
+  }
+
+  if (n_jobs == 1)
+    run_job(&jobs[0], NULL);
+  else
+    for (gsize i = 0; i < n_jobs; ++ i)
+      g_thread_pool_push(get_job_pool(), &jobs[i], NULL);
+
+  g_mutex_lock(&batch.mutex);
+
+  while (batch.n_unfinished != 0)
+    g_cond_wait(&batch.cond, &batch.mutex);
+
+  g_mutex_unlock(&batch.mutex);
+
+  g_mutex_clear(&batch.mutex);
+  g_cond_clear(&batch.cond);
+}
+
+static gsize get_n_chunks(gsize n) {
+  return (n + CHUNK_SIZE - 1) / CHUNK_SIZE;
+}
+
+// Splits `n` points (or segments) of `path` into jobs of `kind` starting
+// from `jobs[n_jobs]`, returns number of jobs after them
+static gsize add_jobs(job_t* jobs, gsize n_jobs, job_kind_t kind,
+                      path_t* path, gsize n) {
+  for (gsize from = 0; from < n; from += CHUNK_SIZE)
+    jobs[n_jobs ++] = (job_t) {
+      .kind = kind,
+      .path = path,
+      .from = from,
+      .n    = MIN(CHUNK_SIZE, n - from)
+    };
+
+  return n_jobs;
+}
+
+// Extents of all the points written by `n_jobs` jobs
+static bounds_t merge_bounds(const job_t* jobs, gsize n_jobs) {
+  bounds_t bounds = jobs[0].bounds;
+
+  for (gsize i = 1; i < n_jobs; ++ i) {
+    bounds_extend(&bounds, jobs[i].bounds.min.x, jobs[i].bounds.min.y);
+    bounds_extend(&bounds, jobs[i].bounds.max.x, jobs[i].bounds.max.y);
+  }
+
+  return bounds;
+}
+
+void paths_transform(path_t** paths, gsize n_paths, const affine_t* affine) {
+  gsize     n_jobs       = 0;
+  gboolean* were_compact = g_new(gboolean, n_paths);
+
+  for (gsize i = 0; i < n_paths; ++ i) {
+    were_compact[i] = paths[i]->compact != NULL;
+
+    path_begin_edit(paths[i]);
+    n_jobs += get_n_chunks(paths[i]->n_points);
+  }
+
+  job_t* jobs = g_new(job_t, n_jobs);
+  n_jobs = 0;
+
+  for (gsize i = 0; i < n_paths; ++ i)
+    n_jobs = add_jobs(jobs, n_jobs, JOB_TRANSFORM, paths[i], paths[i]->n_points);
+
+  for (gsize i = 0; i < n_jobs; ++ i)
+    jobs[i].affine = affine;
+
+  run_jobs(jobs, n_jobs);
+
+  // Jobs of every path go one after another
+  job_t* path_jobs = jobs;
+
+  for (gsize i = 0; i < n_paths; ++ i) {
+    path_t* path = paths[i];
+
+    gsize n_path_jobs = get_n_chunks(path->n_points);
+
+    if (n_path_jobs != 0) {
+      bounds_t bounds = merge_bounds(path_jobs, n_path_jobs);
+      path_end_edit(path, &bounds);
+    }
+
+    if (were_compact[i])
+      path_set_compact(path, TRUE);
+
+    path_jobs += n_path_jobs;
+  }
+
+  g_free(jobs);
+  g_free(were_compact);
+}
+
+void paths_resample(path_t** paths, gsize n_paths, gsize n_points) {
+  g_return_if_fail(n_points >= 2);
+
+  resampling_t* resamplings = g_new(resampling_t, n_paths);
+  gsize n_resamplings = 0;
+
+  gboolean* were_compact = g_new(gboolean, n_paths);
+
+  gsize n_measure_jobs = 0;
+
+  for (gsize i = 0; i < n_paths; ++ i) {
+    path_t* path = paths[i];
+
+    if (path->window_size != 0 || path->n_points < 2)
+      continue;
+
+    // Segments are read from plain arrays
+    were_compact[n_resamplings] = path->compact != NULL;
+    path_set_compact(path, FALSE);
+
+    gsize n_chunks = get_n_chunks(path->n_points - 1);
+
+    resamplings[n_resamplings ++] = (resampling_t) {
+      .path     = path,
+      .n_points = n_points,
+      .lengths  = g_new(gdouble, n_chunks + 1),
+      .n_chunks = n_chunks,
+      .xs       = g_new(gdouble, n_points),
+      .ys       = g_new(gdouble, n_points)
+    };
+
+    n_measure_jobs += n_chunks;
+  }
+
+  if (n_resamplings == 0) {
+    g_free(resamplings);
+    g_free(were_compact);
+    return;
+  }
+
+  // First all the paths are measured...
+  job_t* jobs = g_new(job_t, MAX(n_measure_jobs, n_resamplings * get_n_chunks(n_points)));
+  gsize n_jobs = 0;
+
+  for (gsize i = 0; i < n_resamplings; ++ i) {
+    gsize first_job = n_jobs;
+    n_jobs = add_jobs(jobs, n_jobs, JOB_MEASURE, resamplings[i].path,
+                      resamplings[i].path->n_points - 1);
+
+    for (gsize j = first_job; j < n_jobs; ++ j)
+      jobs[j].resampling = &resamplings[i];
+  }
+
+  run_jobs(jobs, n_jobs);
+
+  for (gsize i = 0, job = 0; i < n_resamplings; ++ i) {
+    resampling_t* resampling = &resamplings[i];
+
+    resampling->lengths[0] = 0.0;
+
+    for (gsize j = 0; j < resampling->n_chunks; ++ j, ++ job)
+      resampling->lengths[j + 1] = resampling->lengths[j] + jobs[job].length;
+  }
+
+  // ...then new points are spread along them
+  n_jobs = 0;
+
+  for (gsize i = 0; i < n_resamplings; ++ i) {
+    gsize first_job = n_jobs;
+    n_jobs = add_jobs(jobs, n_jobs, JOB_RESAMPLE, resamplings[i].path, n_points);
+
+    for (gsize j = first_job; j < n_jobs; ++ j)
+      jobs[j].resampling = &resamplings[i];
+  }
+
+  run_jobs(jobs, n_jobs);
+
+  gsize n_path_jobs = get_n_chunks(n_points);
+
+  for (gsize i = 0; i < n_resamplings; ++ i) {
+    resampling_t* resampling = &resamplings[i];
+    path_t*       path       = resampling->path;
+
+    bounds_t bounds = merge_bounds(jobs + i * n_path_jobs, n_path_jobs);
+    path_take_points(path, resampling->xs, resampling->ys, n_points, &bounds);
+
+    if (were_compact[i])
+      path_set_compact(path, TRUE);
+
+    g_free(resampling->lengths);
+  }
+
+  g_free(jobs);
+  g_free(resamplings);
+  g_free(were_compact);
+}
@@ -0,0 +1,47 @@
+#ifndef PATH_EDIT_H
+#define PATH_EDIT_H
+
+#include "point_store.h"
+
+/*  Edits of whole paths at once
+ *
+ *  Paths are moved, scaled, rotated or resampled in one pass over their
+ *  points instead of point by point. Points of all the edited paths are
+ *  split into chunks that are edited on all the cores at once, so one
+ *  big path goes as fast as many small ones. Affine maps are applied by
+ *  SIMD kernels (picked the same way as in transform.h). Bounds, version
+ *  and caches of every path are updated once, after all of it's points.
+ *
+ *  Compact paths are decoded before the edit and encoded again after
+ *  it, so they take a lot longer than plain ones.
+ *  */
+
+// Affine map of data space into itself:
+//
+//     x' = xx * x + xy * y + dx
+//     y' = yx * x + yy * y + dy
+typedef struct {
+  gdouble xx, xy, dx;
+  gdouble yx, yy, dy;
+} affine_t;
+
+affine_t affine_translation(gdouble dx, gdouble dy);
+
+// Scales `scale_x` and `scale_y` times, `center` stays in place
+affine_t affine_scaling(gdouble scale_x, gdouble scale_y, point_t center);
+
+// Rotates `angle` radians counterclockwise around `center`
+affine_t affine_rotation(gdouble angle, point_t center);
+
+// Map that does what `first` does and then what `second` does
+affine_t affine_compose(const affine_t* first, const affine_t* second);
+
+// Maps all the points of `n_paths` paths with `affine`
+void paths_transform(path_t** paths, gsize n_paths, const affine_t* affine);
+
+// Replaces points of every path with `n_points` (at least 2) points spread
+// evenly along it, the first and the last points stay where they were.
+// Live paths (with a window) and paths of less than 2 points are skipped
+void paths_resample(path_t** paths, gsize n_paths, gsize n_points);
+
+#endif
@@ -0,0 +1,306 @@
+#include "point_index.h"
+#include "compact.h"
+
+#include <math.h>
+#include <string.h>
+
+// How many points are there in one cell on average
+#define POINTS_PER_CELL 4
+
+// Upper limit for the number of cells in each direction
+#define MAX_CELLS_PER_SIDE 4096
+
+// Index is rebuilt once this many points are moved or not listed,
+// or one in `STALE_POINTS_RATIO` points of the path if it's more
+#define MIN_STALE_POINTS   4096
+#define STALE_POINTS_RATIO 256
+
+static gsize cell_column(const point_index_t* index, gdouble x) {
+  if (index->cell_width <= 0.0)
+    return 0;
+
+  gdouble column = floor((x - index->bounds.min.x) / index->cell_width);
+  return CLAMP(column, 0.0, (gdouble) index->columns - 1);
+}
+
+static gsize cell_row(const point_index_t* index, gdouble y) {
+  if (index->cell_height <= 0.0)
+    return 0;
+
+  gdouble row = floor((y - index->bounds.min.y) / index->cell_height);
+  return CLAMP(row, 0.0, (gdouble) index->rows - 1);
+}
+
+static gsize cell_of(const point_index_t* index, gdouble x, gdouble y) {
+  return cell_row(index, y) * index->columns + cell_column(index, x);
+}
+
+static void point_index_build(point_index_t* index, path_t* path) {
+  gsize n_points = path->n_points;
+
+  gsize side = ceil(sqrt((gdouble) n_points / POINTS_PER_CELL));
+  side = CLAMP(side, 1, MAX_CELLS_PER_SIDE);
+
+  index->bounds = path->bounds;
+
+  gdouble width  = index->bounds.max.x - index->bounds.min.x;
+  gdouble height = index->bounds.max.y - index->bounds.min.y;
+
+  // Points that lie on one line only need cells along it
+  index->columns = width  > 0.0 ? side : 1;
+  index->rows    = height > 0.0 ? side : 1;
+
+  index->cell_width  = width  / index->columns;
+  index->cell_height = height / index->rows;
+
+  gsize n_cells = index->columns * index->rows;
+
+  // Same counting as in segment_index.c: points of every cell are counted
+  // one place further than it's start, which is then moved forward while
+  // the cell is being filled, so in the end it points to the next cell
+  index->cell_starts = g_renew(guint32, index->cell_starts, n_cells + 2);
+  index->points      = g_renew(guint32, index->points, n_points);
+
+  memset(index->cell_starts, 0, (n_cells + 2) * sizeof(guint32));
+
+  // Compact paths are decoded a block at a time
+  gdouble xs[COMPACT_BLOCK_SIZE], ys[COMPACT_BLOCK_SIZE];
+
+  // First count points in every cell...
+  for (gsize from = 0; from < n_points; from += COMPACT_BLOCK_SIZE) {
+    gsize n_read = MIN(n_points - from, COMPACT_BLOCK_SIZE);
+    path_get_points(path, from, n_read, xs, ys);
+
+    for (gsize i = 0; i < n_read; ++ i)
+      ++ index->cell_starts[cell_of(index, xs[i], ys[i]) + 2];
+  }
+
+  for (gsize i = 0; i <= n_cells; ++ i)
+    index->cell_starts[i + 1] += index->cell_starts[i];
+
+  // ...then put them in place
+  for (gsize from = 0; from < n_points; from += COMPACT_BLOCK_SIZE) {
+    gsize n_read = MIN(n_points - from, COMPACT_BLOCK_SIZE);
+    path_get_points(path, from, n_read, xs, ys);
+
+    for (gsize i = 0; i < n_read; ++ i) {
+      gsize cell = cell_of(index, xs[i], ys[i]);
+      index->points[index->cell_starts[cell + 1] ++] = from + i;
+    }
+  }
+
+  index->n_points = n_points;
+  index->n_moved  = 0;
+}
+
+const point_index_t* point_index_get(path_t* path) {
+  if (path->n_points == 0 || path->n_points > G_MAXUINT32)
+    return NULL;
+
+  point_index_t* index = path->point_index;
+
+  if (index == NULL)
+    index = path->point_index = g_new0(point_index_t, 1);
+  else {
+    gsize n_stale = path->n_points - index->n_points + index->n_moved;
+
+    if (n_stale <= MAX(MIN_STALE_POINTS, path->n_points / STALE_POINTS_RATIO))
+      return index;
+  }
+
+  point_index_build(index, path);
+  return index;
+}
+
+void point_index_update_point(point_index_t* index, gsize point) {
+  // Points that aren't listed are checked anyway
+  if (point >= index->n_points)
+    return;
+
+  // Dragged point is moved many times in a row
+  if (index->n_moved != 0 && index->moved[index->n_moved - 1] == point)
+    return;
+
+  if (index->n_moved == index->moved_capacity) {
+    index->moved_capacity = index->moved_capacity == 0 ? 64 : 2 * index->moved_capacity;
+    index->moved = g_renew(guint32, index->moved, index->moved_capacity);
+  }
+
+  index->moved[index->n_moved ++] = point;
+}
+
+void point_index_truncate(point_index_t* index, gsize n_points) {
+  index->n_points = MIN(index->n_points, n_points);
+
+  gsize n_kept = 0;
+  for (gsize i = 0; i < index->n_moved; ++ i)
+    if (index->moved[i] < index->n_points)
+      index->moved[n_kept ++] = index->moved[i];
+
+  index->n_moved = n_kept;
+}
+
+// Nearest point found so far, distances are squared and in pixels
+typedef struct {
+  const path_t*      path;
+  const transform_t* transform;
+
+  gdouble x, y;
+
+  gboolean is_found;
+  gsize    nearest;
+  gdouble  distance; // <-- Starts as squared radius, nothing further counts
+} search_t;
+
+static void check_point(search_t* search, gsize point, gdouble x, gdouble y) {
+  gdouble delta_x = transform_x(search->transform, x) - search->x;
+  gdouble delta_y = transform_y(search->transform, y) - search->y;
+
+  gdouble distance = delta_x * delta_x + delta_y * delta_y;
+
+  if (distance < search->distance || (!search->is_found && distance <= search->distance)) {
+    search->is_found = TRUE;
+    search->nearest  = point;
+    search->distance = distance;
+  }
+}
+
+static void check_cell(search_t* search, const point_index_t* index, gsize cell) {
+  for (guint32 i = index->cell_starts[cell]; i < index->cell_starts[cell + 1]; ++ i) {
+    guint32 point = index->points[i];
+
+    // It was removed or shifted and is checked with unlisted ones
+    if (point >= index->n_points)
+      continue;
+
+    point_t position = path_get_point(search->path, point);
+    check_point(search, point, position.x, position.y);
+  }
+}
+
+// Cells from `first` to `last` (inclusive) are searched
+typedef struct {
+  gssize first_column, last_column;
+  gssize first_row   , last_row;
+} cell_range_t;
+
+static void check_row(search_t* search, const point_index_t* index,
+                      const cell_range_t* range, gssize row,
+                      gssize from_column, gssize to_column) {
+  if (row < range->first_row || row > range->last_row)
+    return;
+
+  from_column = MAX(from_column, range->first_column);
+  to_column   = MIN(to_column  , range->last_column);
+
+  for (gssize column = from_column; column <= to_column; ++ column)
+    check_cell(search, index, row * index->columns + column);
+}
+
+static void search_cells(search_t* search, const point_index_t* index, gdouble radius) {
+  const transform_t* transform = search->transform;
+
+  // Part of data space within `radius` of the cursor
+  gdouble x = transform_inverse_x(transform, search->x);
+  gdouble y = transform_inverse_y(transform, search->y);
+
+  gdouble radius_x = radius / fabs(transform->scale_x);
+  gdouble radius_y = radius / fabs(transform->scale_y);
+
+  bounds_t area = { { x - radius_x, y - radius_y }, { x + radius_x, y + radius_y } };
+  if (!bounds_intersect(&index->bounds, &area))
+    return;
+
+  cell_range_t range = {
+    cell_column(index, area.min.x), cell_column(index, area.max.x),
+    cell_row   (index, area.min.y), cell_row   (index, area.max.y)
+  };
+
+  gssize center_column = cell_column(index, x);
+  gssize center_row    = cell_row   (index, y);
+
+  gssize n_rings = MAX(MAX(center_column - range.first_column, range.last_column - center_column),
+                       MAX(center_row    - range.first_row   , range.last_row    - center_row   ));
+
+  // Cursor is in the center cell (or outside of the grid beyond it),
+  // so points of n-th ring around it are at least n - 1 cells away
+  gdouble cell_size = INFINITY;
+
+  if (index->columns > 1)
+    cell_size = MIN(cell_size, index->cell_width  * fabs(transform->scale_x));
+
+  if (index->rows > 1)
+    cell_size = MIN(cell_size, index->cell_height * fabs(transform->scale_y));
+
+  for (gssize ring = 0; ring <= n_rings; ++ ring) {
+    gdouble gap = (ring - 1) * cell_size;
+    if (ring > 1 && gap * gap > search->distance)
+      break;
+
+    gssize from_column = center_column - ring, to_column = center_column + ring;
+
+    // Top and bottom sides of the ring are whole rows...
+    check_row(search, index, &range, center_row - ring, from_column, to_column);
+
+    if (ring == 0)
+      continue;
+
+    check_row(search, index, &range, center_row + ring, from_column, to_column);
+
+    // ...left and right ones are a cell per row between them
+    for (gssize row = center_row - ring + 1; row < center_row + ring; ++ row) {
+      check_row(search, index, &range, row, from_column, from_column);
+      check_row(search, index, &range, row, to_column  , to_column  );
+    }
+  }
+}
+
+gboolean point_index_find_nearest(const point_index_t* index, const path_t* path,
+                                  const transform_t* transform,
+                                  gdouble x, gdouble y, gdouble radius,
+                                  gsize* nearest, gdouble* distance) {
+  search_t search = {
+    .path      = path,
+    .transform = transform,
+
+    .x = x,
+    .y = y,
+
+    .distance = radius * radius
+  };
+
+  if (index->n_points != 0)
+    search_cells(&search, index, radius);
+
+  // Points that aren't where the cells say they are
+  for (gsize i = 0; i < index->n_moved; ++ i) {
+    point_t position = path_get_point(path, index->moved[i]);
+    check_point(&search, index->moved[i], position.x, position.y);
+  }
+
+  gdouble xs[COMPACT_BLOCK_SIZE], ys[COMPACT_BLOCK_SIZE];
+
+  for (gsize from = index->n_points; from < path->n_points; from += COMPACT_BLOCK_SIZE) {
+    gsize n_read = MIN(path->n_points - from, COMPACT_BLOCK_SIZE);
+    path_get_points(path, from, n_read, xs, ys);
+
+    for (gsize i = 0; i < n_read; ++ i)
+      check_point(&search, from + i, xs[i], ys[i]);
+  }
+
+  if (!search.is_found)
+    return FALSE;
+
+  *nearest  = search.nearest;
+  *distance = search.distance;
+
+  return TRUE;
+}
+
+void point_index_free(point_index_t* index) {
+  g_free(index->cell_starts);
+  g_free(index->points);
+  g_free(index->moved);
+
+  g_free(index);
+}
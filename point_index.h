@@ -0,0 +1,73 @@
+#ifndef POINT_INDEX_H
+#define POINT_INDEX_H
+
+#include "point_store.h"
+#include "transform.h"
+
+/*  Uniform grid over points of one path, for picking them with the mouse
+ *
+ *  Bounding box of the path is split into cells and every point is
+ *  listed in the cell it lies in. Nearest point to the cursor is then
+ *  searched for ring by ring of cells around it, and search stops as
+ *  soon as no point in the next ring can be closer than the best one
+ *  found, so it only looks at a few cells however big the path is.
+ *
+ *  Unlike other caches, the index isn't rebuilt on every change of the
+ *  path, since the point that is dragged changes it on every motion:
+ *
+ *    - Moved points stay in the cells they were in and are listed in
+ *      `moved`, points appended after the index was built aren't in it
+ *      at all. Both are checked one by one on every search.
+ *
+ *    - Once there are too many of them, index is built anew.
+ *
+ *  Points are read from the path itself (index only has their numbers),
+ *  so a point listed in the wrong cell is still at the right distance.
+ *  */
+
+typedef struct point_index {
+  // Number of first points of the path that are listed in cells,
+  // listed numbers that aren't less than it are stale
+  gsize    n_points;
+
+  bounds_t bounds;
+
+  gsize    columns, rows;
+  gdouble  cell_width, cell_height;
+
+  // Points of the cell (column, row) are listed in `points` from
+  // `cell_starts[row * columns + column]` up to the next cell's start
+  guint32* cell_starts;
+  guint32* points;
+
+  // Points (among the first `n_points`) that were moved since the index
+  // was built, a point moved several times in a row is listed once
+  guint32* moved;
+  gsize    n_moved;
+  gsize    moved_capacity;
+} point_index_t;
+
+// Returns index of points of `path`, it's built on the first use and kept
+// in the path, edits of the path only update it. Returns NULL if path is
+// empty or has too many points to be indexed
+const point_index_t* point_index_get(path_t* path);
+
+// Called by the store when `index`-th point is moved
+void point_index_update_point(point_index_t* index, gsize point);
+
+// Called by the store when points starting from `n_points`-th one are
+// removed or shifted, they are checked one by one until index is rebuilt
+void point_index_truncate(point_index_t* index, gsize n_points);
+
+// Finds point of `path` nearest to (`x`, `y`) in the widget, distance is
+// measured in the widget too, after `transform`. Returns FALSE if there's
+// no point closer than `radius` pixels, otherwise point's number is
+// written to `*nearest` and squared distance to it to `*distance`
+gboolean point_index_find_nearest(const point_index_t* index, const path_t* path,
+                                  const transform_t* transform,
+                                  gdouble x, gdouble y, gdouble radius,
+                                  gsize* nearest, gdouble* distance);
+
+void point_index_free(point_index_t* index);
+
+#endif
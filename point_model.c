@@ -0,0 +1,372 @@
+#include "point_model.h"
+
+// Enough to hold any coordinate formatted by `format_coordinate`
+#define COORDINATE_TEXT_SIZE 32
+
+struct _PointModel {
+  GObject parent;
+
+  point_store_t* store;
+
+  // Iterators made before the store was replaced have different stamp
+  gint stamp;
+
+  // Reused for every signal emitted, so reporting changes allocates nothing
+  GtkTreePath* scratch_path;
+};
+
+static void point_model_tree_model_init(GtkTreeModelIface* iface);
+
+G_DEFINE_TYPE_WITH_CODE(PointModel, point_model, G_TYPE_OBJECT,
+                        G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_MODEL,
+                                              point_model_tree_model_init))
+
+// Signals that are emitted once per point, they're skipped altogether
+// when nobody listens to them (e.g. while import detaches the view)
+static guint row_inserted_signal;
+static guint row_deleted_signal;
+
+/*  Rows are addressed by indices, so iterator is just a pair of them:
+ *
+ *      user_data     <-- index of the path
+ *      user_data2    <-- index of the point + 1, 0 for path's own row
+ *  */
+
+static void set_iter(PointModel* model, GtkTreeIter* iter,
+                     gsize path_index, gsize point_number) {
+  iter->stamp      = model->stamp;
+  iter->user_data  = GSIZE_TO_POINTER(path_index);
+  iter->user_data2 = GSIZE_TO_POINTER(point_number);
+  iter->user_data3 = NULL;
+}
+
+static gsize get_path_index(GtkTreeIter* iter) {
+  return GPOINTER_TO_SIZE(iter->user_data);
+}
+
+static gsize get_point_number(GtkTreeIter* iter) {
+  return GPOINTER_TO_SIZE(iter->user_data2);
+}
+
+// Live paths have no rows for their points, see point_model.h
+static gsize get_n_point_rows(const path_t* path) {
+  return path->window_size != 0 ? 0 : path->n_points;
+}
+
+// Formats coordinate the way it's shown in views
+static void format_coordinate(gchar* buffer, gsize size, gdouble value) {
+  g_snprintf(buffer, size, "%.10g", value);
+}
+
+static GtkTreeModelFlags get_flags(GtkTreeModel* tree_model) {
+  return 0;
+}
+
+static gint get_n_columns(GtkTreeModel* tree_model) {
+  return N_COLUMNS;
+}
+
+static GType get_column_type(GtkTreeModel* tree_model, gint index) {
+  return G_TYPE_STRING;
+}
+
+static gboolean get_iter(GtkTreeModel* tree_model, GtkTreeIter* iter,
+                         GtkTreePath* tree_path) {
+  PointModel* model = POINT_MODEL(tree_model);
+
+  gint depth = 0;
+  gint* indices = gtk_tree_path_get_indices_with_depth(tree_path, &depth);
+
+  if (depth < 1 || depth > 2 ||
+      indices[0] < 0 || (gsize) indices[0] >= model->store->n_paths)
+    return FALSE;
+
+  if (depth == 1) {
+    set_iter(model, iter, indices[0], 0);
+    return TRUE;
+  }
+
+  path_t* path = model->store->paths[indices[0]];
+  if (indices[1] < 0 || (gsize) indices[1] >= get_n_point_rows(path))
+    return FALSE;
+
+  set_iter(model, iter, indices[0], indices[1] + 1);
+  return TRUE;
+}
+
+static GtkTreePath* get_path(GtkTreeModel* tree_model, GtkTreeIter* iter) {
+  GtkTreePath* tree_path = gtk_tree_path_new();
+  gtk_tree_path_append_index(tree_path, get_path_index(iter));
+
+  if (get_point_number(iter) != 0)
+    gtk_tree_path_append_index(tree_path, get_point_number(iter) - 1);
+
+  return tree_path;
+}
+
+static void get_value(GtkTreeModel* tree_model, GtkTreeIter* iter,
+                      gint column, GValue* value) {
+  PointModel* model = POINT_MODEL(tree_model);
+  path_t* path = model->store->paths[get_path_index(iter)];
+
+  g_value_init(value, G_TYPE_STRING);
+
+  gsize point_number = get_point_number(iter);
+  if (point_number == 0) {
+    // Y column is empty for rows with paths
+    g_value_set_string(value, column == X_COORDINATE_COLUMN ? path->name : "");
+    return;
+  }
+
+  point_t point = path_get_point(path, point_number - 1);
+  gdouble coordinate = column == X_COORDINATE_COLUMN ? point.x : point.y;
+
+  gchar text[COORDINATE_TEXT_SIZE];
+  format_coordinate(text, sizeof(text), coordinate);
+
+  g_value_set_string(value, text);
+}
+
+// Number of rows that `iter` and it's siblings are in
+static gsize get_n_siblings(PointModel* model, GtkTreeIter* iter) {
+  if (get_point_number(iter) == 0)
+    return model->store->n_paths;
+
+  return get_n_point_rows(model->store->paths[get_path_index(iter)]);
+}
+
+static gboolean iter_next(GtkTreeModel* tree_model, GtkTreeIter* iter) {
+  PointModel* model = POINT_MODEL(tree_model);
+
+  gsize path_index   = get_path_index(iter);
+  gsize point_number = get_point_number(iter);
+
+  // Row index is the last non-zero one of the two
+  gsize next = (point_number == 0 ? path_index : point_number - 1) + 1;
+
+  if (next >= get_n_siblings(model, iter)) {
+    iter->stamp = 0;
+    return FALSE;
+  }
+
+  if (point_number == 0)
+    set_iter(model, iter, next, 0);
+  else
+    set_iter(model, iter, path_index, next + 1);
+
+  return TRUE;
+}
+
+static gboolean iter_previous(GtkTreeModel* tree_model, GtkTreeIter* iter) {
+  PointModel* model = POINT_MODEL(tree_model);
+
+  gsize path_index   = get_path_index(iter);
+  gsize point_number = get_point_number(iter);
+
+  if ((point_number == 0 && path_index == 0) || point_number == 1) {
+    iter->stamp = 0;
+    return FALSE;
+  }
+
+  if (point_number == 0)
+    set_iter(model, iter, path_index - 1, 0);
+  else
+    set_iter(model, iter, path_index, point_number - 1);
+
+  return TRUE;
+}
+
+static gint iter_n_children(GtkTreeModel* tree_model, GtkTreeIter* iter) {
+  PointModel* model = POINT_MODEL(tree_model);
+
+  if (iter == NULL)
+    return model->store->n_paths;
+
+  if (get_point_number(iter) != 0)
+    return 0;
+
+  return get_n_point_rows(model->store->paths[get_path_index(iter)]);
+}
+
+static gboolean iter_nth_child(GtkTreeModel* tree_model, GtkTreeIter* iter,
+                               GtkTreeIter* parent, gint n) {
+  PointModel* model = POINT_MODEL(tree_model);
+
+  if (n < 0 || n >= iter_n_children(tree_model, parent)) {
+    iter->stamp = 0;
+    return FALSE;
+  }
+
+  if (parent == NULL)
+    set_iter(model, iter, n, 0);
+  else
+    set_iter(model, iter, get_path_index(parent), n + 1);
+
+  return TRUE;
+}
+
+static gboolean iter_children(GtkTreeModel* tree_model, GtkTreeIter* iter,
+                              GtkTreeIter* parent) {
+  return iter_nth_child(tree_model, iter, parent, 0);
+}
+
+static gboolean iter_has_child(GtkTreeModel* tree_model, GtkTreeIter* iter) {
+  return iter_n_children(tree_model, iter) != 0;
+}
+
+static gboolean iter_parent(GtkTreeModel* tree_model, GtkTreeIter* iter,
+                            GtkTreeIter* child) {
+  PointModel* model = POINT_MODEL(tree_model);
+
+  if (get_point_number(child) == 0) {
+    iter->stamp = 0;
+    return FALSE;
+  }
+
+  set_iter(model, iter, get_path_index(child), 0);
+  return TRUE;
+}
+
+static void point_model_tree_model_init(GtkTreeModelIface* iface) {
+  iface->get_flags       = get_flags;
+  iface->get_n_columns   = get_n_columns;
+  iface->get_column_type = get_column_type;
+  iface->get_iter        = get_iter;
+  iface->get_path        = get_path;
+  iface->get_value       = get_value;
+  iface->iter_next       = iter_next;
+  iface->iter_previous   = iter_previous;
+  iface->iter_children   = iter_children;
+  iface->iter_has_child  = iter_has_child;
+  iface->iter_n_children = iter_n_children;
+  iface->iter_nth_child  = iter_nth_child;
+  iface->iter_parent     = iter_parent;
+}
+
+static void point_model_finalize(GObject* object) {
+  gtk_tree_path_free(POINT_MODEL(object)->scratch_path);
+
+  G_OBJECT_CLASS(point_model_parent_class)->finalize(object);
+}
+
+static void point_model_class_init(PointModelClass* class) {
+  G_OBJECT_CLASS(class)->finalize = point_model_finalize;
+
+  row_inserted_signal = g_signal_lookup("row-inserted", GTK_TYPE_TREE_MODEL);
+  row_deleted_signal  = g_signal_lookup("row-deleted" , GTK_TYPE_TREE_MODEL);
+}
+
+static void point_model_init(PointModel* model) {
+  model->stamp        = g_random_int();
+  model->scratch_path = gtk_tree_path_new();
+}
+
+PointModel* point_model_new(point_store_t* store) {
+  PointModel* model = g_object_new(POINT_TYPE_MODEL, NULL);
+  model->store = store;
+
+  return model;
+}
+
+void point_model_set_store(PointModel* model, point_store_t* store) {
+  model->store = store;
+  ++ model->stamp;
+}
+
+// Makes `scratch_path` point to the row, signal handlers it's passed to
+// only borrow it, so it can be changed as soon as the signal returns
+static GtkTreePath* get_scratch_path(PointModel* model,
+                                     gsize path_index, gsize point_number) {
+  GtkTreePath* tree_path = model->scratch_path;
+
+  while (gtk_tree_path_up(tree_path))
+    ;
+
+  gtk_tree_path_append_index(tree_path, path_index);
+
+  if (point_number != 0)
+    gtk_tree_path_append_index(tree_path, point_number - 1);
+
+  return tree_path;
+}
+
+static gboolean has_listeners(PointModel* model, guint signal) {
+  return g_signal_has_handler_pending(model, signal, 0, FALSE);
+}
+
+// Path's row gets or loses the expander when it's first point
+// is added or it's last one is removed
+static void toggle_has_child(PointModel* model, gsize path_index) {
+  GtkTreeIter iter;
+  set_iter(model, &iter, path_index, 0);
+
+  gtk_tree_model_row_has_child_toggled(GTK_TREE_MODEL(model),
+                                       get_scratch_path(model, path_index, 0), &iter);
+}
+
+void point_model_paths_added(PointModel* model, gsize from) {
+  for (gsize i = from; i < model->store->n_paths; ++ i) {
+    GtkTreeIter iter;
+    set_iter(model, &iter, i, 0);
+
+    gtk_tree_model_row_inserted(GTK_TREE_MODEL(model),
+                                get_scratch_path(model, i, 0), &iter);
+
+    if (get_n_point_rows(model->store->paths[i]) != 0)
+      toggle_has_child(model, i);
+  }
+}
+
+void point_model_path_removed(PointModel* model, gsize path_index) {
+  gtk_tree_model_row_deleted(GTK_TREE_MODEL(model),
+                             get_scratch_path(model, path_index, 0));
+}
+
+void point_model_points_added(PointModel* model, gsize path_index, gsize from) {
+  gsize n_rows = get_n_point_rows(model->store->paths[path_index]);
+  if (from >= n_rows)
+    return;
+
+  if (has_listeners(model, row_inserted_signal)) {
+    for (gsize i = from; i < n_rows; ++ i) {
+      GtkTreeIter iter;
+      set_iter(model, &iter, path_index, i + 1);
+
+      gtk_tree_model_row_inserted(GTK_TREE_MODEL(model),
+                                  get_scratch_path(model, path_index, i + 1), &iter);
+    }
+  }
+
+  if (from == 0)
+    toggle_has_child(model, path_index);
+}
+
+void point_model_point_removed(PointModel* model, gsize path_index, gsize point_index) {
+  gtk_tree_model_row_deleted(GTK_TREE_MODEL(model),
+                             get_scratch_path(model, path_index, point_index + 1));
+
+  if (get_n_point_rows(model->store->paths[path_index]) == 0)
+    toggle_has_child(model, path_index);
+}
+
+void point_model_points_hidden(PointModel* model, gsize path_index, gsize n_points) {
+  if (n_points == 0)
+    return;
+
+  if (has_listeners(model, row_deleted_signal)) {
+    // Every deletion moves the next row to the first place
+    for (gsize i = 0; i < n_points; ++ i)
+      gtk_tree_model_row_deleted(GTK_TREE_MODEL(model),
+                                 get_scratch_path(model, path_index, 1));
+  }
+
+  toggle_has_child(model, path_index);
+}
+
+void point_model_row_changed(PointModel* model, gsize path_index, gssize point_index) {
+  GtkTreeIter iter;
+  set_iter(model, &iter, path_index, point_index + 1);
+
+  gtk_tree_model_row_changed(GTK_TREE_MODEL(model),
+                             get_scratch_path(model, path_index, point_index + 1), &iter);
+}
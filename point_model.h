@@ -0,0 +1,53 @@
+#ifndef POINT_MODEL_H
+#define POINT_MODEL_H
+
+#include "point_store.h"
+
+#include <gtk/gtk.h>
+
+/*  GtkTreeModel for `tree_view_for_points` that reads `point_store`
+ *  directly instead of keeping a copy of it:
+ *
+ *      n-th top-level row     <-- n-th path, X column shows it's name
+ *      it's m-th child row    <-- m-th point of the path
+ *
+ *  Rows hold nothing, coordinates are formatted only when view asks
+ *  for them, that is for the rows that are on the screen. Live paths
+ *  (with a window, see point_store.h) have no rows for their points.
+ *
+ *  Model can't see changes of the store by itself, whoever changes
+ *  the store has to report it with one of the functions below, right
+ *  after the change, so that views can update.
+ *  */
+
+enum { // <-- Model columns, both are strings
+  X_COORDINATE_COLUMN,
+  Y_COORDINATE_COLUMN,
+
+  N_COLUMNS // It corresponds to number of columns
+};
+
+#define POINT_TYPE_MODEL point_model_get_type()
+G_DECLARE_FINAL_TYPE(PointModel, point_model, POINT, MODEL, GObject)
+
+PointModel* point_model_new(point_store_t* store);
+
+// Replaces the whole store at once, no rows are reported as changed,
+// so the model has to be detached from all the views during this call
+void point_model_set_store(PointModel* model, point_store_t* store);
+
+// Paths from `from` up to the end of the store have been added
+void point_model_paths_added(PointModel* model, gsize from);
+void point_model_path_removed(PointModel* model, gsize path_index);
+
+// Points from `from` up to the end of the path have been appended
+void point_model_points_added(PointModel* model, gsize path_index, gsize from);
+void point_model_point_removed(PointModel* model, gsize path_index, gsize point_index);
+
+// Path that had rows for it's `n_points` points has become live
+void point_model_points_hidden(PointModel* model, gsize path_index, gsize n_points);
+
+// Name of the path (if `point_index` is -1) or one of it's points changed
+void point_model_row_changed(PointModel* model, gsize path_index, gssize point_index);
+
+#endif
@@ -0,0 +1,974 @@
+#include "point_store.h"
+#include "compact.h"
+#include "lod.h"
+#include "point_index.h"
+#include "pyramid.h"
+#include "segment_index.h"
+
+#include <string.h>
+
+// Both stores and paths grow geometrically, starting from this capacity
+#define MIN_CAPACITY 16
+
+// Longest lists of changed points a path keeps (see `moved` and
+// `spare_changes`), past that all the points after the first of them
+// are taken as changed, it costs about the same by then
+#define MAX_LISTED_CHANGES 4096
+
+// Points of the block that a point of compact path is dragged in. They
+// are quantized again every time the block is encoded anew, but always
+// from the coordinates they had when the drag started, so their errors
+// don't add up from frame to frame
+typedef struct edited_block {
+  gsize   block;
+  guint64 version; // <-- Path's version once the block was last changed
+
+  gdouble xs[COMPACT_BLOCK_SIZE];
+  gdouble ys[COMPACT_BLOCK_SIZE];
+} edited_block_t;
+
+static gsize grow_capacity(gsize capacity, gsize required) {
+  gsize new_capacity = capacity < MIN_CAPACITY ? MIN_CAPACITY : capacity;
+
+  while (new_capacity < required)
+    new_capacity *= 2;
+
+  return new_capacity;
+}
+
+static void bounds_extend(bounds_t* bounds, gdouble x, gdouble y) {
+  bounds->min.x = MIN(bounds->min.x, x);
+  bounds->min.y = MIN(bounds->min.y, y);
+
+  bounds->max.x = MAX(bounds->max.x, x);
+  bounds->max.y = MAX(bounds->max.y, y);
+}
+
+static gboolean is_on_boundary(const bounds_t* bounds, gdouble x, gdouble y) {
+  return x == bounds->min.x || x == bounds->max.x ||
+         y == bounds->min.y || y == bounds->max.y;
+}
+
+// Checks if point that was at `old` leaves some side of `bounds` it lied on
+// when moved to (`x`, `y`), only then bounds may shrink. Point dragged
+// along or past the boundary keeps bounds tight without rescanning them
+static gboolean is_moved_inwards(const bounds_t* bounds, point_t old, gdouble x, gdouble y) {
+  return (old.x == bounds->min.x && x > old.x) || (old.x == bounds->max.x && x < old.x) ||
+         (old.y == bounds->min.y && y > old.y) || (old.y == bounds->max.y && y < old.y);
+}
+
+point_store_t* point_store_new(void) {
+  point_store_t* store = g_new0(point_store_t, 1);
+
+  // Keys are names of the paths themselves, they aren't copied
+  store->paths_by_name = g_hash_table_new(g_str_hash, g_str_equal);
+
+  return store;
+}
+
+static point_buffer_t* point_buffer_new(gsize capacity) {
+  point_buffer_t* buffer = g_new(point_buffer_t, 1);
+
+  buffer->ref_count = 1;
+
+  buffer->xs = g_new(gdouble, capacity);
+  buffer->ys = g_new(gdouble, capacity);
+
+  return buffer;
+}
+
+static void point_buffer_unref(point_buffer_t* buffer) {
+  if (!g_atomic_int_dec_and_test(&buffer->ref_count))
+    return;
+
+  g_free(buffer->xs);
+  g_free(buffer->ys);
+  g_free(buffer);
+}
+
+// Snapshots only take references on the main thread, so once the count
+// drops to one, no one else can get hold of the arrays again
+static gboolean is_shared(const point_buffer_t* buffer) {
+  return buffer != NULL && g_atomic_int_get(&buffer->ref_count) > 1;
+}
+
+// Drops points and caches of the path, but keeps it's name and lists
+static void path_release(path_t* path) {
+  if (path->buffer != NULL)
+    point_buffer_unref(path->buffer);
+
+  if (path->spare != NULL)
+    point_buffer_unref(path->spare);
+
+  if (path->compact != NULL)
+    compact_unref(path->compact);
+
+  if (path->lod != NULL)
+    lod_free(path->lod);
+
+  if (path->segment_index != NULL)
+    segment_index_free(path->segment_index);
+
+  if (path->pyramid != NULL)
+    pyramid_free(path->pyramid);
+
+  if (path->point_index != NULL)
+    point_index_free(path->point_index);
+
+  path->buffer  = path->spare = NULL;
+  path->compact = NULL;
+
+  path->lod           = NULL;
+  path->segment_index = NULL;
+  path->pyramid       = NULL;
+  path->point_index   = NULL;
+}
+
+static void path_free(path_t* path) {
+  path_release(path);
+
+  g_free(path->name);
+  g_free(path->moved.indices);
+  g_free(path->spare_changes.indices);
+  g_free(path->edited_block);
+
+  g_free(path);
+}
+
+void point_store_free(point_store_t* store) {
+  for (gsize i = 0; i < store->n_paths; ++ i)
+    path_free(store->paths[i]);
+
+  g_free(store->paths);
+  g_hash_table_destroy(store->paths_by_name);
+
+  if (store->mapping != NULL)
+    g_mapped_file_unref(store->mapping);
+
+  g_free(store);
+}
+
+point_store_t* point_store_snapshot(point_store_t* store) {
+  return point_store_snapshot_reuse(store, NULL);
+}
+
+void point_store_snapshot_release(point_store_t* snapshot) {
+  for (gsize i = 0; i < snapshot->n_paths; ++ i)
+    path_release(snapshot->paths[i]);
+
+  if (snapshot->mapping != NULL)
+    g_mapped_file_unref(snapshot->mapping);
+
+  snapshot->mapping = NULL;
+}
+
+point_store_t* point_store_snapshot_reuse(point_store_t* store, point_store_t* snapshot) {
+  if (snapshot == NULL)
+    snapshot = point_store_new();
+  else
+    point_store_snapshot_release(snapshot);
+
+  for (gsize i = store->n_paths; i < snapshot->n_paths; ++ i)
+    path_free(snapshot->paths[i]);
+
+  if (snapshot->capacity < store->n_paths) {
+    snapshot->capacity = store->n_paths;
+    snapshot->paths = g_renew(path_t*, snapshot->paths, snapshot->capacity);
+  }
+
+  for (gsize i = snapshot->n_paths; i < store->n_paths; ++ i)
+    snapshot->paths[i] = g_new0(path_t, 1);
+
+  // Lookup by name stays the same while all the names do
+  gboolean are_names_same = snapshot->n_paths == store->n_paths;
+  snapshot->n_paths = store->n_paths;
+
+  if (store->mapping != NULL)
+    snapshot->mapping = g_mapped_file_ref(store->mapping);
+
+  for (gsize i = 0; i < store->n_paths; ++ i) {
+    path_t* path = store->paths[i];
+    path_t* copy = snapshot->paths[i];
+
+    gchar*       name  = copy->name;
+    index_list_t moved = copy->moved;
+
+    if (name == NULL || strcmp(name, path->name) != 0) {
+      g_free(name);
+      name = g_strdup(path->name);
+
+      are_names_same = FALSE;
+    }
+
+    *copy = *path;
+    copy->name = name;
+
+    if (copy->buffer != NULL)
+      g_atomic_int_inc(&copy->buffer->ref_count);
+
+    if (copy->compact != NULL)
+      compact_ref(copy->compact);
+
+    // Snapshot takes over the list of moved points, path starts a new
+    // one in the array of the list that the snapshot had before
+    path->moved = (index_list_t) { moved.indices, 0, moved.capacity };
+
+    copy->spare         = NULL;
+    copy->spare_changes = (index_list_t) { NULL, 0, 0 };
+    copy->edited_block  = NULL;
+
+    copy->lod           = NULL;
+    copy->segment_index = NULL;
+    copy->pyramid       = NULL;
+    copy->point_index   = NULL;
+
+    // Mapped buckets never change, so they are shared just like points
+    if (path->pyramid != NULL && path->pyramid->is_mapped &&
+        path->pyramid->n_points == path->n_points)
+      pyramid_attach_mapped(copy, path->pyramid->levels[0]);
+
+    // Next snapshot is compared to this one
+    path->n_unchanged = path->n_points;
+  }
+
+  if (!are_names_same) {
+    g_hash_table_remove_all(snapshot->paths_by_name);
+
+    for (gsize i = 0; i < snapshot->n_paths; ++ i) {
+      path_t* copy = snapshot->paths[i];
+
+      if (!g_hash_table_contains(snapshot->paths_by_name, copy->name))
+        g_hash_table_insert(snapshot->paths_by_name, copy->name, copy);
+    }
+  }
+
+  return snapshot;
+}
+
+path_t* point_store_add_path(point_store_t* store, const gchar* name) {
+  if (store->n_paths == store->capacity) {
+    store->capacity = grow_capacity(store->capacity, store->n_paths + 1);
+    store->paths = g_renew(path_t*, store->paths, store->capacity);
+  }
+
+  // Stores may be filled by different threads (e.g. in CLI)
+  static gsize next_id = 0;
+
+  path_t* path = g_new0(path_t, 1);
+  path->name  = g_strdup(name);
+  path->index = store->n_paths;
+  path->id    = g_atomic_pointer_add(&next_id, 1);
+
+  store->paths[store->n_paths ++] = path;
+
+  // Path with the same name that is already there comes first
+  if (!g_hash_table_contains(store->paths_by_name, path->name))
+    g_hash_table_insert(store->paths_by_name, path->name, path);
+
+  return path;
+}
+
+// Takes `path` out of lookup by name, next path with the same name
+// (if there's any) is found instead of it from now on
+static void unindex_path(point_store_t* store, path_t* path) {
+  if (g_hash_table_lookup(store->paths_by_name, path->name) != path)
+    return;
+
+  g_hash_table_remove(store->paths_by_name, path->name);
+
+  // Paths are only looked through when a name had duplicates
+  for (gsize i = path->index + 1; i < store->n_paths; ++ i)
+    if (strcmp(store->paths[i]->name, path->name) == 0) {
+      g_hash_table_insert(store->paths_by_name,
+                          store->paths[i]->name, store->paths[i]);
+      break;
+    }
+}
+
+void point_store_remove_path(point_store_t* store, gsize index) {
+  g_return_if_fail(index < store->n_paths);
+
+  unindex_path(store, store->paths[index]);
+  path_free(store->paths[index]);
+
+  memmove(&store->paths[index], &store->paths[index + 1],
+          (store->n_paths - index - 1) * sizeof(path_t*));
+
+  -- store->n_paths;
+
+  for (gsize i = index; i < store->n_paths; ++ i)
+    store->paths[i]->index = i;
+}
+
+gssize point_store_find_path(point_store_t* store, const gchar* name) {
+  path_t* path = g_hash_table_lookup(store->paths_by_name, name);
+  return path == NULL ? -1 : (gssize) path->index;
+}
+
+void point_store_rename_path(point_store_t* store, gsize index, const gchar* name) {
+  g_return_if_fail(index < store->n_paths);
+
+  path_t* path = store->paths[index];
+  unindex_path(store, path);
+
+  g_free(path->name);
+  path->name = g_strdup(name);
+
+  path_t* first = g_hash_table_lookup(store->paths_by_name, path->name);
+  // Key is replaced too, it's the name of the path that was found before
+  if (first == NULL || first->index > path->index)
+    g_hash_table_replace(store->paths_by_name, path->name, path);
+}
+
+gboolean point_store_get_bounds(point_store_t* store, bounds_t* bounds) {
+  gboolean has_points = FALSE;
+
+  for (gsize i = 0; i < store->n_paths; ++ i) {
+    path_t* path = store->paths[i];
+    if (path->n_points == 0)
+      continue;
+
+    if (!has_points)
+      *bounds = path->bounds;
+    else {
+      bounds_extend(bounds, path->bounds.min.x, path->bounds.min.y);
+      bounds_extend(bounds, path->bounds.max.x, path->bounds.max.y);
+    }
+
+    has_points = TRUE;
+  }
+
+  return has_points;
+}
+
+static void index_list_append(index_list_t* list, gsize index) {
+  // Dragged point is changed many times in a row
+  if (list->n_indices != 0 && list->indices[list->n_indices - 1] == index)
+    return;
+
+  if (list->n_indices == list->capacity) {
+    list->capacity = grow_capacity(list->capacity, list->n_indices + 1);
+    list->indices  = g_renew(gsize, list->indices, list->capacity);
+  }
+
+  list->indices[list->n_indices ++] = index;
+}
+
+// Lets snapshots know that `index`-th point was changed
+static void path_add_moved_point(path_t* path, gsize index) {
+  // Points after `n_unchanged` are rebuilt anyway
+  if (index >= path->n_unchanged)
+    return;
+
+  index_list_t* moved = &path->moved;
+
+  if (moved->n_indices == MAX_LISTED_CHANGES) {
+    for (gsize i = 0; i < moved->n_indices; ++ i)
+      index = MIN(index, moved->indices[i]);
+
+    path->n_unchanged = index;
+    moved->n_indices  = 0;
+    return;
+  }
+
+  index_list_append(moved, index);
+}
+
+// Spare arrays are forgotten when points change in some other way
+// than one by one (e.g. are removed, moved or decoded)
+static void path_drop_spare(path_t* path) {
+  if (path->spare == NULL)
+    return;
+
+  point_buffer_unref(path->spare);
+  path->spare = NULL;
+
+  path->spare_changes.n_indices = 0;
+}
+
+// Remembers that `index`-th point of the path is no longer the same in spare arrays
+static void path_add_spare_change(path_t* path, gsize index) {
+  // Points after `n_spare_synced` are copied anyway
+  if (index >= path->n_spare_synced)
+    return;
+
+  if (path->spare_changes.n_indices == MAX_LISTED_CHANGES) {
+    path->n_spare_synced = 0;
+    path->spare_changes.n_indices = 0;
+    return;
+  }
+
+  index_list_append(&path->spare_changes, index);
+}
+
+// Swaps arrays shared with snapshots for the spare ones, if no snapshot
+// reads those anymore, after copying points that are different in them
+static gboolean path_take_spare(path_t* path) {
+  point_buffer_t* spare = path->spare;
+
+  if (spare == NULL || is_shared(spare) || path->spare_capacity != path->capacity)
+    return FALSE;
+
+  for (gsize i = 0; i < path->spare_changes.n_indices; ++ i) {
+    gsize index = path->spare_changes.indices[i];
+
+    spare->xs[index] = path->xs[index];
+    spare->ys[index] = path->ys[index];
+  }
+
+  gsize n_synced = path->n_spare_synced;
+
+  memcpy(spare->xs + n_synced, path->xs + n_synced, (path->n_points - n_synced) * sizeof(gdouble));
+  memcpy(spare->ys + n_synced, path->ys + n_synced, (path->n_points - n_synced) * sizeof(gdouble));
+
+  // Arrays snapshots read become the spare ones
+  path->spare  = path->buffer;
+  path->buffer = spare;
+
+  path->xs = spare->xs;
+  path->ys = spare->ys;
+
+  path->n_spare_synced = path->n_points;
+  path->spare_changes.n_indices = 0;
+
+  return TRUE;
+}
+
+// Moves points of `path` to new arrays of it's own with room for `capacity`
+// points, arrays it had before are left to the snapshots or the mapping
+static void path_move_points(path_t* path, gsize capacity) {
+  path_drop_spare(path);
+
+  point_buffer_t* buffer = point_buffer_new(capacity);
+  gsize n_points = path->n_points - path->n_encoded;
+
+  memcpy(buffer->xs, path->xs, n_points * sizeof(gdouble));
+  memcpy(buffer->ys, path->ys, n_points * sizeof(gdouble));
+
+  if (path->buffer != NULL)
+    point_buffer_unref(path->buffer);
+
+  path->buffer = buffer;
+
+  path->xs = buffer->xs;
+  path->ys = buffer->ys;
+
+  path->capacity  = capacity;
+  path->offset    = 0;
+  path->is_mapped = FALSE;
+}
+
+// Decodes all the points of compact path back into plain arrays
+static void path_expand(path_t* path) {
+  path_drop_spare(path);
+
+  gsize capacity = grow_capacity(0, path->n_points);
+  point_buffer_t* buffer = point_buffer_new(capacity);
+
+  path_get_points(path, 0, path->n_points, buffer->xs, buffer->ys);
+
+  if (path->buffer != NULL)
+    point_buffer_unref(path->buffer);
+
+  compact_unref(path->compact);
+
+  path->buffer = buffer;
+
+  path->xs = buffer->xs;
+  path->ys = buffer->ys;
+
+  path->capacity  = capacity;
+  path->compact   = NULL;
+  path->n_encoded = 0;
+}
+
+// Gives `path` arrays of it's own, if they're shared, before
+// points that are already in them are changed or moved
+static void path_make_writable(path_t* path) {
+  path_drop_spare(path);
+
+  if (path->compact != NULL)
+    path_expand(path);
+  else if (path->is_mapped || is_shared(path->buffer))
+    path_move_points(path, path->capacity - path->offset);
+}
+
+// Same as `path_make_writable`, but only `index`-th point is going to
+// change. Shared arrays are copied once, and from then on path swaps
+// them with the spare ones, so render worker, that always holds
+// a snapshot, doesn't make every change copy all the points
+static void path_make_point_writable(path_t* path, gsize index) {
+  // Arrays of compact path hold less than a block of points
+  if (path->compact != NULL) {
+    if (is_shared(path->buffer))
+      path_move_points(path, COMPACT_BLOCK_SIZE);
+
+    return;
+  }
+
+  if (path->is_mapped || path->window_size != 0 || path->offset != 0) {
+    path_make_writable(path);
+    return;
+  }
+
+  if (is_shared(path->buffer) && !path_take_spare(path)) {
+    point_buffer_t* shared = path->buffer;
+    g_atomic_int_inc(&shared->ref_count);
+
+    path_move_points(path, path->capacity);
+
+    path->spare          = shared;
+    path->spare_capacity = path->capacity;
+    path->n_spare_synced = path->n_points;
+  }
+
+  if (path->spare != NULL)
+    path_add_spare_change(path, index);
+}
+
+void path_reserve(path_t* path, gsize capacity) {
+  // Arrays of compact path only hold the points that aren't encoded,
+  // and there's never more than a block of them
+  if (path->compact != NULL)
+    capacity = COMPACT_BLOCK_SIZE;
+
+  if (capacity <= path->capacity - path->offset)
+    return;
+
+  // Mapped points can't be reallocated and shared ones are still read
+  // by snapshots, so both are copied instead (and only those in use)
+  if (path->is_mapped) {
+    path_move_points(path, grow_capacity(0, capacity));
+    return;
+  }
+
+  if (is_shared(path->buffer)) {
+    path_move_points(path, grow_capacity(path->capacity, capacity));
+    return;
+  }
+
+  // Room left by dropped points is reused before growing
+  if (path->offset != 0) {
+    gdouble* xs = path->xs - path->offset;
+    gdouble* ys = path->ys - path->offset;
+
+    memmove(xs, path->xs, path->n_points * sizeof(gdouble));
+    memmove(ys, path->ys, path->n_points * sizeof(gdouble));
+
+    path->xs = xs;
+    path->ys = ys;
+
+    path->offset = 0;
+
+    if (capacity <= path->capacity)
+      return;
+  }
+
+  path->capacity = grow_capacity(path->capacity, capacity);
+
+  if (path->buffer == NULL) {
+    path->buffer = point_buffer_new(path->capacity);
+
+    path->xs = path->buffer->xs;
+    path->ys = path->buffer->ys;
+    return;
+  }
+
+  // Spare arrays wouldn't have room for the points anymore
+  path_drop_spare(path);
+
+  point_buffer_t* buffer = path->buffer;
+
+  path->xs = buffer->xs = g_renew(gdouble, buffer->xs, path->capacity);
+  path->ys = buffer->ys = g_renew(gdouble, buffer->ys, path->capacity);
+}
+
+void path_attach_mapped_points(path_t* path,
+                               gdouble* xs, gdouble* ys, gsize n_points,
+                               const bounds_t* bounds) {
+  g_return_if_fail(path->n_points == 0 && path->xs == NULL && path->compact == NULL);
+
+  path->xs = xs;
+  path->ys = ys;
+
+  path->n_points  = n_points;
+  path->capacity  = n_points;
+  path->is_mapped = TRUE;
+
+  path->bounds = *bounds;
+  path->n_unchanged = 0;
+
+  ++ path->version;
+}
+
+// Drops `n_dropped` first points of the path without moving the others
+static void path_drop_first_points(path_t* path, gsize n_dropped) {
+  path_drop_spare(path);
+
+  for (gsize i = 0; i < n_dropped && !path->has_loose_bounds; ++ i)
+    path->has_loose_bounds = is_on_boundary(&path->bounds, path->xs[i], path->ys[i]);
+
+  path->xs += n_dropped;
+  path->ys += n_dropped;
+
+  path->offset   += n_dropped;
+  path->n_points -= n_dropped;
+
+  if (path->point_index != NULL)
+    point_index_truncate(path->point_index, 0);
+
+  path->n_unchanged = 0;
+}
+
+void path_set_window(path_t* path, gsize window_size) {
+  path->window_size = window_size;
+
+  if (window_size == 0)
+    return;
+
+  if (path->compact != NULL)
+    path_expand(path);
+
+  // Windowed paths have no pyramids (see `pyramid_get`)
+  if (path->pyramid != NULL) {
+    pyramid_free(path->pyramid);
+    path->pyramid = NULL;
+  }
+
+  if (path->n_points > window_size) {
+    path_drop_first_points(path, path->n_points - window_size);
+    path_update_bounds(path);
+
+    ++ path->version;
+  }
+
+  // With room for two windows, points are moved back to the
+  // start at most once per `window_size` appended points
+  path_reserve(path, 2 * window_size);
+}
+
+// Encodes the first `n_points` points from `xs` and `ys` as blocks of
+// compact path (there must be a whole number of blocks of them)
+static void path_encode_points(path_t* path, const gdouble* xs, const gdouble* ys,
+                               gsize n_points) {
+  // Encoded points aren't quite the same as they were
+  if (path->pyramid != NULL)
+    pyramid_truncate(path->pyramid, path->n_encoded);
+
+  if (path->point_index != NULL)
+    point_index_truncate(path->point_index, path->n_encoded);
+
+  path->n_unchanged = MIN(path->n_unchanged, path->n_encoded);
+
+  for (gsize i = 0; i < n_points; i += COMPACT_BLOCK_SIZE) {
+    path->compact = compact_append_block(path->compact,
+                                         path->n_encoded / COMPACT_BLOCK_SIZE,
+                                         xs + i, ys + i);
+    path->n_encoded += COMPACT_BLOCK_SIZE;
+  }
+}
+
+void path_set_compact(path_t* path, gboolean is_compact) {
+  g_return_if_fail(!is_compact || path->window_size == 0);
+
+  if (!is_compact) {
+    if (path->compact != NULL)
+      path_expand(path);
+
+    return;
+  }
+
+  if (path->compact != NULL)
+    return;
+
+  path->compact = compact_new();
+
+  gsize n_encoded = path->n_points / COMPACT_BLOCK_SIZE * COMPACT_BLOCK_SIZE;
+  path_encode_points(path, path->xs, path->ys, n_encoded);
+
+  // The rest is moved to the start of arrays that only have room for a block
+  if (path->xs != NULL) {
+    path->xs += n_encoded;
+    path->ys += n_encoded;
+
+    path_move_points(path, COMPACT_BLOCK_SIZE);
+  }
+
+  ++ path->version;
+}
+
+void path_append_point(path_t* path, gdouble x, gdouble y) {
+  if (path->window_size != 0 && path->n_points == path->window_size)
+    path_drop_first_points(path, 1);
+
+  path_reserve(path, path->n_points + 1);
+
+  path->xs[path->n_points - path->n_encoded] = x;
+  path->ys[path->n_points - path->n_encoded] = y;
+
+  if (path->n_points == 0) {
+    path->bounds = (bounds_t) { { x, y }, { x, y } };
+    path->has_loose_bounds = FALSE;
+  } else
+    bounds_extend(&path->bounds, x, y);
+
+  ++ path->n_points;
+  ++ path->version;
+
+  if (path->compact == NULL || path->n_points - path->n_encoded < COMPACT_BLOCK_SIZE)
+    return;
+
+  path_encode_points(path, path->xs, path->ys, COMPACT_BLOCK_SIZE);
+
+  // Arrays are filled again from the start, unless snapshots still read them
+  if (is_shared(path->buffer)) {
+    point_buffer_unref(path->buffer);
+    path->buffer = point_buffer_new(COMPACT_BLOCK_SIZE);
+
+    path->xs = path->buffer->xs;
+    path->ys = path->buffer->ys;
+
+    path->capacity = COMPACT_BLOCK_SIZE;
+  }
+}
+
+// Changes encoded point of compact path, only it's block is decoded and
+// encoded anew. Other points of the block are quantized again, so when
+// extents of the block change, they may move as much as compact.h allows,
+// then TRUE is returned
+static gboolean path_set_encoded_point(path_t* path, gsize index, gdouble x, gdouble y) {
+  gsize block = index / COMPACT_BLOCK_SIZE;
+  gsize first = block * COMPACT_BLOCK_SIZE;
+
+  gdouble xs[COMPACT_BLOCK_SIZE], ys[COMPACT_BLOCK_SIZE];
+  compact_decode_block(path->compact, block, xs, ys);
+
+  edited_block_t* edited = path->edited_block;
+
+  // Block is only still being edited if nothing else has changed since
+  if (edited == NULL || edited->block != block || edited->version != path->version) {
+    if (edited == NULL)
+      edited = path->edited_block = g_new(edited_block_t, 1);
+
+    memcpy(edited->xs, xs, sizeof(xs));
+    memcpy(edited->ys, ys, sizeof(ys));
+
+    edited->block = block;
+  }
+
+  edited->xs[index - first] = x;
+  edited->ys[index - first] = y;
+
+  // It's the version `path_set_point` gives the path right after this
+  edited->version = path->version + 1;
+
+  path->compact = compact_set_block(path->compact, path->n_encoded / COMPACT_BLOCK_SIZE,
+                                    block, edited->xs, edited->ys);
+
+  gdouble new_xs[COMPACT_BLOCK_SIZE], new_ys[COMPACT_BLOCK_SIZE];
+  compact_decode_block(path->compact, block, new_xs, new_ys);
+
+  for (gsize i = 0; i < COMPACT_BLOCK_SIZE; ++ i)
+    if (first + i != index && (new_xs[i] != xs[i] || new_ys[i] != ys[i]))
+      return TRUE;
+
+  return FALSE;
+}
+
+// Tells pyramids that points of the block starting with `first`-th point
+// have moved, one point from each of their buckets is enough. Point index
+// isn't told, points listed in cells they are a tiny bit off still are
+// at the right distance (see point_index.h)
+static void path_update_block_buckets(path_t* path, gsize first) {
+  for (gsize i = first; i < first + COMPACT_BLOCK_SIZE; i += PYRAMID_BUCKET_SIZE) {
+    if (path->pyramid != NULL)
+      pyramid_update_point(path->pyramid, path, i);
+
+    path_add_moved_point(path, i);
+  }
+}
+
+void path_set_point(path_t* path, gsize index, gdouble x, gdouble y) {
+  g_return_if_fail(index < path->n_points);
+
+  point_t old = path_get_point(path, index);
+  gboolean is_shrunk = is_moved_inwards(&path->bounds, old, x, y);
+
+  gboolean is_block_moved = FALSE;
+
+  if (index < path->n_encoded)
+    is_block_moved = path_set_encoded_point(path, index, x, y);
+  else {
+    path_make_point_writable(path, index);
+
+    path->xs[index - path->n_encoded] = x;
+    path->ys[index - path->n_encoded] = y;
+  }
+
+  if (path->pyramid != NULL)
+    pyramid_update_point(path->pyramid, path, index);
+
+  if (path->point_index != NULL)
+    point_index_update_point(path->point_index, index);
+
+  path_add_moved_point(path, index);
+
+  if (is_block_moved)
+    path_update_block_buckets(path, index / COMPACT_BLOCK_SIZE * COMPACT_BLOCK_SIZE);
+
+  // Moving a point from the boundary inwards may shrink the path
+  if (is_shrunk)
+    path_update_bounds(path);
+  else
+    bounds_extend(&path->bounds, x, y);
+
+  ++ path->version;
+}
+
+void path_remove_point(path_t* path, gsize index) {
+  g_return_if_fail(index < path->n_points);
+
+  point_t old = path_get_point(path, index);
+  gboolean was_on_boundary = is_on_boundary(&path->bounds, old.x, old.y);
+
+  path_make_writable(path);
+
+  gsize n_moved = path->n_points - index - 1;
+  memmove(&path->xs[index], &path->xs[index + 1], n_moved * sizeof(gdouble));
+  memmove(&path->ys[index], &path->ys[index + 1], n_moved * sizeof(gdouble));
+
+  -- path->n_points;
+  ++ path->version;
+
+  // Points after the removed one have moved one place back
+  if (path->pyramid != NULL)
+    pyramid_truncate(path->pyramid, index);
+
+  if (path->point_index != NULL)
+    point_index_truncate(path->point_index, index);
+
+  path->n_unchanged = MIN(path->n_unchanged, index);
+
+  if (was_on_boundary)
+    path_update_bounds(path);
+}
+
+void path_update_bounds(path_t* path) {
+  path->has_loose_bounds = FALSE;
+
+  if (path->n_points == 0)
+    return;
+
+  point_t first = path_get_point(path, 0);
+  path->bounds = (bounds_t) { first, first };
+
+  // Extents of blocks are known without decoding them
+  for (gsize i = 0; i < path->n_encoded / COMPACT_BLOCK_SIZE; ++ i) {
+    const compact_block_t* block = &path->compact->blocks[i];
+
+    bounds_extend(&path->bounds, block->min_x, block->min_y);
+    bounds_extend(&path->bounds, block->max_x, block->max_y);
+  }
+
+  for (gsize i = 0; i < path->n_points - path->n_encoded; ++ i)
+    bounds_extend(&path->bounds, path->xs[i], path->ys[i]);
+}
+
+void path_begin_edit(path_t* path) {
+  path_make_writable(path);
+}
+
+void path_end_edit(path_t* path, const bounds_t* bounds) {
+  path->bounds = *bounds;
+  path->has_loose_bounds = FALSE;
+
+  // Every point may have moved to another bucket or cell
+  if (path->pyramid != NULL)
+    pyramid_truncate(path->pyramid, 0);
+
+  if (path->point_index != NULL)
+    point_index_truncate(path->point_index, 0);
+
+  path->n_unchanged = 0;
+  ++ path->version;
+}
+
+void path_take_points(path_t* path, gdouble* xs, gdouble* ys, gsize n_points,
+                      const bounds_t* bounds) {
+  g_return_if_fail(path->window_size == 0);
+
+  path_drop_spare(path);
+
+  if (path->buffer != NULL)
+    point_buffer_unref(path->buffer);
+
+  if (path->compact != NULL)
+    compact_unref(path->compact);
+
+  point_buffer_t* buffer = g_new(point_buffer_t, 1);
+
+  buffer->ref_count = 1;
+
+  buffer->xs = xs;
+  buffer->ys = ys;
+
+  path->buffer = buffer;
+
+  path->xs = xs;
+  path->ys = ys;
+
+  path->n_points  = n_points;
+  path->capacity  = n_points;
+  path->offset    = 0;
+  path->is_mapped = FALSE;
+
+  path->compact   = NULL;
+  path->n_encoded = 0;
+
+  path_end_edit(path, bounds);
+}
+
+point_t path_get_point(const path_t* path, gsize index) {
+  g_return_val_if_fail(index < path->n_points, ((point_t) { 0.0, 0.0 }));
+
+  if (index >= path->n_encoded)
+    return (point_t) { path->xs[index - path->n_encoded],
+                       path->ys[index - path->n_encoded] };
+
+  point_t point;
+  compact_get_point(path->compact, index, &point.x, &point.y);
+
+  return point;
+}
+
+void path_get_points(const path_t* path, gsize from, gsize n_points,
+                     gdouble* xs, gdouble* ys) {
+  g_return_if_fail(from + n_points <= path->n_points);
+
+  while (n_points != 0 && from < path->n_encoded) {
+    gsize block = from / COMPACT_BLOCK_SIZE;
+    gsize first = from % COMPACT_BLOCK_SIZE;
+
+    gsize n_read = MIN(n_points, COMPACT_BLOCK_SIZE - first);
+
+    // Blocks are decoded whole, right into place if they're read whole
+    if (n_read == COMPACT_BLOCK_SIZE)
+      compact_decode_block(path->compact, block, xs, ys);
+    else {
+      gdouble block_xs[COMPACT_BLOCK_SIZE], block_ys[COMPACT_BLOCK_SIZE];
+      compact_decode_block(path->compact, block, block_xs, block_ys);
+
+      memcpy(xs, block_xs + first, n_read * sizeof(gdouble));
+      memcpy(ys, block_ys + first, n_read * sizeof(gdouble));
+    }
+
+    xs += n_read;
+    ys += n_read;
+
+    from     += n_read;
+    n_points -= n_read;
+  }
+
+  memcpy(xs, path->xs + (from - path->n_encoded), n_points * sizeof(gdouble));
+  memcpy(ys, path->ys + (from - path->n_encoded), n_points * sizeof(gdouble));
+}
@@ -0,0 +1,262 @@
+#ifndef POINT_STORE_H
+#define POINT_STORE_H
+
+#include <glib.h>
+
+/*  Native storage for all the paths shown in <Preview> tab
+ *
+ *  Every path keeps its coordinates in two contiguous arrays
+ *  (`xs` and `ys`), so drawing code and bounds code can walk
+ *  them directly without any parsing.
+ *
+ *  Paths too big for that can be made compact (see compact.h),
+ *  then most of their points are encoded in blocks and are read
+ *  with `path_get_points` and `path_get_point` instead.
+ *
+ *  Text is converted to numbers exactly once: when a point
+ *  is added, edited or imported. `tree_view_for_points` only
+ *  shows a formatted copy of what is stored here.
+ *  */
+
+typedef struct {
+  gdouble x;
+  gdouble y;
+} point_t;
+
+typedef struct {
+  point_t min;
+  point_t max;
+} bounds_t;
+
+static inline gboolean bounds_intersect(const bounds_t* first, const bounds_t* second) {
+  return first->min.x <= second->max.x && second->min.x <= first->max.x &&
+         first->min.y <= second->max.y && second->min.y <= first->max.y;
+}
+
+// Checks if `inner` lies completely inside of `outer`
+static inline gboolean bounds_contain(const bounds_t* outer, const bounds_t* inner) {
+  return outer->min.x <= inner->min.x && inner->max.x <= outer->max.x &&
+         outer->min.y <= inner->min.y && inner->max.y <= outer->max.y;
+}
+
+static inline gboolean bounds_equal(const bounds_t* first, const bounds_t* second) {
+  return first->min.x == second->min.x && first->min.y == second->min.y &&
+         first->max.x == second->max.x && first->max.y == second->max.y;
+}
+
+// Heap arrays that hold points of a path. Snapshots of the store (see
+// `point_store_snapshot`) share them with the path instead of copying,
+// so they are counted and freed by whoever lets them go last
+typedef struct {
+  gint     ref_count;
+
+  gdouble* xs; // <-- Allocations themselves, path may start further in them
+  gdouble* ys;
+} point_buffer_t;
+
+// Points of a path that were changed, a point changed
+// several times in a row is listed once
+typedef struct {
+  gsize* indices;
+  gsize  n_indices;
+  gsize  capacity;
+} index_list_t;
+
+typedef struct {
+  gchar*   name;
+  gsize    index; // <-- Position in the store, kept up to date by the store
+
+  // Unique among all the paths of all the stores, so caches kept away
+  // from the path (see render_worker.c) can find out which path is whose
+  gsize    id;
+
+  gdouble* xs; // <-- X coordinates of all the points in the path
+  gdouble* ys; // <-- Y coordinates of all the points in the path
+              //     (of compact path only those that aren't encoded)
+
+  gsize    n_points;
+  gsize    capacity; // <-- Number of points `xs` and `ys` have room for
+
+  // Paths with a window keep only this many last points, older ones are
+  // dropped from the front as new ones come (0 means there's no window)
+  gsize    window_size;
+
+  // Points dropped from the front of a windowed path that are still in
+  // it's arrays, actual allocations start `offset` elements before `xs`
+  // and `ys`. Points are moved back to the start only once the arrays
+  // run out of room, so dropping a point is O(1) amortized
+  gsize    offset;
+
+  // Arrays `xs` and `ys` point into, it's NULL for mapped points. Shared
+  // arrays are only ever appended to, before any point in them is changed
+  // or moved, path gets arrays of it's own
+  point_buffer_t* buffer;
+
+  // Points are borrowed from the store's `mapping` rather than owned,
+  // they are copied to the heap as soon as the path needs to change them
+  gboolean is_mapped;
+
+  // Blocks that the first `n_encoded` points of compact path are encoded
+  // in, it's NULL for other paths. The rest of the points (less than one
+  // block) are in `xs` and `ys`, they are encoded once there's a block of
+  // them. Blocks are shared with snapshots just like `buffer` is
+  struct compact* compact;
+  gsize           n_encoded;
+
+  // Block of compact path that was changed last, with coordinates it's
+  // points had before that, it's encoded anew from them every time
+  // (see `path_set_point`). Snapshots don't share it
+  struct edited_block* edited_block;
+
+  // Extents of all the points in the path, they are kept up to date
+  // by every function below and are meaningless for empty paths
+  bounds_t bounds;
+
+  // Set when windowed path has dropped a point that lied on it's
+  // boundary, `bounds` still cover all the points, but may be larger
+  // than needed until `path_update_bounds` is called
+  gboolean has_loose_bounds;
+
+  // Incremented on every change of points, caches built
+  // from the path compare it to find out if they are stale
+  guint64 version;
+
+  // Number of first points that are the same as in the last snapshot of
+  // the store (except those in `moved`), points after them were changed,
+  // moved or appended since
+  gsize   n_unchanged;
+
+  // Points before `n_unchanged` that were changed by `path_set_point`
+  // since the last snapshot. Snapshot takes them over, so that caches
+  // updated in place (pyramids of render worker) rebuild only buckets
+  // of these points rather than of all the points after them
+  index_list_t moved;
+
+  // Arrays path had before it copied the ones shared with a snapshot,
+  // with room for `spare_capacity` points. When a point is changed again
+  // and the snapshot is gone, path swaps the arrays back and copies only
+  // points that are different in them: those in `spare_changes`
+  // and those after `n_spare_synced`. Path dragged while render worker
+  // draws it doesn't have to copy all of it's points on every frame
+  point_buffer_t* spare;
+  gsize           spare_capacity;
+  gsize           n_spare_synced;
+  index_list_t    spare_changes;
+
+  // Caches built from the path, they are freed together with it:
+  struct lod*           lod;           // <-- Decimated polyline (lod.c)
+  struct segment_index* segment_index; // <-- Spatial index (segment_index.c)
+  struct pyramid*       pyramid;       // <-- Min/max pyramid (pyramid.c)
+  struct point_index*   point_index;   // <-- Picking with the mouse (point_index.c)
+} path_t;
+
+typedef struct {
+  path_t** paths;
+
+  gsize    n_paths;
+  gsize    capacity;
+
+  // Name -> path_t*, paths with the same name are found by the first of
+  // them, so lookup by name doesn't depend on the number of paths
+  GHashTable* paths_by_name;
+
+  // Memory-mapped project file that some of the paths borrow points
+  // from (see project.c). It's read-only and snapshots of the store hold
+  // references to it, so it's unmapped together with the last of them
+  GMappedFile* mapping;
+} point_store_t;
+
+point_store_t* point_store_new(void);
+void point_store_free(point_store_t* store);
+
+// Frozen copy of `store` that can be read by another thread while `store`
+// goes on changing. Points aren't copied, snapshot shares them with the
+// paths, which get arrays of their own only when they change shared points
+// (see `spare` above), so it takes time proportional to the number of paths
+// alone. Caches aren't copied either, paths of the snapshot start without
+// them, except that the pyramids borrowed from the mapping are shared too.
+// Snapshot must not be changed and is freed with `point_store_free`
+point_store_t* point_store_snapshot(point_store_t* store);
+
+// Drops references `snapshot` holds on points (and on the mapping), so
+// that paths don't have to copy them anymore. Released snapshot can't be
+// read, it can only be refilled with `point_store_snapshot_reuse` or freed
+void point_store_snapshot_release(point_store_t* snapshot);
+
+// Same as `point_store_snapshot`, but `snapshot` (NULL or a snapshot that
+// is no longer read) is refilled rather than a new one allocated: it's
+// paths, their names and lists and lookup by name are reused, so while
+// paths and their names stay the same, a snapshot allocates nothing
+point_store_t* point_store_snapshot_reuse(point_store_t* store, point_store_t* snapshot);
+
+// Appends new empty path named `name` to the end of the store
+path_t* point_store_add_path(point_store_t* store, const gchar* name);
+void point_store_remove_path(point_store_t* store, gsize index);
+
+// Returns index of the (first) path named `name` or -1 if there's no such path
+gssize point_store_find_path(point_store_t* store, const gchar* name);
+
+// Renames path, it has to be done here to keep lookup by name working
+void point_store_rename_path(point_store_t* store, gsize index, const gchar* name);
+
+// Combines extents of all non-empty paths, it doesn't look at points
+// at all, so it's cheap to call on every redraw. Returns FALSE if
+// there are no points in the store
+gboolean point_store_get_bounds(point_store_t* store, bounds_t* bounds);
+
+// Makes sure that `path` can hold at least `capacity` points without reallocation
+void path_reserve(path_t* path, gsize capacity);
+
+// Makes empty `path` use `n_points` points from `xs` and `ys` without
+// copying them, they must live in the store's `mapping`. Extents of
+// the points are passed in too, so they don't have to be scanned
+void path_attach_mapped_points(path_t* path,
+                               gdouble* xs, gdouble* ys, gsize n_points,
+                               const bounds_t* bounds);
+
+// Makes `path` keep only `window_size` last points (0 removes the window)
+void path_set_window(path_t* path, gsize window_size);
+
+// Makes `path` compact or turns it back into plain arrays. Compact path
+// takes 2 (noise) to 6 (smooth lines) times less memory, but it's points
+// are only as precise as compact.h says and reading them costs decoding.
+// Points appended to it are encoded as they come, changing a point
+// encodes only it's block anew, but removing a point, as well as setting
+// a window, turns it back. Windowed paths can't be compact
+void path_set_compact(path_t* path, gboolean is_compact);
+
+// Appends point to the end, windowed path that is full drops it's first point
+void path_append_point(path_t* path, gdouble x, gdouble y);
+void path_set_point(path_t* path, gsize index, gdouble x, gdouble y);
+void path_remove_point(path_t* path, gsize index);
+
+// Returns `index`-th point, compact path decodes it from it's block
+point_t path_get_point(const path_t* path, gsize index);
+
+// Copies `n_points` points starting from `from`-th one into `xs` and `ys`,
+// compact path decodes them a block at a time. It's the way to read points
+// of any path, plain ones can also be read from `xs` and `ys` directly
+void path_get_points(const path_t* path, gsize from, gsize n_points,
+                     gdouble* xs, gdouble* ys);
+
+// Rescans all the points in the path to find it's extents, it's only
+// needed when a point that lied on the boundary was moved or removed
+void path_update_bounds(path_t* path);
+
+// Gives `path` plain arrays of it's own with all of it's points (compact
+// path is decoded into them), so that they can be rewritten right in
+// `xs` and `ys`. Then `path_end_edit` is called once for all of them
+void path_begin_edit(path_t* path);
+
+// Tells `path` that all of it's points have changed since `path_begin_edit`,
+// `bounds` are their new extents. Caches built from the old ones are dropped
+void path_end_edit(path_t* path, const bounds_t* bounds);
+
+// Replaces all the points of path without a window by `n_points` points
+// from `xs` and `ys` (allocated with `g_new`), path takes the arrays over.
+// Compact path is turned back into plain arrays, `bounds` are the same
+// as for `path_end_edit`
+void path_take_points(path_t* path, gdouble* xs, gdouble* ys, gsize n_points,
+                      const bounds_t* bounds);
+
+#endif
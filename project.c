@@ -0,0 +1,374 @@
+#include "project.h"
+#include "compact.h"
+#include "pyramid.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// Structures are written and read as they are, so their
+// layout must not depend on the compiler's padding
+G_STATIC_ASSERT(sizeof(project_header_t) == 24);
+G_STATIC_ASSERT(sizeof(project_path_t)   == 80);
+G_STATIC_ASSERT(sizeof(pyramid_bucket_t) == 6 * sizeof(gdouble));
+
+// Path table entry of version 1 files ends before `pyramid_offset`
+#define PROJECT_PATH_V1_SIZE G_STRUCT_OFFSET(project_path_t, pyramid_offset)
+
+GQuark project_error_quark(void) {
+  return g_quark_from_static_string("project-error-quark");
+}
+
+// Point arrays and pyramids are aligned to this many bytes
+#define POINTS_ALIGNMENT sizeof(gdouble)
+
+static guint64 align_offset(guint64 offset) {
+  return (offset + POINTS_ALIGNMENT - 1) / POINTS_ALIGNMENT * POINTS_ALIGNMENT;
+}
+
+static gdouble double_to_le(gdouble value) {
+  union { gdouble value; guint64 bits; } converter = { value };
+  converter.bits = GUINT64_TO_LE(converter.bits);
+
+  return converter.value;
+}
+
+static gdouble double_from_le(gdouble value) {
+  union { gdouble value; guint64 bits; } converter = { value };
+  converter.bits = GUINT64_FROM_LE(converter.bits);
+
+  return converter.value;
+}
+
+static gboolean write_points(FILE* file, const gdouble* values, gsize n_values) {
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+  return fwrite(values, sizeof(gdouble), n_values, file) == n_values;
+#else
+  // Points have to be byte-swapped, it's done in small chunks
+  gdouble buffer[512];
+
+  for (gsize written = 0; written < n_values; ) {
+    gsize n_chunk = MIN(n_values - written, G_N_ELEMENTS(buffer));
+
+    for (gsize i = 0; i < n_chunk; ++ i)
+      buffer[i] = double_to_le(values[written + i]);
+
+    if (fwrite(buffer, sizeof(gdouble), n_chunk, file) != n_chunk)
+      return FALSE;
+
+    written += n_chunk;
+  }
+
+  return TRUE;
+#endif
+}
+
+// Compact paths are saved as doubles too, they are decoded a block at a
+// time, first for X coordinates and then once again for Y coordinates
+static gboolean write_path_points(FILE* file, const path_t* path) {
+  if (path->compact == NULL)
+    return write_points(file, path->xs, path->n_points) &&
+           write_points(file, path->ys, path->n_points);
+
+  gdouble xs[COMPACT_BLOCK_SIZE], ys[COMPACT_BLOCK_SIZE];
+
+  for (int coordinate = 0; coordinate < 2; ++ coordinate)
+    for (gsize from = 0; from < path->n_points; from += COMPACT_BLOCK_SIZE) {
+      gsize n_read = MIN(COMPACT_BLOCK_SIZE, path->n_points - from);
+      path_get_points(path, from, n_read, xs, ys);
+
+      if (!write_points(file, coordinate == 0 ? xs : ys, n_read))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gboolean write_project(FILE* file, point_store_t* store) {
+  // Whole layout is computed first, so table can go before the points
+  guint64 offset = sizeof(project_header_t) + store->n_paths * sizeof(project_path_t);
+
+  project_path_t* table = g_new0(project_path_t, store->n_paths);
+
+  for (gsize i = 0; i < store->n_paths; ++ i) {
+    table[i].name_offset = offset;
+    table[i].name_length = strlen(store->paths[i]->name);
+
+    offset += table[i].name_length;
+  }
+
+  guint64 names_end = offset;
+  offset = align_offset(offset);
+
+  for (gsize i = 0; i < store->n_paths; ++ i) {
+    path_t* path = store->paths[i];
+
+    table[i].n_points  = path->n_points;
+
+    table[i].xs_offset = offset;
+    offset += path->n_points * sizeof(gdouble);
+
+    table[i].ys_offset = offset;
+    offset += path->n_points * sizeof(gdouble);
+
+    if (path->n_points != 0) {
+      table[i].min_x = path->bounds.min.x;
+      table[i].min_y = path->bounds.min.y;
+      table[i].max_x = path->bounds.max.x;
+      table[i].max_y = path->bounds.max.y;
+    }
+  }
+
+  // Buckets are all doubles, so pyramids stay aligned after the points
+  for (gsize i = 0; i < store->n_paths; ++ i) {
+    path_t* path = store->paths[i];
+
+    // It's brought up to date here, if it's not yet
+    if (pyramid_get(path) == NULL)
+      continue;
+
+    table[i].pyramid_offset = offset;
+    offset += pyramid_get_size(path->n_points) * sizeof(pyramid_bucket_t);
+  }
+
+  for (gsize i = 0; i < store->n_paths; ++ i) {
+    table[i].name_offset = GUINT64_TO_LE(table[i].name_offset);
+    table[i].name_length = GUINT64_TO_LE(table[i].name_length);
+    table[i].n_points    = GUINT64_TO_LE(table[i].n_points);
+    table[i].xs_offset   = GUINT64_TO_LE(table[i].xs_offset);
+    table[i].ys_offset   = GUINT64_TO_LE(table[i].ys_offset);
+
+    table[i].pyramid_offset = GUINT64_TO_LE(table[i].pyramid_offset);
+
+    table[i].min_x = double_to_le(table[i].min_x);
+    table[i].min_y = double_to_le(table[i].min_y);
+    table[i].max_x = double_to_le(table[i].max_x);
+    table[i].max_y = double_to_le(table[i].max_y);
+  }
+
+  project_header_t header = {
+    .magic             = PROJECT_MAGIC,
+    .version           = GUINT32_TO_LE(PROJECT_VERSION),
+    .n_paths           = GUINT32_TO_LE(store->n_paths),
+    .path_table_offset = GUINT64_TO_LE(sizeof(project_header_t))
+  };
+
+  gboolean is_written =
+    fwrite(&header, sizeof(header), 1, file) == 1 &&
+    fwrite(table, sizeof(project_path_t), store->n_paths, file) == store->n_paths;
+
+  g_free(table);
+
+  for (gsize i = 0; is_written && i < store->n_paths; ++ i) {
+    gsize length = strlen(store->paths[i]->name);
+    is_written = fwrite(store->paths[i]->name, 1, length, file) == length;
+  }
+
+  static const gchar padding[POINTS_ALIGNMENT] = { 0 };
+  gsize padding_size = align_offset(names_end) - names_end;
+
+  is_written = is_written &&
+    fwrite(padding, 1, padding_size, file) == padding_size;
+
+  // Points go straight from the store to the file
+  for (gsize i = 0; is_written && i < store->n_paths; ++ i)
+    is_written = write_path_points(file, store->paths[i]);
+
+  for (gsize i = 0; is_written && i < store->n_paths; ++ i) {
+    const pyramid_t* pyramid = store->paths[i]->pyramid;
+
+    if (pyramid == NULL || store->paths[i]->n_points < PYRAMID_MIN_POINTS)
+      continue;
+
+    // Buckets are written (and byte-swapped) as plain doubles
+    for (gsize level = 0; is_written && level < pyramid->n_levels; ++ level) {
+      gsize n_buckets = pyramid_get_n_buckets(pyramid->n_points, level);
+
+      is_written = write_points(file, (const gdouble*) pyramid->levels[level],
+                                n_buckets * sizeof(pyramid_bucket_t) / sizeof(gdouble));
+    }
+  }
+
+  return is_written;
+}
+
+gboolean project_save(point_store_t* store, const gchar* filename, GError** error) {
+  g_return_val_if_fail(store->n_paths <= G_MAXUINT32, FALSE);
+
+  // Project being overwritten may be mapped by this very store,
+  // so it's replaced as a whole instead of being written over
+  gchar* temporary_filename = g_strconcat(filename, ".tmp", NULL);
+
+  FILE* file = fopen(temporary_filename, "wb");
+  if (file == NULL) {
+    g_set_error(error, PROJECT_ERROR, PROJECT_ERROR_IO,
+                "Can't create %s: %s", temporary_filename, g_strerror(errno));
+
+    g_free(temporary_filename);
+    return FALSE;
+  }
+
+  gboolean is_saved = write_project(file, store);
+  is_saved = fclose(file) == 0 && is_saved;
+
+  is_saved = is_saved && rename(temporary_filename, filename) == 0;
+
+  if (!is_saved) {
+    g_set_error(error, PROJECT_ERROR, PROJECT_ERROR_IO,
+                "Can't write %s: %s", filename, g_strerror(errno));
+
+    unlink(temporary_filename);
+  }
+
+  g_free(temporary_filename);
+  return is_saved;
+}
+
+// Checks that `size` bytes starting at `offset` lie inside the file
+static gboolean is_in_file(guint64 offset, guint64 size, gsize file_size) {
+  return offset <= file_size && size <= file_size - offset;
+}
+
+static gboolean load_paths(point_store_t* store, const gchar* filename, GError** error) {
+  const gchar* data = g_mapped_file_get_contents(store->mapping);
+  gsize file_size = g_mapped_file_get_length(store->mapping);
+
+  project_header_t header;
+
+  if (file_size < sizeof(header)) {
+    g_set_error(error, PROJECT_ERROR, PROJECT_ERROR_FORMAT,
+                "%s is not a project file", filename);
+    return FALSE;
+  }
+
+  memcpy(&header, data, sizeof(header));
+
+  if (memcmp(header.magic, PROJECT_MAGIC, sizeof(header.magic)) != 0) {
+    g_set_error(error, PROJECT_ERROR, PROJECT_ERROR_FORMAT,
+                "%s is not a project file", filename);
+    return FALSE;
+  }
+
+  guint32 version = GUINT32_FROM_LE(header.version);
+  if (version == 0 || version > PROJECT_VERSION) {
+    g_set_error(error, PROJECT_ERROR, PROJECT_ERROR_VERSION,
+                "%s has unsupported version %u", filename, version);
+    return FALSE;
+  }
+
+  guint64 n_paths = GUINT32_FROM_LE(header.n_paths);
+  guint64 path_table_offset = GUINT64_FROM_LE(header.path_table_offset);
+
+  gsize entry_size = version == 1 ? PROJECT_PATH_V1_SIZE : sizeof(project_path_t);
+
+  if (!is_in_file(path_table_offset, n_paths * entry_size, file_size)) {
+    g_set_error(error, PROJECT_ERROR, PROJECT_ERROR_FORMAT,
+                "%s is damaged: path table is truncated", filename);
+    return FALSE;
+  }
+
+  for (gsize i = 0; i < n_paths; ++ i) {
+    // Fields that older versions don't have stay zero
+    project_path_t entry = { 0 };
+    memcpy(&entry, data + path_table_offset + i * entry_size, entry_size);
+
+    guint64 name_offset = GUINT64_FROM_LE(entry.name_offset);
+    guint64 name_length = GUINT64_FROM_LE(entry.name_length);
+    guint64 n_points    = GUINT64_FROM_LE(entry.n_points);
+    guint64 xs_offset   = GUINT64_FROM_LE(entry.xs_offset);
+    guint64 ys_offset   = GUINT64_FROM_LE(entry.ys_offset);
+
+    guint64 pyramid_offset = GUINT64_FROM_LE(entry.pyramid_offset);
+
+    gboolean is_valid =
+      is_in_file(name_offset, name_length, file_size) &&
+      n_points <= file_size / sizeof(gdouble) &&
+      is_in_file(xs_offset, n_points * sizeof(gdouble), file_size) &&
+      is_in_file(ys_offset, n_points * sizeof(gdouble), file_size) &&
+      xs_offset % POINTS_ALIGNMENT == 0 && ys_offset % POINTS_ALIGNMENT == 0;
+
+    // Pyramid size only depends on the number of points
+    is_valid = is_valid && (pyramid_offset == 0 ||
+      (n_points >= PYRAMID_MIN_POINTS &&
+       is_in_file(pyramid_offset,
+                  pyramid_get_size(n_points) * sizeof(pyramid_bucket_t), file_size) &&
+       pyramid_offset % POINTS_ALIGNMENT == 0));
+
+    if (!is_valid) {
+      g_set_error(error, PROJECT_ERROR, PROJECT_ERROR_FORMAT,
+                  "%s is damaged: path %zu points outside of the file", filename, i);
+      return FALSE;
+    }
+
+    gchar* name = g_strndup(data + name_offset, name_length);
+    path_t* path = point_store_add_path(store, name);
+    g_free(name);
+
+    if (n_points == 0)
+      continue;
+
+    gdouble* xs = (gdouble*) (data + xs_offset);
+    gdouble* ys = (gdouble*) (data + ys_offset);
+
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+    bounds_t bounds = {
+      { double_from_le(entry.min_x), double_from_le(entry.min_y) },
+      { double_from_le(entry.max_x), double_from_le(entry.max_y) }
+    };
+
+    path_attach_mapped_points(path, xs, ys, n_points, &bounds);
+
+    // Without a pyramid (in version 1 files) it's built on the first draw
+    if (pyramid_offset != 0)
+      pyramid_attach_mapped(path, (pyramid_bucket_t*) (data + pyramid_offset));
+#else
+    // Mapped points are in the wrong byte order, so they are copied,
+    // pyramid isn't, it's built again from the copied points
+    path_reserve(path, n_points);
+
+    for (gsize j = 0; j < n_points; ++ j)
+      path_append_point(path, double_from_le(xs[j]), double_from_le(ys[j]));
+#endif
+  }
+
+  return TRUE;
+}
+
+point_store_t* project_load(const gchar* filename, GError** error) {
+  int fd = open(filename, O_RDONLY);
+
+  if (fd == -1) {
+    g_set_error(error, PROJECT_ERROR, PROJECT_ERROR_IO,
+                "Can't open %s: %s", filename, g_strerror(errno));
+    return NULL;
+  }
+
+  point_store_t* store = point_store_new();
+
+  // Mapping is read-only, paths copy points from it before they change
+  // them, so edits of loaded points never reach the file itself
+  GError* map_error = NULL;
+  store->mapping = g_mapped_file_new_from_fd(fd, FALSE, &map_error);
+
+  if (store->mapping == NULL) {
+    g_set_error(error, PROJECT_ERROR, PROJECT_ERROR_IO,
+                "Can't map %s: %s", filename, map_error->message);
+
+    g_error_free(map_error);
+    close(fd);
+    point_store_free(store);
+    return NULL;
+  }
+
+  // Mapping stays valid after the file is closed
+  close(fd);
+
+  if (!load_paths(store, filename, error)) {
+    point_store_free(store);
+    return NULL;
+  }
+
+  return store;
+}
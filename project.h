@@ -0,0 +1,69 @@
+#ifndef PROJECT_H
+#define PROJECT_H
+
+#include "point_store.h"
+
+/*  Binary project files
+ *
+ *  All numbers are little-endian, file is laid out like this:
+ *
+ *      header         (`project_header_t`)
+ *      path table     (`project_path_t` for every path)
+ *      path names     (UTF-8, not NUL-terminated)
+ *      point arrays   (all X, then all Y coordinates of each path,
+ *                      as IEEE 754 doubles aligned to 8 bytes)
+ *      pyramids       (`pyramid_bucket_t` of all the levels of each
+ *                      path that has one, from the lowest level up)
+ *
+ *  Point arrays and pyramids are used right from the memory-mapped
+ *  file, so opening even a huge project costs about as much as reading
+ *  it's path table. Points are paged in only when they are needed, and
+ *  paths that have a pyramid are drawn zoomed out without reading them.
+ *
+ *  Version 1 files have no pyramids and a shorter path table entry
+ *  (without `pyramid_offset`), they are still opened.
+ *  */
+
+#define PROJECT_MAGIC   "PNTDRAW"  // <-- Followed by NUL, 8 bytes in total
+#define PROJECT_VERSION 2
+
+typedef struct {
+  gchar   magic[8];
+  guint32 version;
+  guint32 n_paths;
+  guint64 path_table_offset;
+} project_header_t;
+
+typedef struct {
+  guint64 name_offset;
+  guint64 name_length;
+
+  guint64 n_points;
+  guint64 xs_offset;
+  guint64 ys_offset;
+
+  // Extents of the points, so they don't have to be scanned on load
+  gdouble min_x, min_y;
+  gdouble max_x, max_y;
+
+  // Paths smaller than `PYRAMID_MIN_POINTS` have no pyramid, it's 0 then
+  guint64 pyramid_offset;
+} project_path_t;
+
+#define PROJECT_ERROR project_error_quark()
+GQuark project_error_quark(void);
+
+typedef enum {
+  PROJECT_ERROR_IO,      // <-- File can't be opened, read or written
+  PROJECT_ERROR_FORMAT,  // <-- File is not a project or is damaged
+  PROJECT_ERROR_VERSION  // <-- File was saved by a newer version
+} project_error_t;
+
+// Writes all the paths straight from the store (without building any
+// intermediate copies) to a temporary file that then replaces `filename`
+gboolean project_save(point_store_t* store, const gchar* filename, GError** error);
+
+// Returns new store with points borrowed from memory-mapped `filename`
+point_store_t* project_load(const gchar* filename, GError** error);
+
+#endif
@@ -0,0 +1,286 @@
+#include "pyramid.h"
+
+#include <math.h>
+#include <string.h>
+
+gsize pyramid_get_n_buckets(gsize n_points, gsize level) {
+  if (n_points == 0)
+    return 0;
+
+  return (n_points - 1) / ((gsize) PYRAMID_BUCKET_SIZE << level) + 1;
+}
+
+gsize pyramid_get_n_levels(gsize n_points) {
+  gsize n_levels = 1;
+
+  while (pyramid_get_n_buckets(n_points, n_levels - 1) > 1)
+    ++ n_levels;
+
+  return n_levels;
+}
+
+gsize pyramid_get_size(gsize n_points) {
+  gsize n_levels = pyramid_get_n_levels(n_points);
+  gsize size = 0;
+
+  for (gsize level = 0; level < n_levels; ++ level)
+    size += pyramid_get_n_buckets(n_points, level);
+
+  return size;
+}
+
+static void bucket_from_points(pyramid_bucket_t* bucket,
+                               const gdouble* xs, const gdouble* ys, gsize n_points) {
+  gdouble min_x = xs[0], max_x = xs[0];
+  gsize lowest = 0, highest = 0;
+
+  for (gsize i = 1; i < n_points; ++ i) {
+    min_x = MIN(min_x, xs[i]);
+    max_x = MAX(max_x, xs[i]);
+
+    if (ys[i] < ys[lowest])
+      lowest  = i;
+    if (ys[i] > ys[highest])
+      highest = i;
+  }
+
+  gsize first  = MIN(lowest, highest);
+  gsize second = MAX(lowest, highest);
+
+  *bucket = (pyramid_bucket_t) {
+    min_x, max_x,
+    xs[first ], ys[first ],
+    xs[second], ys[second]
+  };
+}
+
+// Bucket of both halves is found from their extremes alone, ties are
+// resolved the same way as in `bucket_from_points`: earlier point wins
+static void bucket_merge(pyramid_bucket_t* bucket,
+                         const pyramid_bucket_t* left, const pyramid_bucket_t* right) {
+  const gdouble xs[4] = { left->first_x, left->second_x, right->first_x, right->second_x };
+  const gdouble ys[4] = { left->first_y, left->second_y, right->first_y, right->second_y };
+
+  int lowest = 0, highest = 0;
+
+  for (int i = 1; i < 4; ++ i) {
+    if (ys[i] < ys[lowest])
+      lowest  = i;
+    if (ys[i] > ys[highest])
+      highest = i;
+  }
+
+  int first  = MIN(lowest, highest);
+  int second = MAX(lowest, highest);
+
+  *bucket = (pyramid_bucket_t) {
+    MIN(left->min_x, right->min_x), MAX(left->max_x, right->max_x),
+    xs[first ], ys[first ],
+    xs[second], ys[second]
+  };
+}
+
+// Builds `index`-th bucket of `level` from the points or from the level
+// below, which has to be up to date. Pyramid covers `n_points` points
+static void build_bucket(pyramid_t* pyramid, path_t* path,
+                         gsize level, gsize index, gsize n_points) {
+  pyramid_bucket_t* bucket = &pyramid->levels[level][index];
+
+  if (level == 0) {
+    gsize from   = index * PYRAMID_BUCKET_SIZE;
+    gsize n_read = MIN(PYRAMID_BUCKET_SIZE, n_points - from);
+
+    if (path->compact == NULL) {
+      bucket_from_points(bucket, path->xs + from, path->ys + from, n_read);
+      return;
+    }
+
+    gdouble xs[PYRAMID_BUCKET_SIZE], ys[PYRAMID_BUCKET_SIZE];
+    path_get_points(path, from, n_read, xs, ys);
+
+    bucket_from_points(bucket, xs, ys, n_read);
+    return;
+  }
+
+  const pyramid_bucket_t* below = pyramid->levels[level - 1];
+  gsize n_below = pyramid_get_n_buckets(n_points, level - 1);
+
+  // Last bucket may have only one half
+  if (2 * index + 1 < n_below)
+    bucket_merge(bucket, &below[2 * index], &below[2 * index + 1]);
+  else
+    *bucket = below[2 * index];
+}
+
+// Mapped buckets can't be reallocated, so all of them are copied
+static void pyramid_copy_mapped(pyramid_t* pyramid) {
+  for (gsize level = 0; level < pyramid->n_levels; ++ level) {
+    gsize n_buckets = pyramid_get_n_buckets(pyramid->n_points, level);
+
+    pyramid_bucket_t* buckets = g_new(pyramid_bucket_t, n_buckets);
+    memcpy(buckets, pyramid->levels[level], n_buckets * sizeof(pyramid_bucket_t));
+
+    pyramid->levels    [level] = buckets;
+    pyramid->capacities[level] = n_buckets;
+  }
+
+  pyramid->is_mapped = FALSE;
+}
+
+static void reserve_level(pyramid_t* pyramid, gsize level, gsize n_buckets) {
+  if (n_buckets <= pyramid->capacities[level])
+    return;
+
+  pyramid->capacities[level] = MAX(n_buckets, 2 * pyramid->capacities[level]);
+  pyramid->levels[level] = g_renew(pyramid_bucket_t, pyramid->levels[level],
+                                   pyramid->capacities[level]);
+}
+
+// Brings pyramid up to date with `path`, buckets that only have points
+// covered already are left as they are
+static void pyramid_update(pyramid_t* pyramid, path_t* path) {
+  gsize n_points = path->n_points;
+  gsize n_levels = pyramid_get_n_levels(n_points);
+
+  if (pyramid->is_mapped)
+    pyramid_copy_mapped(pyramid);
+
+  // First bucket of each level that has new points, the ones
+  // before it only have old points, so they are up to date
+  gsize first = pyramid->n_points / PYRAMID_BUCKET_SIZE;
+
+  for (gsize level = 0; level < n_levels; ++ level) {
+    // Level that hasn't been there before is built whole
+    if (level >= pyramid->n_levels)
+      first = 0;
+
+    gsize n_buckets = pyramid_get_n_buckets(n_points, level);
+    reserve_level(pyramid, level, n_buckets);
+
+    for (gsize i = first; i < n_buckets; ++ i)
+      build_bucket(pyramid, path, level, i, n_points);
+
+    first /= 2;
+  }
+
+  pyramid->n_points = n_points;
+  pyramid->n_levels = n_levels;
+}
+
+const pyramid_t* pyramid_get(path_t* path) {
+  // Pyramid path had before it got a window is of no use anymore
+  if (path->window_size != 0 && path->pyramid != NULL) {
+    pyramid_free(path->pyramid);
+    path->pyramid = NULL;
+  }
+
+  if (path->n_points < PYRAMID_MIN_POINTS || path->window_size != 0)
+    return NULL;
+
+  pyramid_t* pyramid = path->pyramid;
+
+  if (pyramid == NULL)
+    pyramid = path->pyramid = g_new0(pyramid_t, 1);
+  else if (pyramid->n_points == path->n_points)
+    return pyramid;
+
+  pyramid_update(pyramid, path);
+  return pyramid;
+}
+
+void pyramid_attach_mapped(path_t* path, pyramid_bucket_t* buckets) {
+  g_return_if_fail(path->pyramid == NULL);
+
+  pyramid_t* pyramid = path->pyramid = g_new0(pyramid_t, 1);
+
+  pyramid->n_points  = path->n_points;
+  pyramid->n_levels  = pyramid_get_n_levels(path->n_points);
+  pyramid->is_mapped = TRUE;
+
+  // Levels go one after another, starting from the lowest one
+  for (gsize level = 0; level < pyramid->n_levels; ++ level) {
+    gsize n_buckets = pyramid_get_n_buckets(path->n_points, level);
+
+    pyramid->levels    [level] = buckets;
+    pyramid->capacities[level] = n_buckets;
+
+    buckets += n_buckets;
+  }
+}
+
+static void collect_bucket(const pyramid_t* pyramid, path_t* path,
+                           const transform_t* transform,
+                           gsize level, gsize index, polyline_t* polyline) {
+  const pyramid_bucket_t* bucket = &pyramid->levels[level][index];
+
+  // Bucket within one pixel column is a vertical line between it's extremes
+  if (floor(transform_x(transform, bucket->min_x)) ==
+      floor(transform_x(transform, bucket->max_x))) {
+    polyline_append(polyline, transform_x(transform, bucket->first_x),
+                              transform_y(transform, bucket->first_y));
+
+    if (bucket->second_x != bucket->first_x || bucket->second_y != bucket->first_y)
+      polyline_append(polyline, transform_x(transform, bucket->second_x),
+                                transform_y(transform, bucket->second_y));
+    return;
+  }
+
+  // Points themselves are only read where even the smallest buckets are too wide
+  if (level == 0) {
+    gsize from     = index * PYRAMID_BUCKET_SIZE;
+    gsize n_points = MIN(PYRAMID_BUCKET_SIZE, pyramid->n_points - from);
+
+    polyline_reserve(polyline, polyline->n_points + n_points);
+
+    transform_path_points(transform, path, from, n_points,
+                          polyline->xs + polyline->n_points,
+                          polyline->ys + polyline->n_points);
+
+    polyline->n_points += n_points;
+    return;
+  }
+
+  gsize n_below = pyramid_get_n_buckets(pyramid->n_points, level - 1);
+
+  collect_bucket(pyramid, path, transform, level - 1, 2 * index, polyline);
+
+  if (2 * index + 1 < n_below)
+    collect_bucket(pyramid, path, transform, level - 1, 2 * index + 1, polyline);
+}
+
+void pyramid_collect(const pyramid_t* pyramid, path_t* path,
+                     const transform_t* transform, polyline_t* polyline) {
+  g_return_if_fail(pyramid->n_points == path->n_points);
+
+  if (pyramid->n_points == 0)
+    return;
+
+  collect_bucket(pyramid, path, transform, pyramid->n_levels - 1, 0, polyline);
+}
+
+void pyramid_update_point(pyramid_t* pyramid, path_t* path, gsize index) {
+  // Points that aren't covered yet are going to be built anyway
+  if (index >= pyramid->n_points)
+    return;
+
+  // Mapping is read-only and snapshots may share it's buckets
+  if (pyramid->is_mapped)
+    pyramid_copy_mapped(pyramid);
+
+  gsize bucket = index / PYRAMID_BUCKET_SIZE;
+
+  for (gsize level = 0; level < pyramid->n_levels; ++ level, bucket /= 2)
+    build_bucket(pyramid, path, level, bucket, pyramid->n_points);
+}
+
+void pyramid_truncate(pyramid_t* pyramid, gsize n_points) {
+  pyramid->n_points = MIN(pyramid->n_points, n_points);
+}
+
+void pyramid_free(pyramid_t* pyramid) {
+  if (!pyramid->is_mapped)
+    for (gsize level = 0; level < PYRAMID_MAX_LEVELS; ++ level)
+      g_free(pyramid->levels[level]);
+
+  g_free(pyramid);
+}
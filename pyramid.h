@@ -0,0 +1,96 @@
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+#include "lod.h"
+
+/*  Min/max pyramid of a path, for paths far too big to be scanned
+ *  every time they have to be decimated
+ *
+ *  Points are split into buckets of `PYRAMID_BUCKET_SIZE` consecutive
+ *  points, every next level has buckets twice as big, up to the one
+ *  that covers the whole path:
+ *
+ *      level 2   [               0               ]
+ *      level 1   [       0       ][       1       ]
+ *      level 0   [   0   ][   1   ][   2   ][   3   ]
+ *      points     0 ... 63 64 ...
+ *
+ *  Bucket remembers it's extents in X and it's lowest and highest
+ *  points. Bucket that falls into one pixel column is drawn as these
+ *  two points, that is as a vertical line, just like all of it's
+ *  points would be. So LOD is collected from the top, going down
+ *  only into the buckets that are wider than a pixel, which picks
+ *  the level matching pixel density in every part of the path, and
+ *  points themselves are only read where there are few of them.
+ *
+ *  Buckets only depend on the points in them, so appended points only
+ *  update the last bucket of each level and add new ones.
+ *  */
+
+// Points in the buckets of level 0, project files depend on it
+#define PYRAMID_BUCKET_SIZE 64
+
+// Smaller paths are decimated straight from their points
+#define PYRAMID_MIN_POINTS (1 << 16)
+
+// Layout is a part of project file format (see project.h)
+typedef struct {
+  gdouble min_x, max_x;       // <-- Extents of bucket's points in X
+  gdouble first_x , first_y;  // <-- The lowest and the highest points, in
+  gdouble second_x, second_y; //     the same order they have in the path
+} pyramid_bucket_t;
+
+// No path has 2^64 points, so there can't be more levels than that
+#define PYRAMID_MAX_LEVELS 64
+
+typedef struct pyramid {
+  // Buckets are up to date for this many first points of the path,
+  // buckets of the points after them are (re)built on the next use
+  gsize n_points;
+  gsize n_levels;
+
+  pyramid_bucket_t* levels    [PYRAMID_MAX_LEVELS];
+  gsize             capacities[PYRAMID_MAX_LEVELS];
+
+  // Buckets are borrowed from the store's `mapping` rather than owned,
+  // they are copied to the heap as soon as some of them has to change
+  gboolean is_mapped;
+} pyramid_t;
+
+// Number of buckets on `level` of pyramid over `n_points` points
+gsize pyramid_get_n_buckets(gsize n_points, gsize level);
+
+// Number of levels of pyramid over `n_points` points
+gsize pyramid_get_n_levels(gsize n_points);
+
+// Number of buckets on all the levels together
+gsize pyramid_get_size(gsize n_points);
+
+// Returns pyramid of `path`, it's updated for points appended since the
+// last call. Returns NULL for paths smaller than `PYRAMID_MIN_POINTS`
+// and for paths with a window: every point dropped from the front moves
+// all the others to different buckets, so their pyramid would be rebuilt
+// whole on every frame, that is read all the points just like LOD does
+// without it. Such paths are decimated straight from their points
+const pyramid_t* pyramid_get(path_t* path);
+
+// Makes `path` use buckets of all the levels (one after another, as
+// they are in project files) from the store's `mapping` without copying
+void pyramid_attach_mapped(path_t* path, pyramid_bucket_t* buckets);
+
+// Appends points of `path` that end up in different pixel columns after
+// `transform` to `polyline`, in screen space (see above). It's meant to
+// be decimated further, a column may get a few points from each bucket
+void pyramid_collect(const pyramid_t* pyramid, path_t* path,
+                     const transform_t* transform, polyline_t* polyline);
+
+// Have to be called when points of the path change, but not when points
+// are appended: `index`-th point was moved...
+void pyramid_update_point(pyramid_t* pyramid, path_t* path, gsize index);
+
+// ...or all the points from `n_points`-th on have changed or moved
+void pyramid_truncate(pyramid_t* pyramid, gsize n_points);
+
+void pyramid_free(pyramid_t* pyramid);
+
+#endif
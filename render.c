@@ -0,0 +1,1211 @@
+#include "render.h"
+#include "lod.h"
+#include "segment_index.h"
+
+#include <math.h>
+#include <string.h>
+
+// Draw a line from (from_x, from_y) to (to_x, to_y)
+void cairo_line(cairo_t* cr, double from_x, double from_y, double to_x, double to_y) {
+  cairo_move_to(cr, from_x, from_y);
+  cairo_line_to(cr, to_x, to_y);
+}
+
+// Grid lines closer than this many pixels are thinned out
+#define MIN_GRID_STEP 4
+
+// Grid has a line at every whole coordinate, but when they get too
+// dense only every 10th (100th, ...) of them is drawn. Returns 0 if
+// `scale` isn't a positive number: area is no larger than the padding
+static gdouble grid_step(gdouble scale) {
+  if (!isfinite(scale) || scale <= 0.0)
+    return 0.0;
+
+  gdouble step = 1.0;
+
+  while (step * scale < MIN_GRID_STEP)
+    step *= 10.0;
+
+  return step;
+}
+
+void draw_grid(cairo_t* cr, const bounds_t* viewport,
+               int padding,
+               int width , int height,
+               GdkRGBA* grid_color) {
+
+  transform_t transform = transform_for_viewport(viewport, width, height, padding);
+
+  gdouble step_x = grid_step(  transform.scale_x);
+  gdouble step_y = grid_step(- transform.scale_y);
+
+  // There's no room to draw it
+  if (step_x == 0.0 || step_y == 0.0)
+    return;
+
+  cairo_set_source_rgba(cr,
+                        grid_color->red , grid_color->green,
+                        grid_color->blue, grid_color->alpha);
+
+  for (gdouble i = ceil(viewport->min.x / step_x); i <= floor(viewport->max.x / step_x); ++ i) {
+    double x = transform_x(&transform, i * step_x);
+    cairo_line(cr, x, padding, x, height - padding);
+  }
+
+  for (gdouble i = ceil(viewport->min.y / step_y); i <= floor(viewport->max.y / step_y); ++ i) {
+    double y = transform_y(&transform, i * step_y);
+    cairo_line(cr, padding, y, width - padding, y);
+  }
+
+  cairo_stroke(cr);
+}
+
+// Grid rendered off-screen, it only depends on the things below, so
+// it's reused for every frame until one of them changes
+typedef struct {
+  cairo_surface_t* surface;
+
+  bounds_t viewport;
+  int      padding;
+  int      width , height;
+  GdkRGBA  color;
+} grid_layer_t;
+
+// Circle rasterized once and then stamped at every point in
+// `RENDER_MODE_BATCHED`, it's redrawn only when radius or color change
+typedef struct {
+  cairo_surface_t* surface;
+
+  int     radius;
+  GdkRGBA color;
+} marker_t;
+
+// Paths drawn off-screen by `render_frame_layered`, it's on the caller
+// to tell when they changed, only the size is checked here
+typedef struct {
+  cairo_surface_t* surface;
+
+  int width, height;
+
+  // Part of the layer that is out of date (see `renderer_damage_paths`),
+  // it's NULL until anything is damaged for the first time
+  cairo_region_t* damage;
+
+  // Drawing of the layer was cancelled halfway, it's drawn anew next time
+  gboolean is_unfinished;
+} paths_layer_t;
+
+struct renderer {
+  grid_layer_t  grid_layer;
+  paths_layer_t paths_layer;
+  marker_t      marker;
+
+  render_stats_t stats;
+
+  // Drawing stops as soon as it's set (see `renderer_set_cancel_flag`)
+  const gint* is_cancelled;
+
+  // Reused between paths and frames, so they are only reallocated
+  // when some path turns out to be bigger than all previous ones:
+  polyline_t screen_points;   // <-- Points just moved to screen space
+  polyline_t visible_points;  // <-- Visible pieces of a path
+  guint32*   visible_segments;
+  gsize      visible_segments_capacity;
+
+  // Tiles of the last tiled frame (see `draw_paths_and_points_tiled`)
+  struct tile*      tiles;
+  gsize             tiles_capacity;
+
+  // Surfaces tiles are drawn into, one for every place in the grid
+  // of tiles, they are reused while the size of tile stays the same
+  cairo_surface_t** tile_surfaces;
+  gsize             n_tile_surfaces;
+};
+
+renderer_t* renderer_new(void) {
+  return g_new0(renderer_t, 1);
+}
+
+void renderer_free(renderer_t* renderer) {
+  if (renderer->grid_layer.surface != NULL)
+    cairo_surface_destroy(renderer->grid_layer.surface);
+
+  if (renderer->paths_layer.surface != NULL)
+    cairo_surface_destroy(renderer->paths_layer.surface);
+
+  if (renderer->paths_layer.damage != NULL)
+    cairo_region_destroy(renderer->paths_layer.damage);
+
+  if (renderer->marker.surface != NULL)
+    cairo_surface_destroy(renderer->marker.surface);
+
+  polyline_clear(&renderer->screen_points);
+  polyline_clear(&renderer->visible_points);
+
+  g_free(renderer->visible_segments);
+
+  for (gsize i = 0; i < renderer->n_tile_surfaces; ++ i)
+    if (renderer->tile_surfaces[i] != NULL)
+      cairo_surface_destroy(renderer->tile_surfaces[i]);
+
+  g_free(renderer->tile_surfaces);
+  g_free(renderer->tiles);
+
+  g_free(renderer);
+}
+
+void renderer_reset_stats(renderer_t* renderer) {
+  renderer->stats = (render_stats_t) { 0 };
+}
+
+const render_stats_t* renderer_get_stats(renderer_t* renderer) {
+  return &renderer->stats;
+}
+
+void renderer_set_cancel_flag(renderer_t* renderer, const gint* is_cancelled) {
+  renderer->is_cancelled = is_cancelled;
+}
+
+static gboolean is_frame_cancelled(const renderer_t* renderer) {
+  return renderer->is_cancelled != NULL && g_atomic_int_get(renderer->is_cancelled);
+}
+
+static void count_cache_use(renderer_t* renderer, gboolean is_hit) {
+  if (is_hit)
+    ++ renderer->stats.n_cache_hits;
+  else
+    ++ renderer->stats.n_cache_misses;
+}
+
+static void count_allocation(renderer_t* renderer, gboolean is_allocated) {
+  if (is_allocated)
+    ++ renderer->stats.n_allocations;
+}
+
+// Surfaces are reused from frame to frame, so they're cleared before drawing
+static void clear_surface(cairo_t* cr) {
+  cairo_save(cr);
+
+  cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+  cairo_paint(cr);
+
+  cairo_restore(cr);
+}
+
+void draw_grid_layer(renderer_t* renderer, cairo_t* cr,
+                     const bounds_t* viewport,
+                     int padding,
+                     int width , int height,
+                     GdkRGBA* grid_color) {
+  grid_layer_t* grid_layer = &renderer->grid_layer;
+
+  gboolean is_valid =
+    grid_layer->surface != NULL &&
+    memcmp(&grid_layer->viewport, viewport, sizeof(bounds_t)) == 0 &&
+    grid_layer->padding == padding &&
+    grid_layer->width   == width   && grid_layer->height == height &&
+    gdk_rgba_equal(&grid_layer->color, grid_color);
+
+  count_cache_use(renderer, is_valid);
+
+  gint64 start = g_get_monotonic_time();
+
+  if (!is_valid) {
+    // Panning and zooming only redraw the grid into the same surface
+    gboolean is_resized = grid_layer->surface == NULL ||
+      grid_layer->width != width || grid_layer->height != height;
+
+    count_allocation(renderer, is_resized);
+
+    if (is_resized) {
+      if (grid_layer->surface != NULL)
+        cairo_surface_destroy(grid_layer->surface);
+
+      grid_layer->surface = cairo_surface_create_similar(cairo_get_target(cr),
+                                                         CAIRO_CONTENT_COLOR_ALPHA,
+                                                         width, height);
+    }
+
+    cairo_t* grid_cr = cairo_create(grid_layer->surface);
+
+    clear_surface(grid_cr);
+    draw_grid(grid_cr, viewport, padding, width, height, grid_color);
+
+    cairo_destroy(grid_cr);
+
+    grid_layer->viewport = *viewport;
+    grid_layer->padding  = padding;
+    grid_layer->width    = width;
+    grid_layer->height   = height;
+    grid_layer->color    = *grid_color;
+  }
+
+  cairo_set_source_surface(cr, grid_layer->surface, 0, 0);
+  cairo_paint(cr);
+
+  renderer->stats.cairo_time += g_get_monotonic_time() - start;
+}
+
+static cairo_surface_t* get_marker_surface(renderer_t* renderer, cairo_t* cr,
+                                           int radius, GdkRGBA* color) {
+  marker_t* marker = &renderer->marker;
+
+  gboolean is_valid = marker->surface != NULL && marker->radius == radius &&
+    gdk_rgba_equal(&marker->color, color);
+
+  count_cache_use(renderer, is_valid);
+
+  if (is_valid)
+    return marker->surface;
+
+  // Leave a pixel around the circle for antialiasing
+  int size = 2 * radius + 2;
+
+  // New color is drawn over the old one in the same surface
+  gboolean is_resized = marker->surface == NULL || marker->radius != radius;
+  count_allocation(renderer, is_resized);
+
+  if (is_resized) {
+    if (marker->surface != NULL)
+      cairo_surface_destroy(marker->surface);
+
+    marker->surface = cairo_surface_create_similar(cairo_get_target(cr),
+                                                   CAIRO_CONTENT_COLOR_ALPHA,
+                                                   size, size);
+  }
+
+  marker->radius = radius;
+  marker->color  = *color;
+
+  cairo_t* marker_cr = cairo_create(marker->surface);
+  clear_surface(marker_cr);
+
+  cairo_set_source_rgba(marker_cr,
+                        color->red , color->green,
+                        color->blue, color->alpha);
+
+  cairo_arc(marker_cr, size / 2.0, size / 2.0, radius, 0, 2 * G_PI);
+  cairo_fill(marker_cr);
+
+  cairo_destroy(marker_cr);
+  return marker->surface;
+}
+
+// Moves points from `from` up to `to` (inclusive) into `screen_points`
+static void transform_to_screen_points(renderer_t* renderer,
+                                       path_t* path, const transform_t* transform,
+                                       gsize from, gsize to) {
+  polyline_t* screen_points = &renderer->screen_points;
+  count_allocation(renderer, polyline_reserve(screen_points, to - from + 1));
+
+  transform_path_points(transform, path, from, to - from + 1,
+                        screen_points->xs, screen_points->ys);
+
+  screen_points->n_points = to - from + 1;
+}
+
+static void draw_path_segments(renderer_t* renderer, cairo_t* cr, path_t* path,
+                               const transform_t* transform,
+                               int             point_radius,
+                               gdouble           line_width,
+                               GdkRGBA*         point_color,
+                               GdkRGBA*          line_color) {
+  // Path has at least one point, so they are set before the last one is drawn
+  gdouble x_from = 0.0, y_from = 0.0;
+
+  transform_to_screen_points(renderer, path, transform, 0, path->n_points - 1);
+  const polyline_t* screen_points = &renderer->screen_points;
+
+  // Every point goes to cairo, it's all counted as cairo's time
+  gint64 start = g_get_monotonic_time();
+
+  for (gsize j = 0; j < path->n_points; ++ j) {
+    double x_real = screen_points->xs[j];
+    double y_real = screen_points->ys[j];
+
+    // Draw a line
+    if (j != 0) {
+      cairo_set_source_rgba(cr,
+                            line_color->red , line_color->green,
+                            line_color->blue, line_color->alpha);
+
+      cairo_set_line_width(cr, line_width);
+      cairo_line(cr, x_from, y_from, x_real, y_real);
+
+      cairo_stroke(cr);
+    }
+
+    if (j != 0) {
+      // Draw a point
+      cairo_set_source_rgba(cr,
+                            point_color->red , point_color->green,
+                            point_color->blue, point_color->alpha);
+
+      cairo_arc(cr, x_from, y_from, point_radius, 0, 2 * 3.1415926);
+
+      cairo_fill(cr);
+    }
+
+    x_from = x_real;
+    y_from = y_real;
+  }
+
+  // Draw the last point
+  cairo_set_source_rgba(cr,
+                        point_color->red , point_color->green,
+                        point_color->blue, point_color->alpha);
+
+  cairo_arc(cr, x_from, y_from, point_radius, 0, 2 * 3.1415926);
+
+  cairo_fill(cr);
+
+  renderer->stats.cairo_time += g_get_monotonic_time() - start;
+
+  renderer->stats.n_points_submitted   += path->n_points;
+  renderer->stats.n_segments_submitted += path->n_points - 1;
+}
+
+// Paths with more points than this many per pixel column are
+// decimated with `lod_get` before drawing in `RENDER_MODE_BATCHED`
+#define LOD_POINTS_PER_COLUMN 2
+
+static void draw_polyline_batched(renderer_t* renderer, cairo_t* cr,
+                                  const polyline_t*  polyline,
+                                  int            point_radius,
+                                  gdouble          line_width,
+                                  GdkRGBA*        point_color,
+                                  GdkRGBA*         line_color) {
+  gint64 start = g_get_monotonic_time();
+
+  // Whole path goes to the rasterizer in one stroke
+  gboolean is_new_piece = TRUE;
+
+  gsize n_points = 0, n_pieces = 0;
+
+  for (gsize j = 0; j < polyline->n_points; ++ j) {
+    if (polyline_is_break(polyline, j)) {
+      is_new_piece = TRUE;
+      continue;
+    }
+
+    if (is_new_piece) {
+      cairo_move_to(cr, polyline->xs[j], polyline->ys[j]);
+      ++ n_pieces;
+    } else
+      cairo_line_to(cr, polyline->xs[j], polyline->ys[j]);
+
+    is_new_piece = FALSE;
+    ++ n_points;
+  }
+
+  renderer->stats.n_points_submitted   += n_points;
+  renderer->stats.n_segments_submitted += n_points - n_pieces;
+
+  cairo_set_source_rgba(cr,
+                        line_color->red , line_color->green,
+                        line_color->blue, line_color->alpha);
+
+  cairo_set_line_width(cr, line_width);
+  cairo_stroke(cr);
+
+  if (point_radius <= 0) {
+    renderer->stats.cairo_time += g_get_monotonic_time() - start;
+    return;
+  }
+
+  cairo_surface_t* marker_surface =
+    get_marker_surface(renderer, cr, point_radius, point_color);
+
+  double marker_offset = point_radius + 1;
+
+  // And every point is just a copy of the same small surface
+  for (gsize j = 0; j < polyline->n_points; ++ j) {
+    if (polyline_is_break(polyline, j))
+      continue;
+
+    cairo_set_source_surface(cr, marker_surface,
+                             round(polyline->xs[j]) - marker_offset,
+                             round(polyline->ys[j]) - marker_offset);
+    cairo_paint(cr);
+  }
+
+  renderer->stats.cairo_time += g_get_monotonic_time() - start;
+}
+
+// Same as `lod_get`, but it also counts if LOD was there already
+static const lod_t* get_lod(renderer_t* renderer, path_t* path,
+                            const transform_t* transform) {
+  const lod_t* lod = path->lod;
+
+  count_cache_use(renderer, lod != NULL && lod->version == path->version &&
+                            transform_equal(&lod->transform, transform));
+
+  gsize lod_capacity     = lod == NULL ? 0 : lod->polyline.capacity;
+  gsize scratch_capacity = renderer->screen_points.capacity;
+
+  count_allocation(renderer, lod == NULL);
+
+  // LOD is rebuilt in place, it's arrays only grow when they are too small
+  lod = lod_get(path, transform, &renderer->screen_points);
+
+  count_allocation(renderer, lod->polyline.capacity != lod_capacity);
+  count_allocation(renderer, renderer->screen_points.capacity != scratch_capacity);
+
+  return lod;
+}
+
+// Same as `segment_index_get`, but it also counts if index was there already
+static const segment_index_t* get_segment_index(renderer_t* renderer, path_t* path) {
+  // Index is rebuilt in place, so it's version is checked before that
+  gboolean is_hit = path->segment_index != NULL &&
+    path->segment_index->version == path->version;
+
+  gboolean is_new = path->segment_index == NULL;
+
+  gsize capacity = is_new ? 0 :
+    path->segment_index->cell_starts_capacity + path->segment_index->segments_capacity +
+    path->segment_index->changed_capacity;
+
+  const segment_index_t* index = segment_index_get(path);
+
+  if (index != NULL) {
+    count_allocation(renderer, is_new);
+    count_allocation(renderer, index->cell_starts_capacity + index->segments_capacity +
+                               index->changed_capacity != capacity);
+  }
+
+  // Paths that can't be indexed don't count
+  if (index != NULL)
+    count_cache_use(renderer, is_hit);
+
+  return index;
+}
+
+// Draws path that is visible as a whole
+static void draw_path_batched(renderer_t* renderer, cairo_t* cr, path_t* path,
+                              const transform_t* transform,
+                              int                    width,
+                              int             point_radius,
+                              gdouble           line_width,
+                              GdkRGBA*         point_color,
+                              GdkRGBA*          line_color) {
+  if (path->n_points > (gsize) LOD_POINTS_PER_COLUMN * width) {
+    const lod_t* lod = get_lod(renderer, path, transform);
+
+    draw_polyline_batched(renderer, cr, &lod->polyline,
+                          point_radius, line_width, point_color, line_color);
+    return;
+  }
+
+  transform_to_screen_points(renderer, path, transform, 0, path->n_points - 1);
+
+  draw_polyline_batched(renderer, cr, &renderer->screen_points,
+                        point_radius, line_width, point_color, line_color);
+}
+
+// Draws path that is only partially visible, only segments found
+// in `visible` area by path's spatial index are ever looked at
+static void draw_path_culled(renderer_t* renderer, cairo_t* cr, path_t* path,
+                             const transform_t* transform,
+                             const bounds_t*      visible,
+                             int                    width,
+                             int             point_radius,
+                             gdouble           line_width,
+                             GdkRGBA*         point_color,
+                             GdkRGBA*          line_color) {
+  const segment_index_t* index = get_segment_index(renderer, path);
+
+  if (index == NULL) {
+    draw_path_batched(renderer, cr, path, transform, width,
+                      point_radius, line_width, point_color, line_color);
+    return;
+  }
+
+  gsize segments_capacity = renderer->visible_segments_capacity;
+
+  gsize n_segments =
+    segment_index_query(index, path, visible,
+                        &renderer->visible_segments,
+                        &renderer->visible_segments_capacity);
+
+  count_allocation(renderer, renderer->visible_segments_capacity != segments_capacity);
+
+  if (n_segments == 0)
+    return;
+
+  const guint32* visible_segments = renderer->visible_segments;
+
+  polyline_t* screen_points  = &renderer->screen_points;
+  polyline_t* visible_points = &renderer->visible_points;
+
+  gboolean is_dense = n_segments > (gsize) LOD_POINTS_PER_COLUMN * width;
+
+  visible_points->n_points = 0;
+
+  // Every piece of k segments gives at most k + 1 points and a break,
+  // so with room reserved here appends below never reallocate
+  count_allocation(renderer, polyline_reserve(visible_points, 3 * n_segments));
+
+  // Consecutive segments make up one continuous piece of the path
+  for (gsize i = 0; i < n_segments; ) {
+    gsize from = visible_segments[i];
+
+    while (i + 1 < n_segments && visible_segments[i + 1] == visible_segments[i] + 1)
+      ++ i;
+
+    gsize to = visible_segments[i ++] + 1;
+
+    transform_to_screen_points(renderer, path, transform, from, to);
+
+    if (visible_points->n_points != 0)
+      polyline_append_break(visible_points);
+
+    if (is_dense)
+      lod_decimate(visible_points, screen_points->xs, screen_points->ys,
+                   screen_points->n_points);
+    else
+      for (gsize j = 0; j < screen_points->n_points; ++ j)
+        polyline_append(visible_points, screen_points->xs[j], screen_points->ys[j]);
+  }
+
+  draw_polyline_batched(renderer, cr, visible_points,
+                        point_radius, line_width, point_color, line_color);
+}
+
+// Part of data space that ends up in the rectangle from (`left`, `top`)
+// to (`right`, `bottom`) of the screen, with `margin` pixels of room
+// around it for lines and points that stick out
+static bounds_t get_visible_area(const transform_t* transform,
+                                 gdouble left , gdouble top,
+                                 gdouble right, gdouble bottom,
+                                 gdouble margin) {
+  return (bounds_t) {
+    { transform_inverse_x(transform, left   - margin),
+      transform_inverse_y(transform, bottom + margin) },
+    { transform_inverse_x(transform, right  + margin),
+      transform_inverse_y(transform, top    - margin) }
+  };
+}
+
+// Dense paths that are visible as a whole are drawn from their LOD even
+// where only part of them is in `visible` (that is, in tiles): LOD is
+// built once for the whole picture, and straight from the pyramid for
+// huge paths, which is far cheaper than indexing all of their segments
+static gboolean is_drawn_whole(path_t* path, const bounds_t* visible,
+                               const bounds_t* picture, int width) {
+  return bounds_contain(visible, &path->bounds) ||
+    (path->n_points > (gsize) LOD_POINTS_PER_COLUMN * width &&
+     bounds_contain(picture, &path->bounds));
+}
+
+// Draws every path of `store` that gets into `visible` part of data
+// space, `picture` is the visible part of the whole picture and `width`
+// is it's width, they are the same as `visible` unless it's a tile
+static void draw_paths_in_area(renderer_t* renderer, cairo_t* cr,
+                               point_store_t*          store,
+                               render_mode_t            mode,
+                               const transform_t*  transform,
+                               const bounds_t*       visible,
+                               const bounds_t*       picture,
+                               int                     width,
+                               int              point_radius,
+                               gdouble            line_width,
+                               GdkRGBA*          point_color,
+                               GdkRGBA*           line_color) {
+  render_stats_t* stats = &renderer->stats;
+
+  for (gsize i = 0; i < store->n_paths && !is_frame_cancelled(renderer); ++ i) {
+    path_t* path = store->paths[i];
+    if (path->n_points == 0 || !bounds_intersect(&path->bounds, visible))
+      continue;
+
+    // Whatever isn't spent in cairo is spent on the points
+    gint64 start      = g_get_monotonic_time();
+    gint64 cairo_time = stats->cairo_time;
+
+    if (mode == RENDER_MODE_SEGMENTS)
+      draw_path_segments(renderer, cr, path, transform, point_radius,
+                         line_width, point_color, line_color);
+    else if (is_drawn_whole(path, visible, picture, width))
+      draw_path_batched(renderer, cr, path, transform, width, point_radius,
+                        line_width, point_color, line_color);
+    else
+      draw_path_culled(renderer, cr, path, transform, visible, width, point_radius,
+                       line_width, point_color, line_color);
+
+    stats->data_time += g_get_monotonic_time() - start - (stats->cairo_time - cairo_time);
+  }
+}
+
+// Counts all the points that could have been drawn, whether they were or not
+static void count_store(renderer_t* renderer, point_store_t* store) {
+  for (gsize i = 0; i < store->n_paths; ++ i) {
+    gsize n_points = store->paths[i]->n_points;
+
+    renderer->stats.n_points   += n_points;
+    renderer->stats.n_segments += n_points == 0 ? 0 : n_points - 1;
+  }
+}
+
+void draw_paths_and_points(renderer_t* renderer, cairo_t* cr,
+                           point_store_t*           store,
+                           render_mode_t             mode,
+                           const bounds_t*       viewport,
+                           int                    padding,
+                           int         width, int  height,
+                           int               point_radius,
+                           gdouble             line_width,
+                           GdkRGBA*           point_color,
+                           GdkRGBA*            line_color) {
+
+  transform_t transform = transform_for_viewport(viewport, width, height, padding);
+
+  bounds_t visible = get_visible_area(&transform, 0, 0, width, height,
+                                      point_radius + line_width / 2);
+
+  count_store(renderer, store);
+
+  draw_paths_in_area(renderer, cr, store, mode, &transform, &visible, &visible, width,
+                     point_radius, line_width, point_color, line_color);
+}
+
+// Tiles are squares of this many pixels (before device scale)
+#define TILE_SIZE 256
+
+// Everything tiles of one frame share, it's only read while they are drawn
+typedef struct {
+  point_store_t*    store;
+  render_settings_t style;
+  transform_t       transform;
+  bounds_t          visible; // <-- Visible part of the whole picture
+  int               width;
+
+  const gint* is_cancelled; // <-- Cancel flag of the renderer drawing the frame
+
+  gdouble device_scale_x, device_scale_y;
+
+  // Number of tiles that are still being drawn
+  GMutex mutex;
+  GCond  cond;
+  gsize  n_unfinished_tiles;
+} tiled_frame_t;
+
+typedef struct tile {
+  tiled_frame_t* frame;
+
+  int      x    , y;
+  int      width, height;
+  bounds_t visible;
+
+  cairo_surface_t* surface;
+
+  // What tile's thread has spent on it
+  render_stats_t stats;
+} tile_t;
+
+// Every thread of the pool draws tiles with it's own renderer
+static GPrivate tile_renderer = G_PRIVATE_INIT((GDestroyNotify) renderer_free);
+
+static void draw_tile(gpointer data, gpointer user_data) {
+  tile_t*        tile  = data;
+  tiled_frame_t* frame = tile->frame;
+
+  renderer_t* renderer = g_private_get(&tile_renderer);
+  if (renderer == NULL) {
+    renderer = renderer_new();
+    g_private_set(&tile_renderer, renderer);
+  }
+
+  // Tile is drawn in the coordinates of the whole picture, so
+  // every pixel gets exactly what it would get without tiles
+  cairo_t* cr = cairo_create(tile->surface);
+
+  clear_surface(cr);
+  cairo_translate(cr, - tile->x, - tile->y);
+
+  render_settings_t* style = &frame->style;
+
+  renderer_reset_stats(renderer);
+  renderer_set_cancel_flag(renderer, frame->is_cancelled);
+
+  draw_paths_in_area(renderer, cr, frame->store, style->mode, &frame->transform,
+                     &tile->visible, &frame->visible, frame->width,
+                     style->point_radius, style->line_width,
+                     &style->point_color, &style->line_color);
+
+  cairo_destroy(cr);
+
+  tile->stats = renderer->stats;
+
+  g_mutex_lock(&frame->mutex);
+
+  if (-- frame->n_unfinished_tiles == 0)
+    g_cond_signal(&frame->cond);
+
+  g_mutex_unlock(&frame->mutex);
+}
+
+static GThreadPool* get_tile_pool(void) {
+  static GThreadPool* pool = NULL;
+
+  if (g_once_init_enter(&pool)) {
+    GThreadPool* new_pool = g_thread_pool_new(draw_tile, NULL,
+                                              g_get_num_processors(), FALSE, NULL);
+    g_once_init_leave(&pool, new_pool);
+  }
+
+  return pool;
+}
+
+// Builds caches that `draw_paths_in_area` is going to use for `tile`,
+// so tiles only read them and can be drawn in parallel. Returns FALSE
+// if there's nothing to draw in the tile
+static gboolean prepare_tile(renderer_t* renderer, tile_t* tile) {
+  tiled_frame_t* frame = tile->frame;
+  point_store_t* store = frame->store;
+
+  gboolean has_paths = FALSE;
+
+  for (gsize i = 0; i < store->n_paths; ++ i) {
+    path_t* path = store->paths[i];
+    if (path->n_points == 0 || !bounds_intersect(&path->bounds, &tile->visible))
+      continue;
+
+    has_paths = TRUE;
+
+    // It mirrors choices made by `draw_path_culled` and `draw_path_batched`
+    gboolean is_culled =
+      !is_drawn_whole(path, &tile->visible, &frame->visible, frame->width) &&
+      get_segment_index(renderer, path) != NULL;
+
+    if (!is_culled && path->n_points > (gsize) LOD_POINTS_PER_COLUMN * frame->width)
+      get_lod(renderer, path, &frame->transform);
+  }
+
+  return has_paths;
+}
+
+// Surface for the tile in place `slot` of the grid of tiles, surface from
+// the previous frame is reused if it's of the right size and scale
+static cairo_surface_t* get_tile_surface(renderer_t* renderer, gsize slot,
+                                         const tile_t* tile) {
+  tiled_frame_t* frame = tile->frame;
+
+  int width  = ceil(tile->width  * frame->device_scale_x);
+  int height = ceil(tile->height * frame->device_scale_y);
+
+  cairo_surface_t* surface = renderer->tile_surfaces[slot];
+
+  if (surface != NULL) {
+    gdouble scale_x, scale_y;
+    cairo_surface_get_device_scale(surface, &scale_x, &scale_y);
+
+    if (cairo_image_surface_get_width (surface) == width  &&
+        cairo_image_surface_get_height(surface) == height &&
+        scale_x == frame->device_scale_x && scale_y == frame->device_scale_y)
+      return surface;
+
+    cairo_surface_destroy(surface);
+  }
+
+  count_allocation(renderer, TRUE);
+
+  surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+  cairo_surface_set_device_scale(surface, frame->device_scale_x, frame->device_scale_y);
+
+  return renderer->tile_surfaces[slot] = surface;
+}
+
+// Same as `draw_paths_and_points` in `RENDER_MODE_BATCHED`, but picture
+// is split into tiles drawn by `n_threads` threads at once
+static void draw_paths_and_points_tiled(renderer_t* renderer, cairo_t* cr,
+                                        point_store_t*              store,
+                                        const render_settings_t* settings,
+                                        const bounds_t*          viewport,
+                                        int                       padding,
+                                        int            width, int  height) {
+  tiled_frame_t frame = {
+    .store     = store,
+    .style     = *settings,
+    .transform = transform_for_viewport(viewport, width, height, padding),
+    .width     = width,
+
+    .is_cancelled = renderer->is_cancelled
+  };
+
+  cairo_surface_get_device_scale(cairo_get_target(cr),
+                                 &frame.device_scale_x, &frame.device_scale_y);
+
+  g_mutex_init(&frame.mutex);
+  g_cond_init(&frame.cond);
+
+  gdouble margin = settings->point_radius + settings->line_width / 2;
+
+  frame.visible = get_visible_area(&frame.transform, 0, 0, width, height, margin);
+
+  int n_columns = (width  + TILE_SIZE - 1) / TILE_SIZE;
+  int n_rows    = (height + TILE_SIZE - 1) / TILE_SIZE;
+
+  gsize n_slots = n_columns * n_rows;
+
+  if (renderer->tiles_capacity < n_slots) {
+    count_allocation(renderer, TRUE);
+
+    renderer->tiles_capacity = n_slots;
+    renderer->tiles = g_renew(tile_t, renderer->tiles, n_slots);
+  }
+
+  if (renderer->n_tile_surfaces < n_slots) {
+    count_allocation(renderer, TRUE);
+
+    renderer->tile_surfaces = g_renew(cairo_surface_t*, renderer->tile_surfaces, n_slots);
+    memset(renderer->tile_surfaces + renderer->n_tile_surfaces, 0,
+           (n_slots - renderer->n_tile_surfaces) * sizeof(cairo_surface_t*));
+
+    renderer->n_tile_surfaces = n_slots;
+  }
+
+  tile_t* tiles   = renderer->tiles;
+  gsize   n_tiles = 0;
+
+  count_store(renderer, store);
+
+  // Caches are built here, on the calling thread
+  gint64 prepare_start = g_get_monotonic_time();
+
+  for (int row = 0; row < n_rows && !is_frame_cancelled(renderer); ++ row)
+    for (int column = 0; column < n_columns; ++ column) {
+      tile_t* tile = &tiles[n_tiles];
+
+      tile->frame  = &frame;
+      tile->x      = column * TILE_SIZE;
+      tile->y      = row    * TILE_SIZE;
+      tile->width  = MIN(TILE_SIZE, width  - tile->x);
+      tile->height = MIN(TILE_SIZE, height - tile->y);
+
+      tile->visible = get_visible_area(&frame.transform,
+                                       tile->x              , tile->y,
+                                       tile->x + tile->width, tile->y + tile->height,
+                                       margin);
+
+      // Empty tiles are just skipped
+      if (!prepare_tile(renderer, tile))
+        continue;
+
+      tile->surface = get_tile_surface(renderer, row * n_columns + column, tile);
+      ++ n_tiles;
+    }
+
+  renderer->stats.data_time += g_get_monotonic_time() - prepare_start;
+
+  frame.n_unfinished_tiles = n_tiles;
+
+  GThreadPool* pool = get_tile_pool();
+  g_thread_pool_set_max_threads(pool, settings->n_threads, NULL);
+
+  for (gsize i = 0; i < n_tiles; ++ i)
+    g_thread_pool_push(pool, &tiles[i], NULL);
+
+  g_mutex_lock(&frame.mutex);
+
+  while (frame.n_unfinished_tiles != 0)
+    g_cond_wait(&frame.cond, &frame.mutex);
+
+  g_mutex_unlock(&frame.mutex);
+
+  gint64 composite_start = g_get_monotonic_time();
+
+  for (gsize i = 0; i < n_tiles; ++ i) {
+    cairo_set_source_surface(cr, tiles[i].surface, tiles[i].x, tiles[i].y);
+    cairo_rectangle(cr, tiles[i].x, tiles[i].y, tiles[i].width, tiles[i].height);
+    cairo_fill(cr);
+
+    // Caches were prepared and counted above, tiles only reuse them
+    render_stats_t* tile_stats = &tiles[i].stats;
+
+    renderer->stats.data_time            += tile_stats->data_time;
+    renderer->stats.cairo_time           += tile_stats->cairo_time;
+    renderer->stats.n_points_submitted   += tile_stats->n_points_submitted;
+    renderer->stats.n_segments_submitted += tile_stats->n_segments_submitted;
+    renderer->stats.n_allocations        += tile_stats->n_allocations;
+  }
+
+  renderer->stats.cairo_time += g_get_monotonic_time() - composite_start;
+
+  g_mutex_clear(&frame.mutex);
+  g_cond_clear(&frame.cond);
+}
+
+static void draw_paths(renderer_t* renderer, cairo_t* cr,
+                       point_store_t*              store,
+                       const render_settings_t* settings,
+                       const bounds_t*          viewport,
+                       int                       padding,
+                       int            width, int  height) {
+  // Drawing functions take colors by pointer, so they get a copy
+  render_settings_t style = *settings;
+
+  // Only batched mode is tiled, segments mode has no culling,
+  // so every tile would draw all the points all over again
+  if (style.n_threads > 1 && style.mode == RENDER_MODE_BATCHED) {
+    draw_paths_and_points_tiled(renderer, cr, store, &style, viewport, padding, width, height);
+    return;
+  }
+
+  draw_paths_and_points(renderer, cr, store, style.mode, viewport, padding,
+                        width, height, style.point_radius, style.line_width,
+                        &style.point_color, &style.line_color);
+}
+
+void render_frame(renderer_t* renderer, cairo_t* cr,
+                  point_store_t*              store,
+                  const render_settings_t* settings,
+                  const bounds_t*          viewport,
+                  int                       padding,
+                  int            width, int  height) {
+  gint64 start = g_get_monotonic_time();
+
+  render_settings_t style = *settings;
+
+  if (style.is_grid_enabled)
+    draw_grid_layer(renderer, cr, viewport, padding, width, height,
+                    &style.grid_color);
+
+  draw_paths(renderer, cr, store, settings, viewport, padding, width, height);
+
+  renderer->stats.frame_time += g_get_monotonic_time() - start;
+  ++ renderer->stats.n_frames;
+}
+
+// Cairo's default, so joins of batched polylines may stick
+// out of their points by up to this many halves of line width
+#define MITER_LIMIT 10.0
+
+// How far from the points drawing of a path may reach
+static gdouble get_damage_margin(const render_settings_t* settings) {
+  // Markers are snapped to whole pixels and have a pixel of room around
+  // them, and antialiasing smears everything by one more pixel
+  return MAX(settings->point_radius + 1.5, MITER_LIMIT * settings->line_width / 2) + 1;
+}
+
+void render_get_points_area(const render_settings_t* settings,
+                            const bounds_t*          viewport,
+                            int                       padding,
+                            int            width, int  height,
+                            const path_t*                path,
+                            gsize               from, gsize to,
+                            cairo_rectangle_int_t*       area) {
+  g_return_if_fail(from <= to && to < path->n_points);
+
+  transform_t transform = transform_for_viewport(viewport, width, height, padding);
+
+  gdouble left  =  INFINITY, top    =  INFINITY;
+  gdouble right = -INFINITY, bottom = -INFINITY;
+
+  for (gsize i = from; i <= to; ++ i) {
+    point_t point = path_get_point(path, i);
+
+    gdouble x = transform_x(&transform, point.x);
+    gdouble y = transform_y(&transform, point.y);
+
+    left  = MIN(left , x);
+    right = MAX(right, x);
+
+    top    = MIN(top   , y);
+    bottom = MAX(bottom, y);
+  }
+
+  gdouble margin = get_damage_margin(settings);
+
+  // Points far outside of the widget would overflow `int`
+  left   = CLAMP(floor(left   - margin), 0, width );
+  right  = CLAMP(ceil (right  + margin), 0, width );
+  top    = CLAMP(floor(top    - margin), 0, height);
+  bottom = CLAMP(ceil (bottom + margin), 0, height);
+
+  *area = (cairo_rectangle_int_t) { left, top, right - left, bottom - top };
+}
+
+void renderer_damage_paths(renderer_t* renderer, const cairo_region_t* damage) {
+  paths_layer_t* paths_layer = &renderer->paths_layer;
+
+  if (paths_layer->damage == NULL)
+    paths_layer->damage = cairo_region_create();
+
+  cairo_region_union(paths_layer->damage, damage);
+}
+
+// Redraws only the damaged part of paths layer, everything else is left
+// as it was. Returns FALSE without drawing anything if damaged part can't
+// be redrawn alone
+static gboolean draw_damaged_paths(renderer_t* renderer, cairo_t* cr,
+                                   point_store_t*              store,
+                                   const render_settings_t* settings,
+                                   const bounds_t*          viewport,
+                                   int                       padding,
+                                   int            width, int  height,
+                                   const cairo_region_t*      damage) {
+  render_settings_t style = *settings;
+
+  transform_t transform = transform_for_viewport(viewport, width, height, padding);
+
+  cairo_rectangle_int_t extents;
+  cairo_region_get_extents(damage, &extents);
+
+  bounds_t visible = get_visible_area(&transform, extents.x, extents.y,
+                                      extents.x + extents.width,
+                                      extents.y + extents.height,
+                                      get_damage_margin(&style));
+
+  // Decimated paths are drawn from all of their points around, not just
+  // from those in the damaged part, so they can only be redrawn whole
+  if (style.mode == RENDER_MODE_BATCHED)
+    for (gsize i = 0; i < store->n_paths; ++ i) {
+      path_t* path = store->paths[i];
+
+      if (path->n_points > (gsize) LOD_POINTS_PER_COLUMN * width &&
+          bounds_intersect(&path->bounds, &visible))
+        return FALSE;
+    }
+
+  for (int i = 0; i < cairo_region_num_rectangles(damage); ++ i) {
+    cairo_rectangle_int_t rectangle;
+    cairo_region_get_rectangle(damage, i, &rectangle);
+
+    cairo_rectangle(cr, rectangle.x, rectangle.y, rectangle.width, rectangle.height);
+  }
+
+  cairo_clip(cr);
+  clear_surface(cr);
+
+  count_store(renderer, store);
+
+  // Damage is small, so it's not worth splitting it into tiles
+  draw_paths_in_area(renderer, cr, store, style.mode, &transform, &visible, &visible,
+                     width, style.point_radius, style.line_width,
+                     &style.point_color, &style.line_color);
+
+  return TRUE;
+}
+
+void render_frame_layered(renderer_t* renderer, cairo_t* cr,
+                          point_store_t*              store,
+                          const render_settings_t* settings,
+                          const bounds_t*          viewport,
+                          int                       padding,
+                          int            width, int  height,
+                          gboolean         are_paths_changed) {
+  gint64 start = g_get_monotonic_time();
+
+  render_settings_t style = *settings;
+
+  if (style.is_grid_enabled)
+    draw_grid_layer(renderer, cr, viewport, padding, width, height,
+                    &style.grid_color);
+
+  paths_layer_t* paths_layer = &renderer->paths_layer;
+
+  gboolean is_valid = !are_paths_changed && !paths_layer->is_unfinished &&
+    paths_layer->surface != NULL &&
+    paths_layer->width == width && paths_layer->height == height;
+
+  if (paths_layer->damage != NULL) {
+    cairo_rectangle_int_t layer = { 0, 0, width, height };
+    cairo_region_intersect_rectangle(paths_layer->damage, &layer);
+  }
+
+  gboolean is_damaged = is_valid && paths_layer->damage != NULL &&
+                        !cairo_region_is_empty(paths_layer->damage);
+
+  count_cache_use(renderer, is_valid && !is_damaged);
+
+  if (is_damaged) {
+    cairo_t* paths_cr = cairo_create(paths_layer->surface);
+
+    is_valid = draw_damaged_paths(renderer, paths_cr, store, settings, viewport,
+                                  padding, width, height, paths_layer->damage);
+    cairo_destroy(paths_cr);
+  }
+
+  // Whatever was damaged is either redrawn now or is redrawn with the rest
+  if (paths_layer->damage != NULL)
+    cairo_region_subtract(paths_layer->damage, paths_layer->damage);
+
+  if (!is_valid) {
+    if (paths_layer->surface != NULL &&
+        (paths_layer->width != width || paths_layer->height != height)) {
+      cairo_surface_destroy(paths_layer->surface);
+      paths_layer->surface = NULL;
+    }
+
+    count_allocation(renderer, paths_layer->surface == NULL);
+
+    if (paths_layer->surface == NULL)
+      paths_layer->surface = cairo_surface_create_similar(cairo_get_target(cr),
+                                                          CAIRO_CONTENT_COLOR_ALPHA,
+                                                          width, height);
+
+    cairo_t* paths_cr = cairo_create(paths_layer->surface);
+
+    // Surface of the same size is reused, so it's cleared first
+    clear_surface(paths_cr);
+
+    draw_paths(renderer, paths_cr, store, settings, viewport, padding, width, height);
+    cairo_destroy(paths_cr);
+
+    paths_layer->width  = width;
+    paths_layer->height = height;
+  }
+
+  // Cancelled frame may have left some paths out of the layer
+  if (is_damaged || !is_valid)
+    paths_layer->is_unfinished = is_frame_cancelled(renderer);
+
+  gint64 paint_start = g_get_monotonic_time();
+
+  cairo_set_source_surface(cr, paths_layer->surface, 0, 0);
+  cairo_paint(cr);
+
+  gint64 end = g_get_monotonic_time();
+
+  renderer->stats.cairo_time += end - paint_start;
+  renderer->stats.frame_time += end - start;
+  ++ renderer->stats.n_frames;
+}
+
+void render_settings_init(render_settings_t* settings) {
+  *settings = (render_settings_t) {
+    .mode            = RENDER_MODE_BATCHED,
+
+    .is_grid_enabled = TRUE,
+    .grid_color      = { 0x55 / 256.0, 0x57 / 256.0, 0x53 / 256.0, 1.0 },
+
+    .line_width      = 5,
+    .line_color      = { 0xD3 / 256.0, 0xD7 / 256.0, 0xCF / 256.0, 1.0 },
+
+    .point_radius    = 5,
+    .point_color     = { 0x2E / 256.0, 0x34 / 256.0, 0x36 / 256.0, 1.0 },
+
+    .n_threads       = g_get_num_processors()
+  };
+}
+
+void render_fit_viewport(point_store_t* store, bounds_t* viewport) {
+  // Origin is always shown, empty store is fitted just to it
+  bounds_t bounds = { { 0.0, 0.0 }, { 0.0, 0.0 } };
+
+  bounds_t store_bounds;
+  if (point_store_get_bounds(store, &store_bounds)) {
+    bounds.min.x = MIN(bounds.min.x, store_bounds.min.x);
+    bounds.min.y = MIN(bounds.min.y, store_bounds.min.y);
+
+    bounds.max.x = MAX(bounds.max.x, store_bounds.max.x);
+    bounds.max.y = MAX(bounds.max.y, store_bounds.max.y);
+  }
+
+  viewport->min.x = floor(bounds.min.x);
+  viewport->min.y = floor(bounds.min.y);
+
+  viewport->max.x = MAX(ceil(bounds.max.x), viewport->min.x + 1);
+  viewport->max.y = MAX(ceil(bounds.max.y), viewport->min.y + 1);
+}
@@ -0,0 +1,164 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <gtk/gtk.h>
+
+#include "point_store.h"
+
+/*  Drawing of everything shown in <Preview> tab
+ *
+ *  Nothing in here touches widgets, all the settings are passed
+ *  in explicitly, so the same code can draw into any cairo context.
+ *  */
+
+typedef enum {
+  // Stroke every segment and fill every point with separate calls,
+  // slow, but each point is an exact circle at it's exact position
+  RENDER_MODE_SEGMENTS,
+
+  // Stroke each path as one polyline and stamp points with a circle
+  // rasterized once, points are snapped to the whole pixels
+  RENDER_MODE_BATCHED
+} render_mode_t;
+
+// Everything that defines how the drawing looks, in GUI
+// it comes from <Settings> tab
+typedef struct {
+  render_mode_t mode;
+
+  gboolean is_grid_enabled;
+  GdkRGBA  grid_color;
+
+  gdouble  line_width;
+  GdkRGBA  line_color;
+
+  int      point_radius;
+  GdkRGBA  point_color;
+
+  // Picture is split into tiles drawn by this many threads at once,
+  // with 1 it's drawn by the calling thread alone
+  int      n_threads;
+} render_settings_t;
+
+// Fills `settings` with the values <Settings> tab starts with
+void render_settings_init(render_settings_t* settings);
+
+// Caches and scratch buffers reused from frame to frame. Renderer
+// can only be used by one thread at a time, but any number of them
+// may draw different stores in parallel
+typedef struct renderer renderer_t;
+
+renderer_t* renderer_new(void);
+void renderer_free(renderer_t* renderer);
+
+// What renderer has done since `renderer_reset_stats`. Tiles drawn by
+// other threads are added up, so with tiles `data_time` and `cairo_time`
+// are CPU time of all the threads together and may exceed `frame_time`
+typedef struct {
+  gsize  n_frames;   // <-- Calls of `render_frame` and `render_frame_layered`
+  gint64 frame_time; // <-- Microseconds, wall clock time of these calls
+
+  gint64 data_time;  // <-- Microseconds spent on points: transforms, LOD, culling
+  gint64 cairo_time; // <-- Microseconds spent inside of cairo
+
+  gsize  n_points;             // <-- Points in all the paths drawn
+  gsize  n_points_submitted;   // <-- Points handed to cairo, others were culled
+  gsize  n_segments;           //     or decimated, same for segments
+  gsize  n_segments_submitted;
+
+  // LODs, spatial indices, layers and markers that were reused
+  // as they were (hits) or had to be built again (misses)
+  gsize  n_cache_hits;
+  gsize  n_cache_misses;
+
+  // Buffers, caches and surfaces that the renderer had to allocate or
+  // grow. Once they fit the data and the widget it stays 0, so a frame
+  // that only moves or restyles the picture allocates nothing
+  gsize  n_allocations;
+} render_stats_t;
+
+// Makes renderer check `is_cancelled` (atomically) between paths and
+// tiles and stop drawing as soon as it's set, frame is left unfinished
+// then. Layer that was being drawn is drawn whole by the next frame.
+// NULL (the default) makes frames always finish
+void renderer_set_cancel_flag(renderer_t* renderer, const gint* is_cancelled);
+
+void renderer_reset_stats(renderer_t* renderer);
+const render_stats_t* renderer_get_stats(renderer_t* renderer);
+
+// Picks part of data space that shows all the points in `store` (and
+// the origin), it's aligned to whole grid cells
+void render_fit_viewport(point_store_t* store, bounds_t* viewport);
+
+// Draw a line from (from_x, from_y) to (to_x, to_y)
+void cairo_line(cairo_t* cr, double from_x, double from_y, double to_x, double to_y);
+
+// Draws grid lines at whole coordinates of `viewport` (or only at
+// every 10th, 100th... of them, when lines get too close)
+void draw_grid(cairo_t* cr, const bounds_t* viewport,
+               int padding,
+               int width , int height,
+               GdkRGBA* grid_color);
+
+// Same as `draw_grid`, but grid is drawn into an off-screen surface
+// once and just painted from it, while none of the arguments change
+void draw_grid_layer(renderer_t* renderer, cairo_t* cr,
+                     const bounds_t* viewport,
+                     int padding,
+                     int width , int height,
+                     GdkRGBA* grid_color);
+
+// Draws part of `store` that falls into `viewport` (in data space),
+// which is stretched to fill the widget except for `padding` pixels
+void draw_paths_and_points(renderer_t* renderer, cairo_t* cr,
+                           point_store_t*           store,
+                           render_mode_t             mode,
+                           const bounds_t*       viewport,
+                           int                    padding,
+                           int         width, int  height,
+                           int               point_radius,
+                           gdouble             line_width,
+                           GdkRGBA*           point_color,
+                           GdkRGBA*            line_color);
+
+// Draws the whole picture: grid (if it's enabled) and all the paths
+void render_frame(renderer_t* renderer, cairo_t* cr,
+                  point_store_t*              store,
+                  const render_settings_t* settings,
+                  const bounds_t*          viewport,
+                  int                       padding,
+                  int            width, int  height);
+
+// Same as `render_frame`, but paths are drawn into an off-screen layer,
+// which is only painted again while `are_paths_changed` is FALSE and the
+// size stays the same. Grid is cached as in `draw_grid_layer`, so frames
+// where only grid has changed don't draw any paths at all. If part of the
+// layer is damaged (see `renderer_damage_paths`), only that part is redrawn
+void render_frame_layered(renderer_t* renderer, cairo_t* cr,
+                          point_store_t*              store,
+                          const render_settings_t* settings,
+                          const bounds_t*          viewport,
+                          int                       padding,
+                          int            width, int  height,
+                          gboolean         are_paths_changed);
+
+// Rectangle (in pixels) that points of `path` from `from`-th up to `to`-th
+// and segments between them take in a frame drawn with `settings`, it has
+// room for markers, line joins and antialiasing around them
+void render_get_points_area(const render_settings_t* settings,
+                            const bounds_t*          viewport,
+                            int                       padding,
+                            int            width, int  height,
+                            const path_t*                path,
+                            gsize               from, gsize to,
+                            cairo_rectangle_int_t*       area);
+
+// Marks `damage` (in pixels) of the layer kept by `render_frame_layered`
+// as out of date, while the rest of it stays as it is. It's meant for edits
+// of a few points that don't move the viewport: only the areas they took
+// before and after the edit are damaged, and only they are drawn again.
+// Areas that decimated paths pass through can't be redrawn partially,
+// layer is redrawn whole then
+void renderer_damage_paths(renderer_t* renderer, const cairo_region_t* damage);
+
+#endif
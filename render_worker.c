@@ -0,0 +1,376 @@
+#include "render_worker.h"
+#include "lod.h"
+#include "pyramid.h"
+#include "segment_index.h"
+
+// Caches of one path drawn by the worker, they are moved into the path
+// of a snapshot for the time it's drawn and taken back after that
+typedef struct {
+  struct lod*           lod;
+  struct segment_index* segment_index;
+  struct pyramid*       pyramid;
+
+  // Pyramid may borrow buckets from it, so it's kept mapped
+  GMappedFile* mapping;
+
+  guint64 frame;   // <-- Number of the last frame the path was in
+  guint64 version; // <-- Version of the path in that frame
+} path_caches_t;
+
+typedef struct {
+  render_worker_t* worker;
+
+  render_input_t   input; // <-- Store there is a snapshot owned by the frame
+  gboolean         are_paths_changed;
+  cairo_region_t*  damage;
+
+  gint is_cancelled;
+
+  // Filled in by the worker
+  render_stats_t stats;
+  gint64         start, duration;
+} frame_t;
+
+struct render_worker {
+  render_input_func_t get_input;
+  render_done_func_t  on_done;
+  gpointer            user_data;
+
+  GThreadPool* pool;  // <-- Has just one thread
+  frame_t*     frame; // <-- Frame being drawn, NULL while worker is free
+
+  // Last finished frame, it's released snapshot (see
+  // `point_store_snapshot_release`) is refilled by the next frame,
+  // so frames of a drag don't allocate a new snapshot every time
+  frame_t*     spare_frame;
+
+  // What is requested for the next frame
+  gboolean        is_requested;
+  gboolean        are_paths_changed;
+  cairo_region_t* damage;
+
+  gboolean was_cancelled; // <-- Previous frame was cancelled
+
+  // Back buffer belongs to the worker while a frame is drawn, buffers are
+  // only swapped once it's finished, so neither of them needs a lock
+  cairo_surface_t* front;
+  cairo_surface_t* back;
+
+  // Only touched by the worker thread:
+  renderer_t* renderer;
+  GHashTable* caches;   // <-- Path id -> path_caches_t*
+  guint64     n_frames;
+};
+
+static void path_caches_free(path_caches_t* caches) {
+  if (caches->lod != NULL)
+    lod_free(caches->lod);
+
+  if (caches->segment_index != NULL)
+    segment_index_free(caches->segment_index);
+
+  if (caches->pyramid != NULL)
+    pyramid_free(caches->pyramid);
+
+  if (caches->mapping != NULL)
+    g_mapped_file_unref(caches->mapping);
+
+  g_free(caches);
+}
+
+// Moves worker's caches into the paths of `snapshot`
+static void attach_caches(render_worker_t* worker, point_store_t* snapshot) {
+  ++ worker->n_frames;
+
+  for (gsize i = 0; i < snapshot->n_paths; ++ i) {
+    path_t* path = snapshot->paths[i];
+
+    path_caches_t* caches = g_hash_table_lookup(worker->caches, GSIZE_TO_POINTER(path->id));
+    if (caches == NULL) {
+      caches = g_new0(path_caches_t, 1);
+      g_hash_table_insert(worker->caches, GSIZE_TO_POINTER(path->id), caches);
+    }
+
+    caches->frame = worker->n_frames;
+
+    // Other caches compare versions, but pyramid is updated in place,
+    // so it's told which of it's points have changed since last frame
+    if (caches->pyramid != NULL) {
+      pyramid_truncate(caches->pyramid, path->n_unchanged);
+
+      for (gsize j = 0; j < path->moved.n_indices; ++ j)
+        pyramid_update_point(caches->pyramid, path, path->moved.indices[j]);
+    }
+
+    // Segment index missed changes of the frames it wasn't drawn in,
+    // it's only updated in place if it was up to date in the last one
+    if (caches->segment_index != NULL && caches->segment_index->version == caches->version)
+      segment_index_update(caches->segment_index, path);
+
+    caches->version = path->version;
+
+    // Pyramid of the snapshot is only there if it's mapped
+    if (caches->pyramid == NULL && path->pyramid != NULL) {
+      caches->pyramid = path->pyramid;
+      caches->mapping = g_mapped_file_ref(snapshot->mapping);
+    } else if (path->pyramid != NULL)
+      pyramid_free(path->pyramid);
+
+    path->lod           = caches->lod;
+    path->segment_index = caches->segment_index;
+    path->pyramid       = caches->pyramid;
+  }
+}
+
+static gboolean is_stale(gpointer key, gpointer value, gpointer user_data) {
+  const render_worker_t* worker = user_data;
+  const path_caches_t*   caches = value;
+
+  return caches->frame != worker->n_frames;
+}
+
+// Takes caches (rebuilt or not) back from the paths of `snapshot`,
+// caches of the paths that are no longer there are freed
+static void detach_caches(render_worker_t* worker, point_store_t* snapshot) {
+  for (gsize i = 0; i < snapshot->n_paths; ++ i) {
+    path_t* path = snapshot->paths[i];
+
+    path_caches_t* caches = g_hash_table_lookup(worker->caches, GSIZE_TO_POINTER(path->id));
+
+    caches->lod           = path->lod;
+    caches->segment_index = path->segment_index;
+    caches->pyramid       = path->pyramid;
+
+    path->lod           = NULL;
+    path->segment_index = NULL;
+    path->pyramid       = NULL;
+  }
+
+  g_hash_table_foreach_remove(worker->caches, is_stale, worker);
+}
+
+// Back buffer is reused while the size of the widget stays the same
+static cairo_surface_t* get_back_buffer(render_worker_t* worker, const render_input_t* input) {
+  int width  = input->width  * input->scale;
+  int height = input->height * input->scale;
+
+  if (worker->back != NULL &&
+      cairo_image_surface_get_width (worker->back) == width &&
+      cairo_image_surface_get_height(worker->back) == height) {
+    gdouble scale_x, scale_y;
+    cairo_surface_get_device_scale(worker->back, &scale_x, &scale_y);
+
+    if (scale_x == input->scale && scale_y == input->scale)
+      return worker->back;
+  }
+
+  if (worker->back != NULL)
+    cairo_surface_destroy(worker->back);
+
+  worker->back = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+  cairo_surface_set_device_scale(worker->back, input->scale, input->scale);
+
+  return worker->back;
+}
+
+static gboolean finish_frame(gpointer data);
+
+// Runs on the worker thread. Cancelled frame is still drawn, but drawing
+// stops right away, so layers learn what has changed and are redrawn later
+static void draw_frame(gpointer data, gpointer user_data) {
+  frame_t*         frame  = data;
+  render_worker_t* worker = frame->worker;
+  render_input_t*  input  = &frame->input;
+
+  frame->start = g_get_monotonic_time();
+
+  renderer_t* renderer = worker->renderer;
+
+  renderer_set_cancel_flag(renderer, &frame->is_cancelled);
+  renderer_reset_stats(renderer);
+
+  if (frame->damage != NULL)
+    renderer_damage_paths(renderer, frame->damage);
+
+  attach_caches(worker, input->store);
+
+  cairo_t* cr = cairo_create(get_back_buffer(worker, input));
+
+  // Buffer is reused, and layers don't cover what's under them
+  cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+  cairo_paint(cr);
+  cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+
+  render_frame_layered(renderer, cr, input->store, &input->settings, &input->viewport,
+                       input->padding, input->width, input->height,
+                       frame->are_paths_changed);
+  cairo_destroy(cr);
+
+  // Image is read by the main thread from now on
+  cairo_surface_flush(worker->back);
+
+  detach_caches(worker, input->store);
+
+  frame->stats    = *renderer_get_stats(renderer);
+  frame->duration = g_get_monotonic_time() - frame->start;
+
+  g_idle_add(finish_frame, frame);
+}
+
+static void frame_free(frame_t* frame) {
+  point_store_free(frame->input.store);
+
+  if (frame->damage != NULL)
+    cairo_region_destroy(frame->damage);
+
+  g_free(frame);
+}
+
+// Finished frame is kept for the next one, only it's
+// snapshot lets go of the points right away
+static void frame_recycle(render_worker_t* worker, frame_t* frame) {
+  point_store_snapshot_release(frame->input.store);
+
+  if (frame->damage != NULL)
+    cairo_region_destroy(frame->damage);
+
+  frame->damage = NULL;
+
+  if (worker->spare_frame != NULL)
+    frame_free(worker->spare_frame);
+
+  worker->spare_frame = frame;
+}
+
+static void start_frame(render_worker_t* worker) {
+  frame_t* frame = worker->spare_frame;
+  point_store_t* snapshot = NULL;
+
+  if (frame != NULL)
+    snapshot = frame->input.store;
+  else
+    frame = g_new(frame_t, 1);
+
+  worker->spare_frame = NULL;
+
+  *frame = (frame_t) { .worker = worker };
+
+  worker->get_input(&frame->input, worker->user_data);
+  frame->input.store = point_store_snapshot_reuse(frame->input.store, snapshot);
+
+  // Whatever was requested so far goes to this frame
+  frame->are_paths_changed = worker->are_paths_changed;
+  frame->damage            = worker->damage;
+
+  worker->is_requested      = FALSE;
+  worker->are_paths_changed = FALSE;
+  worker->damage            = NULL;
+
+  worker->frame = frame;
+  g_thread_pool_push(worker->pool, frame, NULL);
+}
+
+// Runs on the main thread once the worker is done with the frame
+static gboolean finish_frame(gpointer data) {
+  frame_t*         frame  = data;
+  render_worker_t* worker = frame->worker;
+
+  worker->frame = NULL;
+  worker->was_cancelled = g_atomic_int_get(&frame->is_cancelled);
+
+  if (!worker->was_cancelled) {
+    cairo_surface_t* front = worker->front;
+
+    worker->front = worker->back;
+    worker->back  = front;
+
+    worker->on_done(&frame->stats, frame->start, frame->duration, worker->user_data);
+  }
+
+  frame_recycle(worker, frame);
+
+  if (worker->is_requested)
+    start_frame(worker);
+
+  return G_SOURCE_REMOVE;
+}
+
+render_worker_t* render_worker_new(render_input_func_t get_input,
+                                   render_done_func_t  on_done,
+                                   gpointer          user_data) {
+  render_worker_t* worker = g_new0(render_worker_t, 1);
+
+  worker->get_input = get_input;
+  worker->on_done   = on_done;
+  worker->user_data = user_data;
+
+  worker->pool = g_thread_pool_new(draw_frame, worker, 1, TRUE, NULL);
+
+  worker->renderer = renderer_new();
+  worker->caches   = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                           (GDestroyNotify) path_caches_free);
+
+  return worker;
+}
+
+void render_worker_free(render_worker_t* worker) {
+  if (worker->frame != NULL)
+    g_atomic_int_set(&worker->frame->is_cancelled, TRUE);
+
+  // Waits for the frame, but it's `finish_frame` is never run
+  g_thread_pool_free(worker->pool, FALSE, TRUE);
+
+  if (worker->frame != NULL) {
+    g_source_remove_by_user_data(worker->frame);
+    frame_free(worker->frame);
+  }
+
+  if (worker->spare_frame != NULL)
+    frame_free(worker->spare_frame);
+
+  if (worker->damage != NULL)
+    cairo_region_destroy(worker->damage);
+
+  if (worker->front != NULL)
+    cairo_surface_destroy(worker->front);
+
+  if (worker->back != NULL)
+    cairo_surface_destroy(worker->back);
+
+  renderer_free(worker->renderer);
+  g_hash_table_destroy(worker->caches);
+
+  g_free(worker);
+}
+
+void render_worker_request(render_worker_t* worker,
+                           gboolean  are_paths_changed,
+                           const cairo_region_t* damage) {
+  worker->is_requested       = TRUE;
+  worker->are_paths_changed |= are_paths_changed;
+
+  if (damage != NULL) {
+    if (worker->damage == NULL)
+      worker->damage = cairo_region_create();
+
+    cairo_region_union(worker->damage, damage);
+  }
+
+  if (worker->frame == NULL) {
+    start_frame(worker);
+    return;
+  }
+
+  if (!worker->was_cancelled)
+    g_atomic_int_set(&worker->frame->is_cancelled, TRUE);
+}
+
+gboolean render_worker_paint(render_worker_t* worker, cairo_t* cr) {
+  if (worker->front == NULL)
+    return FALSE;
+
+  cairo_set_source_surface(cr, worker->front, 0, 0);
+  cairo_paint(cr);
+
+  return TRUE;
+}
@@ -0,0 +1,68 @@
+#ifndef RENDER_WORKER_H
+#define RENDER_WORKER_H
+
+#include "render.h"
+
+/*  Drawing of frames off the main thread
+ *
+ *  Frame is drawn by a worker thread into a back buffer, from a snapshot
+ *  of the store (see `point_store_snapshot`) and a copy of the settings,
+ *  so the main thread goes on changing them meanwhile. Finished frame
+ *  becomes the front buffer, which is what `render_worker_paint` paints,
+ *  so `draw` handler only ever copies a ready picture and never waits.
+ *
+ *  There's at most one frame being drawn at a time. Request that comes
+ *  while a frame is being drawn cancels it, since it's out of date by
+ *  then, and the next frame is started as soon as the worker is free,
+ *  so all the requests in between are merged into it. Frame right after
+ *  a cancelled one is never cancelled, so even when changes come faster
+ *  than frames are drawn, every other frame makes it to the screen.
+ *
+ *  Worker keeps caches (LODs, spatial indices, pyramids) of the paths
+ *  it has drawn by itself, main thread never touches them.
+ *
+ *  All the functions and callbacks below are for the main thread only.
+ *  */
+
+// Everything a frame is drawn from
+typedef struct {
+  point_store_t*    store; // <-- Only a snapshot of it is kept
+
+  render_settings_t settings;
+  bounds_t          viewport;
+  int               padding;
+
+  int width , height;
+  int scale; // <-- Device scale of the widget, buffers are that much bigger
+} render_input_t;
+
+// Fills in the latest `input`, it's called right before a frame is started
+typedef void (*render_input_func_t)(render_input_t* input, gpointer user_data);
+
+// Called after a frame has become the front buffer, `stats` and `duration`
+// (microseconds of wall clock time) are what the worker has spent on it
+typedef void (*render_done_func_t)(const render_stats_t* stats,
+                                   gint64 start, gint64 duration,
+                                   gpointer user_data);
+
+typedef struct render_worker render_worker_t;
+
+render_worker_t* render_worker_new(render_input_func_t get_input,
+                                   render_done_func_t  on_done,
+                                   gpointer          user_data);
+
+// Frame that is being drawn is cancelled and waited for
+void render_worker_free(render_worker_t* worker);
+
+// Asks for a new frame. `are_paths_changed` is the same as for
+// `render_frame_layered`, `damage` (may be NULL) is passed to
+// `renderer_damage_paths`, both add up until the frame is started
+void render_worker_request(render_worker_t* worker,
+                           gboolean  are_paths_changed,
+                           const cairo_region_t* damage);
+
+// Paints the last finished frame at the origin of `cr`,
+// returns FALSE if no frame has been finished yet
+gboolean render_worker_paint(render_worker_t* worker, cairo_t* cr);
+
+#endif
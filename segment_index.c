@@ -0,0 +1,379 @@
+#include "segment_index.h"
+#include "compact.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// How many segments are there in one cell on average
+#define SEGMENTS_PER_CELL 4
+
+// Upper limit for the number of cells in each direction
+#define MAX_CELLS_PER_SIDE 4096
+
+// Segments that jump across the path (scattered points, noise) cross
+// hundreds of cells each, index of such a path isn't built once it
+// lists more than this many cells per segment on average
+#define MAX_CELLS_PER_SEGMENT 16
+
+// Every query checks all the segments that have changed since the
+// index was built, it's rebuilt rather than list more of them
+#define MAX_CHANGED_SEGMENTS 1024
+
+static gsize cell_column(const segment_index_t* index, gdouble x) {
+  if (index->cell_width <= 0.0)
+    return 0;
+
+  gdouble column = floor((x - index->bounds.min.x) / index->cell_width);
+  return CLAMP(column, 0.0, (gdouble) index->columns - 1);
+}
+
+static gsize cell_row(const segment_index_t* index, gdouble y) {
+  if (index->cell_height <= 0.0)
+    return 0;
+
+  gdouble row = floor((y - index->bounds.min.y) / index->cell_height);
+  return CLAMP(row, 0.0, (gdouble) index->rows - 1);
+}
+
+// Points of compact path are read from the last block that was decoded,
+// so segments that go in order cost one decoding per block
+typedef struct {
+  const path_t* path;
+
+  gboolean is_decoded;
+  gsize    block; // <-- Block that is decoded into `xs` and `ys`
+  gdouble  xs[COMPACT_BLOCK_SIZE];
+  gdouble  ys[COMPACT_BLOCK_SIZE];
+} segment_reader_t;
+
+static point_t read_point(segment_reader_t* reader, gsize index) {
+  const path_t* path = reader->path;
+
+  // Points of other paths and the ones that aren't encoded are in arrays
+  if (index >= path->n_encoded)
+    return (point_t) { path->xs[index - path->n_encoded],
+                       path->ys[index - path->n_encoded] };
+
+  gsize block = index / COMPACT_BLOCK_SIZE;
+
+  if (!reader->is_decoded || reader->block != block) {
+    compact_decode_block(path->compact, block, reader->xs, reader->ys);
+
+    reader->is_decoded = TRUE;
+    reader->block      = block;
+  }
+
+  return (point_t) { reader->xs[index % COMPACT_BLOCK_SIZE],
+                     reader->ys[index % COMPACT_BLOCK_SIZE] };
+}
+
+static void segment_bounds(segment_reader_t* reader, gsize segment, bounds_t* bounds) {
+  point_t first  = read_point(reader, segment);
+  point_t second = read_point(reader, segment + 1);
+
+  bounds->min.x = MIN(first.x, second.x);
+  bounds->max.x = MAX(first.x, second.x);
+
+  bounds->min.y = MIN(first.y, second.y);
+  bounds->max.y = MAX(first.y, second.y);
+}
+
+// Walks over the cells segment crosses, from the cell of it's first point
+// to the cell of the second one, every step goes to a neighbouring cell
+typedef struct {
+  gsize   column, row;
+  gsize   to_column, to_row;
+
+  // Where (as a fraction of the segment) it crosses the next border
+  // between columns and between rows, and how far apart these are
+  gdouble next_x, next_y;
+  gdouble step_x, step_y;
+} cell_walk_t;
+
+static gdouble get_first_crossing(gdouble from, gdouble to, gdouble min,
+                                  gdouble cell_size, gsize cell) {
+  gdouble border = min + (to > from ? cell + 1 : cell) * cell_size;
+  return (border - from) / (to - from);
+}
+
+static void cell_walk_start(cell_walk_t* walk, const segment_index_t* index,
+                            point_t first, point_t second) {
+  walk->column    = cell_column(index, first.x);
+  walk->row       = cell_row   (index, first.y);
+  walk->to_column = cell_column(index, second.x);
+  walk->to_row    = cell_row   (index, second.y);
+
+  walk->next_x = walk->next_y = INFINITY;
+  walk->step_x = walk->step_y = INFINITY;
+
+  if (walk->column != walk->to_column) {
+    walk->next_x = get_first_crossing(first.x, second.x, index->bounds.min.x,
+                                      index->cell_width, walk->column);
+    walk->step_x = index->cell_width / fabs(second.x - first.x);
+  }
+
+  if (walk->row != walk->to_row) {
+    walk->next_y = get_first_crossing(first.y, second.y, index->bounds.min.y,
+                                      index->cell_height, walk->row);
+    walk->step_y = index->cell_height / fabs(second.y - first.y);
+  }
+}
+
+// Moves to the next cell, returns FALSE once the last one was visited.
+// It goes along the row or column of the last cell as soon as it's reached,
+// so rounding can't make it miss the end
+static gboolean cell_walk_next(cell_walk_t* walk) {
+  gboolean is_column_done = walk->column == walk->to_column;
+  gboolean is_row_done    = walk->row    == walk->to_row;
+
+  if (is_column_done && is_row_done)
+    return FALSE;
+
+  if (is_row_done || (!is_column_done && walk->next_x < walk->next_y)) {
+    walk->column += walk->to_column > walk->column ? 1 : -1;
+    walk->next_x += walk->step_x;
+  } else {
+    walk->row    += walk->to_row > walk->row ? 1 : -1;
+    walk->next_y += walk->step_y;
+  }
+
+  return TRUE;
+}
+
+static gsize cell_walk_get_cell(const cell_walk_t* walk, const segment_index_t* index) {
+  return walk->row * index->columns + walk->column;
+}
+
+// Returns FALSE if segments cross too many cells to be indexed
+static gboolean segment_index_build(segment_index_t* index, path_t* path) {
+  gsize n_segments = path->n_points - 1;
+
+  gsize side = ceil(sqrt((gdouble) n_segments / SEGMENTS_PER_CELL));
+  side = CLAMP(side, 1, MAX_CELLS_PER_SIDE);
+
+  index->bounds  = path->bounds;
+  index->columns = side;
+  index->rows    = side;
+
+  index->n_segments = n_segments;
+  index->n_changed  = 0;
+
+  index->cell_width  = (index->bounds.max.x - index->bounds.min.x) / side;
+  index->cell_height = (index->bounds.max.y - index->bounds.min.y) / side;
+
+  gsize n_cells = index->columns * index->rows;
+
+  // Segments of every cell are counted one place further than it's start,
+  // and that start is then moved forward while the cell is being filled,
+  // so in the end it points to the start of the next cell
+  if (index->cell_starts_capacity < n_cells + 2) {
+    index->cell_starts_capacity = n_cells + 2;
+    index->cell_starts = g_renew(guint32, index->cell_starts, n_cells + 2);
+  }
+
+  memset(index->cell_starts, 0, (n_cells + 2) * sizeof(guint32));
+
+  segment_reader_t reader = { .path = path };
+
+  // Counts are 32-bit, so there must be no more listed cells than that
+  gsize max_listed = MIN(G_MAXUINT32, MAX_CELLS_PER_SEGMENT * n_segments);
+  gsize n_listed   = 0;
+
+  // First count segments in every cell...
+  for (gsize i = 0; i < n_segments; ++ i) {
+    cell_walk_t walk;
+    cell_walk_start(&walk, index, read_point(&reader, i), read_point(&reader, i + 1));
+
+    do {
+      if (++ n_listed > max_listed)
+        return FALSE;
+
+      ++ index->cell_starts[cell_walk_get_cell(&walk, index) + 2];
+    } while (cell_walk_next(&walk));
+  }
+
+  for (gsize i = 0; i <= n_cells; ++ i)
+    index->cell_starts[i + 1] += index->cell_starts[i];
+
+  if (index->segments_capacity < n_listed) {
+    index->segments_capacity = n_listed;
+
+    g_free(index->segments);
+    index->segments = g_new(guint32, n_listed);
+  }
+
+  // ...then put them in place
+  for (gsize i = 0; i < n_segments; ++ i) {
+    cell_walk_t walk;
+    cell_walk_start(&walk, index, read_point(&reader, i), read_point(&reader, i + 1));
+
+    do {
+      gsize cell = cell_walk_get_cell(&walk, index);
+      index->segments[index->cell_starts[cell + 1] ++] = i;
+    } while (cell_walk_next(&walk));
+  }
+
+  return TRUE;
+}
+
+const segment_index_t* segment_index_get(path_t* path) {
+  if (path->n_points < 2 || path->n_points - 1 > G_MAXUINT32)
+    return NULL;
+
+  segment_index_t* index = path->segment_index;
+
+  if (index == NULL)
+    index = path->segment_index = g_new0(segment_index_t, 1);
+  else if (index->version == path->version)
+    return index->is_too_crowded ? NULL : index;
+
+  index->is_too_crowded = !segment_index_build(index, path);
+  index->version = path->version;
+
+  // Arrays of the index that failed aren't needed until the path changes
+  if (index->is_too_crowded) {
+    g_free(index->cell_starts);
+    g_free(index->segments);
+    g_free(index->changed);
+
+    index->cell_starts = NULL;
+    index->segments    = NULL;
+    index->changed     = NULL;
+
+    index->cell_starts_capacity = 0;
+    index->segments_capacity    = 0;
+    index->changed_capacity     = 0;
+
+    return NULL;
+  }
+
+  return index;
+}
+
+static int compare_segments(const void* first, const void* second) {
+  guint32 first_segment  = *(const guint32*) first;
+  guint32 second_segment = *(const guint32*) second;
+
+  return (first_segment > second_segment) - (first_segment < second_segment);
+}
+
+static void add_changed_segment(segment_index_t* index, gsize segment) {
+  if (index->n_changed == index->changed_capacity) {
+    index->changed_capacity = MAX(64, 2 * index->changed_capacity);
+    index->changed = g_renew(guint32, index->changed, index->changed_capacity);
+  }
+
+  index->changed[index->n_changed ++] = segment;
+}
+
+void segment_index_update(segment_index_t* index, const path_t* path) {
+  // Such paths aren't indexed, `segment_index_get` finds it out again
+  if (index->is_too_crowded || path->n_points < 2 || path->n_points - 1 > G_MAXUINT32)
+    return;
+
+  gsize n_segments = path->n_points - 1;
+
+  // Segment that ends in the first changed point has changed too
+  gsize first_changed = path->n_unchanged == 0 ? 0 : path->n_unchanged - 1;
+  first_changed = MIN(first_changed, n_segments);
+
+  gsize n_added = n_segments - first_changed + 2 * path->moved.n_indices;
+  if (index->n_changed + n_added > MAX_CHANGED_SEGMENTS)
+    return;
+
+  for (gsize i = first_changed; i < n_segments; ++ i)
+    add_changed_segment(index, i);
+
+  // Every moved point changes segments on both sides of it
+  for (gsize i = 0; i < path->moved.n_indices; ++ i) {
+    gsize point = path->moved.indices[i];
+
+    if (point > 0)
+      add_changed_segment(index, point - 1);
+
+    if (point < n_segments)
+      add_changed_segment(index, point);
+  }
+
+  // Point dragged for many frames changes the same segments every time
+  qsort(index->changed, index->n_changed, sizeof(guint32), compare_segments);
+
+  gsize n_unique = 0;
+  for (gsize i = 0; i < index->n_changed; ++ i)
+    if (n_unique == 0 || index->changed[n_unique - 1] != index->changed[i])
+      index->changed[n_unique ++] = index->changed[i];
+
+  index->n_changed  = n_unique;
+  index->n_segments = n_segments;
+  index->version    = path->version;
+}
+
+static void list_segment(guint32** segments, gsize* capacity, gsize n_listed,
+                         guint32 segment) {
+  if (n_listed == *capacity) {
+    *capacity = *capacity == 0 ? 1024 : *capacity * 2;
+    *segments = g_renew(guint32, *segments, *capacity);
+  }
+
+  (*segments)[n_listed] = segment;
+}
+
+gsize segment_index_query(const segment_index_t* index, path_t* path,
+                          const bounds_t* area,
+                          guint32** segments, gsize* capacity) {
+  gsize n_listed = 0;
+
+  // Changed segments may be anywhere, even outside of index's bounds
+  for (gsize i = 0; i < index->n_changed; ++ i)
+    list_segment(segments, capacity, n_listed ++, index->changed[i]);
+
+  if (bounds_intersect(&index->bounds, area)) {
+    gsize from_column = cell_column(index, area->min.x), to_column = cell_column(index, area->max.x);
+    gsize from_row    = cell_row   (index, area->min.y), to_row    = cell_row   (index, area->max.y);
+
+    for (gsize row = from_row; row <= to_row; ++ row)
+      for (gsize column = from_column; column <= to_column; ++ column) {
+        gsize cell = row * index->columns + column;
+
+        // Cells still list segments that path had when index was built
+        for (guint32 i = index->cell_starts[cell]; i < index->cell_starts[cell + 1]; ++ i)
+          if (index->segments[i] < index->n_segments)
+            list_segment(segments, capacity, n_listed ++, index->segments[i]);
+      }
+  }
+
+  if (n_listed == 0)
+    return 0;
+
+  // Long segments are listed in several cells, leave only one copy. It's
+  // done before segments are checked, so their points are read in order
+  qsort(*segments, n_listed, sizeof(guint32), compare_segments);
+
+  gsize n_found = 0;
+  segment_reader_t reader = { .path = path };
+
+  for (gsize i = 0; i < n_listed; ++ i) {
+    guint32 segment = (*segments)[i];
+
+    if (n_found != 0 && (*segments)[n_found - 1] == segment)
+      continue;
+
+    // Cell may intersect the area while segment itself doesn't
+    bounds_t bounds;
+    segment_bounds(&reader, segment, &bounds);
+
+    if (bounds_intersect(&bounds, area))
+      (*segments)[n_found ++] = segment;
+  }
+
+  return n_found;
+}
+
+void segment_index_free(segment_index_t* index) {
+  g_free(index->cell_starts);
+  g_free(index->segments);
+  g_free(index->changed);
+
+  g_free(index);
+}
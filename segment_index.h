@@ -0,0 +1,73 @@
+#ifndef SEGMENT_INDEX_H
+#define SEGMENT_INDEX_H
+
+#include "point_store.h"
+
+/*  Uniform grid over segments of one path
+ *
+ *  Bounding box of the path is split into cells and every segment
+ *  (from i-th point to i+1-th) is listed in all the cells it crosses.
+ *  Finding segments that may be visible in a zoomed in viewport then
+ *  only visits cells under the viewport, so it costs about as much
+ *  as there are visible segments.
+ *
+ *  Paths with long segments (scattered points, noise) aren't indexed
+ *  at all: every segment would be listed in hundreds of cells, and
+ *  most of the path is visible in any viewport anyway.
+ *  */
+
+typedef struct segment_index {
+  // Version of the path the index was built from
+  guint64  version;
+
+  // Segments of that version cross too many cells, there are no arrays
+  gboolean is_too_crowded;
+
+  bounds_t bounds;
+
+  gsize    columns, rows;
+  gdouble  cell_width, cell_height;
+
+  // Segments of the cell (column, row) are listed in `segments` from
+  // `cell_starts[row * columns + column]` up to the next cell's start
+  guint32* cell_starts;
+  guint32* segments;
+
+  // Segments path has now, those listed in cells may be past them
+  gsize    n_segments;
+
+  // Segments that have changed since the index was built (in ascending
+  // order), they are still listed in their old cells, so instead of cells
+  // every query checks them (see `segment_index_update`)
+  guint32* changed;
+  gsize    n_changed;
+
+  // Index is rebuilt in the same arrays, they only grow when needed
+  gsize    cell_starts_capacity;
+  gsize    segments_capacity;
+  gsize    changed_capacity;
+} segment_index_t;
+
+// Returns index of segments of `path`, it's built on the first use and
+// cached in the path until it's points change. Returns NULL if path has
+// no segments, too many of them or they cross too many cells to be indexed
+const segment_index_t* segment_index_get(path_t* path);
+
+// Brings index that was up to date with the previous snapshot of the path
+// up to date with `path`, a newer snapshot (see `n_unchanged` and `moved`
+// in point_store.h), without rebuilding it. Dragged point only changes
+// two segments, so every frame of the drag costs about nothing. Once
+// too many segments have changed, index is left stale and is rebuilt
+void segment_index_update(segment_index_t* index, const path_t* path);
+
+// Finds all segments of `path` that cross cells under `area` and whose
+// bounding boxes intersect it.
+// Indices of their first points are written to `*segments` (which is
+// grown when needed) in ascending order without duplicates
+gsize segment_index_query(const segment_index_t* index, path_t* path,
+                          const bounds_t* area,
+                          guint32** segments, gsize* capacity);
+
+void segment_index_free(segment_index_t* index);
+
+#endif
@@ -0,0 +1,337 @@
+#include "stream.h"
+#include "import.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib-unix.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Source is read in chunks of this size, one chunk per main loop iteration,
+// so a flood of points can't keep the main loop from drawing
+#define READ_SIZE (1 << 16)
+
+// Longer lines can't be points, they are dropped instead of being collected
+#define MAX_LINE_LENGTH 4096
+
+#define SOCKET_PREFIX "unix:"
+
+// Plain file that has been read up to the end is checked for new lines
+// this often (it's always readable, so it can't be watched for them)
+#define FOLLOW_INTERVAL 100 // <-- Milliseconds
+
+typedef enum {
+  SOURCE_STDIN,
+  SOURCE_FIFO,
+  SOURCE_FILE,   // <-- Plain file, it's followed once it's read to the end
+  SOURCE_DEVICE, // <-- Anything else opened by path, read until it ends
+  SOURCE_SOCKET
+} source_type_t;
+
+// Anything lines are read from: stdin, FIFO, file or socket client
+typedef struct {
+  stream_t* stream;
+
+  int   fd;
+  guint watch_id; // <-- Watch of `fd` or, for followed file, timeout
+
+  // Beginning of the line that hasn't been read completely yet
+  GString* line;
+  gboolean is_line_dropped; // <-- Line is too long, it's skipped up to '\n'
+} connection_t;
+
+struct stream {
+  source_type_t type;
+  gchar* path; // <-- NULL for stdin
+
+  gchar* default_name;
+
+  stream_point_func_t on_point;
+  gpointer           user_data;
+
+  // Only for sockets
+  int   listen_fd;
+  guint listen_watch_id;
+
+  GPtrArray* connections; // <-- connection_t*
+};
+
+GQuark stream_error_quark(void) {
+  return g_quark_from_static_string("stream-error-quark");
+}
+
+static void parse_line(stream_t* stream, const gchar* begin, const gchar* end) {
+  const gchar* name;
+  gsize name_length;
+
+  gdouble x, y;
+
+  // Anything that isn't a point is silently skipped, as in import
+  if (!import_parse_line(begin, end, &name, &name_length, &x, &y))
+    return;
+
+  if (name == NULL)
+    stream->on_point(stream->default_name, strlen(stream->default_name),
+                     x, y, stream->user_data);
+  else
+    stream->on_point(name, name_length, x, y, stream->user_data);
+}
+
+static void parse_chunk(connection_t* connection, const gchar* chunk, gsize size) {
+  const gchar* current = chunk;
+  const gchar* end     = chunk + size;
+
+  while (current < end) {
+    const gchar* line_end = memchr(current, '\n', end - current);
+
+    if (line_end == NULL) {
+      // Line continues in the next chunk
+      if (connection->line->len + (end - current) > MAX_LINE_LENGTH)
+        connection->is_line_dropped = TRUE;
+
+      if (!connection->is_line_dropped)
+        g_string_append_len(connection->line, current, end - current);
+
+      return;
+    }
+
+    if (connection->is_line_dropped)
+      connection->is_line_dropped = FALSE;
+    else if (connection->line->len != 0) {
+      g_string_append_len(connection->line, current, line_end - current);
+      parse_line(connection->stream, connection->line->str,
+                 connection->line->str + connection->line->len);
+    } else
+      // Most lines are parsed right inside of the chunk
+      parse_line(connection->stream, current, line_end);
+
+    g_string_truncate(connection->line, 0);
+    current = line_end + 1;
+  }
+}
+
+static connection_t* connection_new(stream_t* stream, int fd);
+
+static void connection_free(connection_t* connection) {
+  if (connection->watch_id != 0)
+    g_source_remove(connection->watch_id);
+
+  // Stdin is left open, it's not ours
+  if (connection->fd != STDIN_FILENO)
+    close(connection->fd);
+
+  g_string_free(connection->line, TRUE);
+  g_free(connection);
+}
+
+static int open_fifo(const gchar* path) {
+  // Non-blocking open doesn't wait for a writer to appear
+  return open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+}
+
+static gboolean on_readable(gint fd, GIOCondition condition, gpointer data);
+
+// Checks if anything was appended to the followed file, it's read from
+// the watch again until the end. File that got shorter was rewritten,
+// so it's read anew from the start
+static gboolean on_follow_timeout(gpointer data) {
+  connection_t* connection = data;
+
+  struct stat file_stat;
+  off_t position = lseek(connection->fd, 0, SEEK_CUR);
+
+  if (fstat(connection->fd, &file_stat) == -1 || position == -1 ||
+      file_stat.st_size == position)
+    return G_SOURCE_CONTINUE;
+
+  if (file_stat.st_size < position) {
+    lseek(connection->fd, 0, SEEK_SET);
+
+    g_string_truncate(connection->line, 0);
+    connection->is_line_dropped = FALSE;
+  }
+
+  connection->watch_id = g_unix_fd_add(connection->fd, G_IO_IN | G_IO_HUP | G_IO_ERR,
+                                       on_readable, connection);
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean on_readable(gint fd, GIOCondition condition, gpointer data) {
+  connection_t* connection = data;
+  stream_t*     stream     = connection->stream;
+
+  gchar chunk[READ_SIZE];
+  gssize n_read = read(fd, chunk, sizeof(chunk));
+
+  if (n_read < 0 && (errno == EAGAIN || errno == EINTR))
+    return G_SOURCE_CONTINUE;
+
+  if (n_read > 0) {
+    parse_chunk(connection, chunk, n_read);
+    return G_SOURCE_CONTINUE;
+  }
+
+  // End of the file isn't the end of the stream, the last line may not
+  // be written completely yet, so it's kept until the rest of it comes
+  if (n_read == 0 && stream->type == SOURCE_FILE) {
+    connection->watch_id = g_timeout_add(FOLLOW_INTERVAL, on_follow_timeout, connection);
+    return G_SOURCE_REMOVE;
+  }
+
+  // Writer is gone, the last line may have no '\n' after it
+  if (connection->line->len != 0 && !connection->is_line_dropped)
+    parse_line(stream, connection->line->str,
+               connection->line->str + connection->line->len);
+
+  connection->watch_id = 0;
+  g_ptr_array_remove(stream->connections, connection);
+
+  // Next writer of FIFO will need a new reader
+  if (stream->type == SOURCE_FIFO) {
+    int new_fd = open_fifo(stream->path);
+
+    if (new_fd != -1)
+      g_ptr_array_add(stream->connections, connection_new(stream, new_fd));
+    else
+      g_warning("Can't reopen %s: %s", stream->path, g_strerror(errno));
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+static connection_t* connection_new(stream_t* stream, int fd) {
+  connection_t* connection = g_new0(connection_t, 1);
+
+  connection->stream = stream;
+  connection->fd     = fd;
+  connection->line   = g_string_sized_new(128);
+
+  g_unix_set_fd_nonblocking(fd, TRUE, NULL);
+
+  connection->watch_id = g_unix_fd_add(fd, G_IO_IN | G_IO_HUP | G_IO_ERR,
+                                       on_readable, connection);
+  return connection;
+}
+
+static gboolean on_client_connected(gint fd, GIOCondition condition, gpointer data) {
+  stream_t* stream = data;
+
+  int client_fd = accept(fd, NULL, NULL);
+  if (client_fd != -1)
+    g_ptr_array_add(stream->connections, connection_new(stream, client_fd));
+
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean open_socket(stream_t* stream, GError** error) {
+  struct sockaddr_un address = { .sun_family = AF_UNIX };
+
+  if (strlen(stream->path) >= sizeof(address.sun_path)) {
+    g_set_error(error, STREAM_ERROR, STREAM_ERROR_IO,
+                "Socket path %s is too long", stream->path);
+    return FALSE;
+  }
+
+  strcpy(address.sun_path, stream->path);
+
+  // Socket left by previous run would make `bind` fail
+  struct stat file_stat;
+  if (stat(stream->path, &file_stat) == 0 && S_ISSOCK(file_stat.st_mode))
+    unlink(stream->path);
+
+  stream->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  if (stream->listen_fd == -1 ||
+      bind(stream->listen_fd, (struct sockaddr*) &address, sizeof(address)) == -1 ||
+      listen(stream->listen_fd, SOMAXCONN) == -1) {
+    g_set_error(error, STREAM_ERROR, STREAM_ERROR_IO,
+                "Can't listen on %s: %s", stream->path, g_strerror(errno));
+    return FALSE;
+  }
+
+  g_unix_set_fd_nonblocking(stream->listen_fd, TRUE, NULL);
+
+  stream->listen_watch_id = g_unix_fd_add(stream->listen_fd, G_IO_IN,
+                                          on_client_connected, stream);
+  return TRUE;
+}
+
+stream_t* stream_open(const gchar* source, const gchar* default_name,
+                      stream_point_func_t on_point, gpointer user_data,
+                      GError** error) {
+  stream_t* stream = g_new0(stream_t, 1);
+
+  stream->default_name = g_strdup(default_name);
+  stream->on_point     = on_point;
+  stream->user_data    = user_data;
+  stream->listen_fd    = -1;
+
+  stream->connections = g_ptr_array_new_with_free_func((GDestroyNotify) connection_free);
+
+  if (strcmp(source, "-") == 0) {
+    stream->type = SOURCE_STDIN;
+    g_ptr_array_add(stream->connections, connection_new(stream, STDIN_FILENO));
+
+    return stream;
+  }
+
+  if (g_str_has_prefix(source, SOCKET_PREFIX)) {
+    stream->type = SOURCE_SOCKET;
+    stream->path = g_strdup(source + strlen(SOCKET_PREFIX));
+
+    if (!open_socket(stream, error)) {
+      stream_close(stream);
+      return NULL;
+    }
+
+    return stream;
+  }
+
+  stream->path = g_strdup(source);
+
+  struct stat file_stat;
+
+  int fd = open_fifo(stream->path);
+  if (fd == -1 || fstat(fd, &file_stat) == -1) {
+    g_set_error(error, STREAM_ERROR, STREAM_ERROR_IO,
+                "Can't open %s: %s", stream->path, g_strerror(errno));
+
+    if (fd != -1)
+      close(fd);
+
+    stream_close(stream);
+    return NULL;
+  }
+
+  // Only FIFO is reopened at the end, reopening a file
+  // would read the same points over and over again
+  if (S_ISFIFO(file_stat.st_mode))
+    stream->type = SOURCE_FIFO;
+  else if (S_ISREG(file_stat.st_mode))
+    stream->type = SOURCE_FILE;
+  else
+    stream->type = SOURCE_DEVICE;
+
+  g_ptr_array_add(stream->connections, connection_new(stream, fd));
+  return stream;
+}
+
+void stream_close(stream_t* stream) {
+  g_ptr_array_free(stream->connections, TRUE);
+
+  // Socket file is removed only if it's been created by this stream
+  if (stream->listen_watch_id != 0) {
+    g_source_remove(stream->listen_watch_id);
+    unlink(stream->path);
+  }
+
+  if (stream->listen_fd != -1)
+    close(stream->listen_fd);
+
+  g_free(stream->path);
+  g_free(stream->default_name);
+  g_free(stream);
+}
@@ -0,0 +1,44 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <glib.h>
+
+/*  Live input of points, to use the program as a telemetry plotter
+ *
+ *  Lines have the same format as imported files (see import.h),
+ *  usually `name, x, y`. They are read from one of the sources:
+ *
+ *      -            <-- standard input
+ *      unix:PATH    <-- Unix socket created at PATH, any number of
+ *                       clients may connect to it and write lines
+ *      PATH         <-- FIFO, reopened every time the last writer
+ *                       closes it, or plain file, which is read and
+ *                       then followed as lines are appended to it
+ *                       (like `tail -f` does)
+ *
+ *  Source is watched by the main loop and read without blocking,
+ *  so `on_point` runs on the main thread, once for every point.
+ *  */
+
+#define STREAM_ERROR stream_error_quark()
+GQuark stream_error_quark(void);
+
+typedef enum {
+  STREAM_ERROR_IO // <-- Source can't be opened
+} stream_error_t;
+
+// `name` is not NUL-terminated, it's valid only during the call
+typedef void (*stream_point_func_t)(const gchar* name, gsize name_length,
+                                    gdouble x, gdouble y, gpointer user_data);
+
+typedef struct stream stream_t;
+
+// Starts reading `source`, points without path name go to `default_name`
+stream_t* stream_open(const gchar* source, const gchar* default_name,
+                      stream_point_func_t on_point, gpointer user_data,
+                      GError** error);
+
+// Stops reading and closes the source (and all it's clients)
+void stream_close(stream_t* stream);
+
+#endif
@@ -0,0 +1,105 @@
+#include "trace.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+// Everything is shown as one process with one thread
+#define TRACE_PID 1
+#define TRACE_TID 1
+
+struct trace {
+  gchar* filename;
+  FILE*  file;
+
+  gboolean has_events;
+};
+
+GQuark trace_error_quark(void) {
+  return g_quark_from_static_string("trace-error-quark");
+}
+
+trace_t* trace_open(const gchar* filename, GError** error) {
+  FILE* file = fopen(filename, "w");
+
+  if (file == NULL) {
+    g_set_error(error, TRACE_ERROR, TRACE_ERROR_IO,
+                "Can't create %s: %s", filename, g_strerror(errno));
+    return NULL;
+  }
+
+  trace_t* trace = g_new0(trace_t, 1);
+
+  trace->filename = g_strdup(filename);
+  trace->file     = file;
+
+  fputs("{ \"displayTimeUnit\": \"ms\", \"traceEvents\": [\n", file);
+  return trace;
+}
+
+gboolean trace_close(trace_t* trace, GError** error) {
+  fputs("\n] }\n", trace->file);
+
+  gboolean is_written = !ferror(trace->file);
+  is_written = fclose(trace->file) == 0 && is_written;
+
+  if (!is_written)
+    g_set_error(error, TRACE_ERROR, TRACE_ERROR_IO,
+                "Can't write %s: %s", trace->filename, g_strerror(errno));
+
+  g_free(trace->filename);
+  g_free(trace);
+
+  return is_written;
+}
+
+static void start_event(trace_t* trace) {
+  if (trace->has_events)
+    fputs(",\n", trace->file);
+
+  trace->has_events = TRUE;
+}
+
+// Names come from the code, not from the user, so they are never escaped
+void trace_add_span(trace_t* trace, const gchar* name,
+                    gint64 start, gint64 duration) {
+  start_event(trace);
+
+  fprintf(trace->file,
+          "{ \"name\": \"%s\", \"ph\": \"X\", \"ts\": %" G_GINT64_FORMAT
+          ", \"dur\": %" G_GINT64_FORMAT ", \"pid\": %d, \"tid\": %d }",
+          name, start, duration, TRACE_PID, TRACE_TID);
+}
+
+void trace_add_counter(trace_t* trace, const gchar* name, gint64 time,
+                       const gchar* first_series, ...) {
+  start_event(trace);
+
+  fprintf(trace->file,
+          "{ \"name\": \"%s\", \"ph\": \"C\", \"ts\": %" G_GINT64_FORMAT
+          ", \"pid\": %d, \"args\": {",
+          name, time, TRACE_PID);
+
+  va_list arguments;
+  va_start(arguments, first_series);
+
+  for (const gchar* series = first_series; series != NULL;
+       series = va_arg(arguments, const gchar*)) {
+    gdouble value = va_arg(arguments, gdouble);
+
+    // Numbers are written the same in any locale (printf would put
+    // a comma in them under ru_RU), JSON has nothing for NaN or inf
+    gchar text[G_ASCII_DTOSTR_BUF_SIZE] = "null";
+
+    if (isfinite(value))
+      g_ascii_dtostr(text, sizeof(text), value);
+
+    fprintf(trace->file, "%s \"%s\": %s", series == first_series ? "" : ",",
+            series, text);
+  }
+
+  va_end(arguments);
+
+  fputs(" } }", trace->file);
+}
@@ -0,0 +1,39 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <glib.h>
+
+/*  Recording of timings in Chrome trace format
+ *
+ *  Written files open in chrome://tracing and ui.perfetto.dev.
+ *  Events go to the file as they come (through stdio buffer),
+ *  so recording can go on for as long as needed. Times are in
+ *  microseconds of `g_get_monotonic_time`.
+ *  */
+
+#define TRACE_ERROR trace_error_quark()
+GQuark trace_error_quark(void);
+
+typedef enum {
+  TRACE_ERROR_IO // <-- File can't be written
+} trace_error_t;
+
+typedef struct trace trace_t;
+
+trace_t* trace_open(const gchar* filename, GError** error);
+
+// Finishes the file, trace is freed even if it couldn't be written
+gboolean trace_close(trace_t* trace, GError** error);
+
+// Something that took `duration` starting at `start`, spans
+// shown in the same row have to be nested in each other
+void trace_add_span(trace_t* trace, const gchar* name,
+                    gint64 start, gint64 duration);
+
+// Values of one counter's series at `time`, they go in pairs
+// of series name and gdouble value, terminated by NULL. NaN and
+// infinite values are written as null
+void trace_add_counter(trace_t* trace, const gchar* name, gint64 time,
+                       const gchar* first_series, ...) G_GNUC_NULL_TERMINATED;
+
+#endif
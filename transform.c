@@ -0,0 +1,164 @@
+#include "transform.h"
+#include "compact.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAS_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+// Transforms one coordinate array: `output[i] = input[i] * scale + offset`
+typedef void (*kernel_func_t)(const gdouble* input, gsize n,
+                              gdouble scale, gdouble offset, gdouble* output);
+
+static void transform_scalar(const gdouble* input, gsize n,
+                             gdouble scale, gdouble offset, gdouble* output) {
+  for (gsize i = 0; i < n; ++ i)
+    output[i] = input[i] * scale + offset;
+}
+
+#ifdef HAS_X86_KERNELS
+
+// Arrays are not aligned (they come from `g_renew`), so all loads
+// and stores are unaligned, which costs nothing on recent CPUs
+
+__attribute__((target("sse2")))
+static void transform_sse2(const gdouble* input, gsize n,
+                           gdouble scale, gdouble offset, gdouble* output) {
+  __m128d scales  = _mm_set1_pd(scale);
+  __m128d offsets = _mm_set1_pd(offset);
+
+  gsize i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d values = _mm_loadu_pd(input + i);
+    _mm_storeu_pd(output + i, _mm_add_pd(_mm_mul_pd(values, scales), offsets));
+  }
+
+  transform_scalar(input + i, n - i, scale, offset, output + i);
+}
+
+__attribute__((target("avx2")))
+static void transform_avx2(const gdouble* input, gsize n,
+                           gdouble scale, gdouble offset, gdouble* output) {
+  __m256d scales  = _mm256_set1_pd(scale);
+  __m256d offsets = _mm256_set1_pd(offset);
+
+  gsize i = 0;
+
+  // Two vectors per iteration keep both multipliers busy
+  for (; i + 8 <= n; i += 8) {
+    __m256d first  = _mm256_loadu_pd(input + i);
+    __m256d second = _mm256_loadu_pd(input + i + 4);
+
+    _mm256_storeu_pd(output + i    , _mm256_add_pd(_mm256_mul_pd(first , scales), offsets));
+    _mm256_storeu_pd(output + i + 4, _mm256_add_pd(_mm256_mul_pd(second, scales), offsets));
+  }
+
+  for (; i + 4 <= n; i += 4) {
+    __m256d values = _mm256_loadu_pd(input + i);
+    _mm256_storeu_pd(output + i, _mm256_add_pd(_mm256_mul_pd(values, scales), offsets));
+  }
+
+  transform_scalar(input + i, n - i, scale, offset, output + i);
+}
+
+#endif
+
+static const struct {
+  const gchar*  name;
+  kernel_func_t func;
+} kernels[N_TRANSFORM_KERNELS] = {
+  [TRANSFORM_KERNEL_SCALAR] = { "scalar", transform_scalar },
+#ifdef HAS_X86_KERNELS
+  [TRANSFORM_KERNEL_SSE2  ] = { "sse2"  , transform_sse2   },
+  [TRANSFORM_KERNEL_AVX2  ] = { "avx2"  , transform_avx2   },
+#else
+  [TRANSFORM_KERNEL_SSE2  ] = { "sse2"  , NULL             },
+  [TRANSFORM_KERNEL_AVX2  ] = { "avx2"  , NULL             },
+#endif
+};
+
+gboolean transform_kernel_is_supported(transform_kernel_t kernel) {
+  switch (kernel) {
+  case TRANSFORM_KERNEL_SCALAR:
+    return TRUE;
+
+#ifdef HAS_X86_KERNELS
+  case TRANSFORM_KERNEL_SSE2:
+    return __builtin_cpu_supports("sse2");
+
+  case TRANSFORM_KERNEL_AVX2:
+    return __builtin_cpu_supports("avx2");
+#endif
+
+  default:
+    return FALSE;
+  }
+}
+
+const gchar* transform_kernel_get_name(transform_kernel_t kernel) {
+  g_return_val_if_fail(kernel < N_TRANSFORM_KERNELS, NULL);
+  return kernels[kernel].name;
+}
+
+transform_kernel_t transform_get_best_kernel(void) {
+  // It's called from tile threads, so CPU is checked only once
+  static gsize best_kernel = 0;
+
+  if (g_once_init_enter(&best_kernel)) {
+    transform_kernel_t kernel = N_TRANSFORM_KERNELS - 1;
+    while (!transform_kernel_is_supported(kernel))
+      -- kernel;
+
+    // Stored plus one, since zero means it's not known yet
+    g_once_init_leave(&best_kernel, kernel + 1);
+  }
+
+  return best_kernel - 1;
+}
+
+void transform_points_with_kernel(transform_kernel_t kernel,
+                                  const transform_t* transform,
+                                  const gdouble* xs, const gdouble* ys, gsize n_points,
+                                  gdouble* screen_xs, gdouble* screen_ys) {
+  g_return_if_fail(transform_kernel_is_supported(kernel));
+
+  kernel_func_t func = kernels[kernel].func;
+
+  func(xs, n_points, transform->scale_x, transform->offset_x, screen_xs);
+  func(ys, n_points, transform->scale_y, transform->offset_y, screen_ys);
+}
+
+void transform_points(const transform_t* transform,
+                      const gdouble* xs, const gdouble* ys, gsize n_points,
+                      gdouble* screen_xs, gdouble* screen_ys) {
+  kernel_func_t func = kernels[transform_get_best_kernel()].func;
+
+  func(xs, n_points, transform->scale_x, transform->offset_x, screen_xs);
+  func(ys, n_points, transform->scale_y, transform->offset_y, screen_ys);
+}
+
+void transform_path_points(const transform_t* transform, const path_t* path,
+                           gsize from, gsize n_points,
+                           gdouble* screen_xs, gdouble* screen_ys) {
+  if (path->compact == NULL) {
+    transform_points(transform, path->xs + from, path->ys + from, n_points,
+                     screen_xs, screen_ys);
+    return;
+  }
+
+  gdouble xs[COMPACT_BLOCK_SIZE], ys[COMPACT_BLOCK_SIZE];
+
+  // Pieces end where blocks do, so no block is decoded twice
+  while (n_points != 0) {
+    gsize n_read = MIN(n_points, COMPACT_BLOCK_SIZE - from % COMPACT_BLOCK_SIZE);
+
+    path_get_points(path, from, n_read, xs, ys);
+    transform_points(transform, xs, ys, n_read, screen_xs, screen_ys);
+
+    screen_xs += n_read;
+    screen_ys += n_read;
+
+    from     += n_read;
+    n_points -= n_read;
+  }
+}
@@ -0,0 +1,98 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include "point_store.h"
+
+// Maps points from data space to the widget (screen) space:
+//
+//     screen_x = x * scale_x + offset_x
+//     screen_y = y * scale_y + offset_y
+//
+// `scale_y` is negative, since Y axis of the screen points down
+typedef struct {
+  gdouble scale_x, scale_y;
+  gdouble offset_x, offset_y;
+} transform_t;
+
+static inline gdouble transform_x(const transform_t* transform, gdouble x) {
+  return x * transform->scale_x + transform->offset_x;
+}
+
+static inline gdouble transform_y(const transform_t* transform, gdouble y) {
+  return y * transform->scale_y + transform->offset_y;
+}
+
+// Inverse of `transform_x` and `transform_y`
+static inline gdouble transform_inverse_x(const transform_t* transform, gdouble x) {
+  return (x - transform->offset_x) / transform->scale_x;
+}
+
+static inline gdouble transform_inverse_y(const transform_t* transform, gdouble y) {
+  return (y - transform->offset_y) / transform->scale_y;
+}
+
+// Fits `viewport` (part of data space) into a widget of the given size,
+// leaving `padding` pixels free on every side
+static inline transform_t transform_for_viewport(const bounds_t* viewport,
+                                                 int width, int height,
+                                                 int padding) {
+  gdouble scale_x = (width  - 2 * padding) / (viewport->max.x - viewport->min.x);
+  gdouble scale_y = (height - 2 * padding) / (viewport->max.y - viewport->min.y);
+
+  return (transform_t) {
+    .scale_x  =   scale_x,
+    .scale_y  = - scale_y,
+    .offset_x = padding - viewport->min.x * scale_x,
+    .offset_y = padding + viewport->max.y * scale_y
+  };
+}
+
+static inline gboolean transform_equal(const transform_t* first,
+                                       const transform_t* second) {
+  return first->scale_x  == second->scale_x  &&
+         first->scale_y  == second->scale_y  &&
+         first->offset_x == second->offset_x &&
+         first->offset_y == second->offset_y;
+}
+
+/*  Batch versions of `transform_x` and `transform_y` for whole arrays
+ *
+ *  There are a few implementations (kernels) of the same thing, the
+ *  best one that the CPU supports is picked when it's first needed.
+ *  All of them give exactly the same results as `transform_x` and
+ *  `transform_y` (there's no fused multiply-add anywhere).
+ *  */
+
+typedef enum {
+  TRANSFORM_KERNEL_SCALAR, // <-- Plain loop, it works everywhere
+  TRANSFORM_KERNEL_SSE2,   // <-- Two coordinates at a time, x86 only
+  TRANSFORM_KERNEL_AVX2,   // <-- Four coordinates at a time, x86 only
+
+  N_TRANSFORM_KERNELS
+} transform_kernel_t;
+
+gboolean     transform_kernel_is_supported(transform_kernel_t kernel);
+const gchar* transform_kernel_get_name    (transform_kernel_t kernel);
+
+// Fastest of the kernels supported by the CPU
+transform_kernel_t transform_get_best_kernel(void);
+
+// Transforms `n_points` points from `xs` and `ys` into `screen_xs`
+// and `screen_ys`, input and output arrays must not overlap
+void transform_points(const transform_t* transform,
+                      const gdouble* xs, const gdouble* ys, gsize n_points,
+                      gdouble* screen_xs, gdouble* screen_ys);
+
+// Same as `transform_points` for `n_points` points of `path` starting
+// from `from`-th one, it decodes them on the way if path is compact
+void transform_path_points(const transform_t* transform, const path_t* path,
+                           gsize from, gsize n_points,
+                           gdouble* screen_xs, gdouble* screen_ys);
+
+// Same as `transform_points` with the given (supported) kernel
+void transform_points_with_kernel(transform_kernel_t kernel,
+                                  const transform_t* transform,
+                                  const gdouble* xs, const gdouble* ys, gsize n_points,
+                                  gdouble* screen_xs, gdouble* screen_ys);
+
+#endif